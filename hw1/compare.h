@@ -0,0 +1,184 @@
+/*
+ * compare.h
+ *
+ * Description: Compare mode of the benchmark drivers. A run is compared
+ * with a stored stats file of the same configuration (the baseline): the
+ * per-iteration times of both are ranked together and a one-sided
+ * Mann-Whitney U test asks whether the new times are larger. The run is a
+ * regression when the test is significant at COMPARE_ALPHA and the median
+ * time grew by more than COMPARE_MIN_SLOWDOWN, so a tiny but consistent
+ * shift on a quiet machine does not fail the gate.
+ *
+ * Usage:
+ *   n0 = compare_load_baseline(path, filename, &baseline);  before fopen
+ *   ... run, usecs[iter] per iteration ...
+ *   if (compare_report(fp, path, baseline, n0, usecs, num_iters))
+ *       return COMPARE_REGRESSION;
+ */
+
+#ifndef COMPARE_H
+#define COMPARE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/time.h>
+
+#define COMPARE_ALPHA 0.01
+#define COMPARE_MIN_SLOWDOWN 0.05
+#define COMPARE_REGRESSION (-3)     // exit status of a regression
+
+// compare_load_baseline: the per-iteration times of the stats file path into
+// *samples (malloc'ed). stats_file is the name of the stats file this run
+// writes and must match the "Stats file:" line of the baseline, so only runs
+// of the same configuration are compared. Returns the number of samples, -1
+// if the file can't be read or has no iterations, -2 if the configuration
+// differs.
+static int compare_load_baseline(const char *path, const char *stats_file,
+                                 suseconds_t **samples)
+{
+    char line[512];
+    char name[256] = "";
+    int count = 0, capacity = 16;
+    int iter, iter_usec;
+    suseconds_t *buf;
+    FILE *fp = fopen(path, "r");
+
+    *samples = NULL;
+    if (fp == NULL)
+        return -1;
+    buf = (suseconds_t *) malloc(sizeof(suseconds_t) * capacity);
+    if (buf == NULL) {
+        fclose(fp);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (sscanf(line, "Stats file: %255s", name) == 1)
+            continue;
+        if (sscanf(line, "iteration %d elapsed time: %d (usec)", &iter,
+                   &iter_usec) != 2)
+            continue;
+        if (count == capacity) {
+            suseconds_t *grown = (suseconds_t *) realloc(buf,
+                                     sizeof(suseconds_t) * capacity * 2);
+            if (grown == NULL)
+                break;
+            buf = grown;
+            capacity *= 2;
+        }
+        buf[count++] = iter_usec;
+    }
+    fclose(fp);
+
+    if (strcmp(name, stats_file) != 0) {
+        free(buf);
+        return -2;
+    }
+    if (count == 0) {
+        free(buf);
+        return -1;
+    }
+    *samples = buf;
+
+    return count;
+}
+
+static int compare_cmp_usec(const void *a, const void *b)
+{
+    suseconds_t x = *(const suseconds_t *) a;
+    suseconds_t y = *(const suseconds_t *) b;
+    return (x > y) - (x < y);
+}
+
+// compare_median: median of n sorted samples
+static double compare_median(const suseconds_t *sorted, int n)
+{
+    return (n % 2) ? sorted[n / 2] : 0.5 * (sorted[n / 2 - 1] + sorted[n / 2]);
+}
+
+// compare_mann_whitney: one-sided Mann-Whitney U test of "the current
+// samples are larger than the baseline" on sorted samples; sets *u to the
+// U statistic of the current samples and returns the p-value from the
+// normal approximation with tie and continuity corrections
+static double compare_mann_whitney(const suseconds_t *base, int n0,
+                                   const suseconds_t *cur, int n1, double *u)
+{
+    double rank_sum = 0.0, ties = 0.0;
+    int n = n0 + n1;
+    int i = 0, j = 0, rank = 1;
+
+    // merge the two sorted lists; a run of equal times shares its mean rank
+    while (i < n0 || j < n1) {
+        suseconds_t x = (j == n1 || (i < n0 && base[i] <= cur[j])) ? base[i] : cur[j];
+        int in_base = 0, in_cur = 0;
+        while (i < n0 && base[i] == x) {
+            i++;
+            in_base++;
+        }
+        while (j < n1 && cur[j] == x) {
+            j++;
+            in_cur++;
+        }
+        int t = in_base + in_cur;
+        rank_sum += in_cur * (rank + (t - 1) / 2.0);
+        ties += (double) t * t * t - t;
+        rank += t;
+    }
+
+    *u = rank_sum - n1 * (n1 + 1) / 2.0;
+    double mean = n0 * (double) n1 / 2.0;
+    double var = n0 * (double) n1 / 12.0 * ((n + 1) - ties / ((double) n * (n - 1)));
+    if (var <= 0.0)
+        return 1.0;     // every time is the same
+    double z = (*u - mean - 0.5) / sqrt(var);
+
+    return 0.5 * erfc(z / sqrt(2.0));
+}
+
+// compare_report: test the num_iters times of this run against the baseline
+// and print the verdict to stdout and fp; returns 1 on a regression, or if
+// the comparison can't be made
+static int compare_report(FILE *fp, const char *path, suseconds_t *baseline,
+                          int n0, const suseconds_t *usecs, int n1)
+{
+    suseconds_t *current = NULL;
+    double u, p, base_median, cur_median, change;
+    int regression;
+
+    if (n1 < 1)
+        return 0;
+    current = (suseconds_t *) malloc(sizeof(suseconds_t) * n1);
+    if (current == NULL) {
+        printf("ERROR: can't allocate %d samples to compare with %s!\n", n1, path);
+        fprintf(fp, "ERROR: can't allocate %d samples to compare with %s!\n", n1, path);
+        return 1;
+    }
+    memcpy(current, usecs, sizeof(suseconds_t) * n1);
+    qsort(baseline, n0, sizeof(suseconds_t), compare_cmp_usec);
+    qsort(current, n1, sizeof(suseconds_t), compare_cmp_usec);
+
+    p = compare_mann_whitney(baseline, n0, current, n1, &u);
+    base_median = compare_median(baseline, n0);
+    cur_median = compare_median(current, n1);
+    change = base_median > 0 ? cur_median / base_median - 1.0 : 0.0;
+    regression = (p < COMPARE_ALPHA && change > COMPARE_MIN_SLOWDOWN);
+
+    printf("\nBaseline: %s, %d iterations, median %.0f (usec)\n", path, n0, base_median);
+    fprintf(fp, "\nBaseline: %s, %d iterations, median %.0f (usec)\n", path, n0, base_median);
+    printf("Current: %d iterations, median %.0f (usec), change %+.1f%%\n",
+            n1, cur_median, 100.0 * change);
+    fprintf(fp, "Current: %d iterations, median %.0f (usec), change %+.1f%%\n",
+            n1, cur_median, 100.0 * change);
+    printf("Mann-Whitney U = %.1f, one-sided p = %.4f (alpha %.2f, min slowdown %.0f%%): %s\n",
+            u, p, COMPARE_ALPHA, 100.0 * COMPARE_MIN_SLOWDOWN,
+            regression ? "REGRESSION" : "no significant slowdown");
+    fprintf(fp, "Mann-Whitney U = %.1f, one-sided p = %.4f (alpha %.2f, min slowdown %.0f%%): %s\n",
+            u, p, COMPARE_ALPHA, 100.0 * COMPARE_MIN_SLOWDOWN,
+            regression ? "REGRESSION" : "no significant slowdown");
+
+    free(current);
+    return regression;
+}
+
+#endif // COMPARE_H
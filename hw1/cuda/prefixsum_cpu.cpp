@@ -0,0 +1,146 @@
+// Host backend of prefixsum_cuda.cu: the same Scan(d_in, d_out, buffer, n)
+// entry point and driver, with warps mapped to SIMD lanes and thread blocks
+// mapped to cache-sized tiles scanned by OpenMP threads.
+#include <stdio.h>
+#include <stdlib.h>
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include <omp.h>
+
+#define WARP_LANES 4      // floats per SIMD "warp" (one SSE register)
+#define TILE1D 4096       // floats per tile (16 KB, stays in L1 while scanned)
+
+typedef float warp_t __attribute__((vector_size(WARP_LANES * sizeof(float))));
+typedef int lane_mask_t __attribute__((vector_size(WARP_LANES * sizeof(int))));
+
+void Initialize(float *h_in, int num_items) {
+    for (int ii = 0; ii < num_items; ii++) h_in[ii] = float(ii)/1000.0f;
+}
+
+// The reference accumulates in double: a serial float sum drifts past the
+// assnear tolerance after ~1.5M items, well before the tiled scan does.
+void Solve(float *h_in, float *h_reference, int num_items) {
+    double inclusive = 0;
+    for (int ii = 0; ii < num_items; ii++) {
+        inclusive += h_in[ii];
+        h_reference[ii] = inclusive;
+    }
+    return ;
+}
+
+int assnear(float a, float b, float abs_err = 1e-1, float rel_err = 1e-3) {
+    if(std::abs(a-b) > abs_err && std::abs(a-b)/a > rel_err) return 0;
+    return 1;
+}
+
+int TestResult(float *h_out, float *h_reference, int nums) {
+    for(int ii = 0; ii < nums; ii++) {
+        if(!assnear(h_reference[ii], h_out[ii])) {
+            printf("FATAL : Error at %d : reference = %f, out = %f\n", ii, h_reference[ii], h_out[ii]);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+// WarpScan: the __shfl_up_sync ladder of the CUDA version, with lane shifts
+// of the SIMD register instead of shuffles
+static inline __attribute__((always_inline)) warp_t WarpScan(warp_t val) {
+    const warp_t zero = {0};
+    val += __builtin_shuffle(zero, val, (lane_mask_t){0, 4, 5, 6});
+    val += __builtin_shuffle(zero, val, (lane_mask_t){0, 1, 4, 5});
+    return val;
+}
+
+// BlockScan: scan one tile warp by warp; the warp_sum scan of the CUDA
+// version becomes a running carry broadcast to all the lanes. Returns the
+// tile total.
+static inline float BlockScan(const float *in, float *out, int num_items) {
+    warp_t carry = {0};
+    int idx = 0;
+    for (; idx + WARP_LANES <= num_items; idx += WARP_LANES) {
+        warp_t val;
+        __builtin_memcpy(&val, in + idx, sizeof(val));
+        val = WarpScan(val) + carry;
+        __builtin_memcpy(out + idx, &val, sizeof(val));
+        carry = warp_t{} + val[WARP_LANES - 1];
+    }
+    float inclusive = carry[0];
+    for (; idx < num_items; idx++) {
+        inclusive += in[idx];
+        out[idx] = inclusive;
+    }
+    return inclusive;
+}
+
+void ScanKernel(float *in, float *out,
+        float *buffer, int num_items, int num_part) {
+    #pragma omp parallel for schedule(static)
+    for(int ii = 0; ii < num_part; ii++) {
+        int idx = TILE1D * ii;
+        int len = std::min<int>(TILE1D, num_items - idx);
+        buffer[ii] = BlockScan(in + idx, out + idx, len);
+    }
+}
+
+void AddBaseKernel(float *buffer, float *out,
+    int num_items, int num_part) {
+    #pragma omp parallel for schedule(static)
+    for(int ii = 1; ii < num_part; ii++) {
+        float base = buffer[ii - 1];
+        int end = std::min<int>(TILE1D * (ii + 1), num_items);
+        for(int idx = ii * TILE1D; idx < end; idx++) out[idx] += base;
+    }
+}
+
+// Scan: same recursion as the CUDA version. Every level keeps its tile
+// totals and their scan in its own 2 * num_part slice of buffer, so a level
+// never overwrites the input of the level below; 4 * ceil(n / TILE1D) floats
+// are enough for all the levels.
+void Scan(float *d_in, float *d_out, float *buffer, int num_items) {
+    int num_part = (num_items + TILE1D - 1) / TILE1D;
+    ScanKernel(d_in, d_out, buffer, num_items, num_part);
+    if(num_part >= 2) {
+        Scan(buffer, buffer + num_part, buffer + 2 * num_part, num_part);
+        AddBaseKernel(buffer + num_part, d_out, num_items, num_part);
+    }
+}
+
+int main(int argc, char **argv) {
+    int num_items = 4096;
+    int num_iters = 1;
+    if(argc > 1) num_items = std::atoi(argv[1]);
+    if(argc > 2) num_iters = std::max(1, std::atoi(argv[2]));
+    float *h_in = new float [num_items];
+    float *h_out = new float [num_items];
+    float *h_reference = new float [num_items];
+    // Loose array
+    int buffer_items = (num_items + TILE1D - 1) / TILE1D * 4;
+    float *buffer = new float [buffer_items]();
+
+    Initialize(h_in, num_items);
+    Solve(h_in, h_reference, num_items);
+
+    // first touch of the output and the buffer outside of the timed region
+    Scan(h_in, h_out, buffer, num_items);
+
+    auto start = std::chrono::steady_clock::now();
+    for(int iter = 0; iter < num_iters; iter++)
+        Scan(h_in, h_out, buffer, num_items);
+    auto stop = std::chrono::steady_clock::now();
+    float milliseconds =
+        std::chrono::duration<float, std::milli>(stop - start).count() / num_iters;
+    printf("%f", milliseconds);
+
+    int passed = TestResult(h_out, h_reference, num_items);
+
+    delete[] h_in;
+    delete[] h_reference;
+    delete[] h_out;
+    delete[] buffer;
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,76 @@
+/*
+ * sum_engine.h
+ *
+ * Description: Reduction kernels shared by the sum examples.
+ *
+ * sum_int64 widens the int inputs to 64-bit while summing, so the sum of up
+ * to 2^32 ints of any value cannot overflow. It keeps SUM_VECTORS
+ * independent vector accumulators of two int64 lanes each, so the adds of
+ * consecutive vectors do not wait on each other and the loop runs at the
+ * speed of the loads (memory bandwidth for arrays larger than the caches).
+ * sum_int64_omp splits the array into one contiguous block per thread.
+ */
+
+#ifndef SUM_ENGINE_H
+#define SUM_ENGINE_H
+
+#include <string.h>
+
+#define SUM_VECTORS 8       // independent accumulators, 2 int64 lanes each
+
+typedef int v4si_t __attribute__((vector_size(16)));
+typedef long v2di_t __attribute__((vector_size(16)));
+
+// sum_int64: widening sum of n ints
+static inline long sum_int64(const int *data, long n)
+{
+    v2di_t acc[SUM_VECTORS];
+    long i = 0, sum = 0;
+    int k;
+
+    for (k = 0; k < SUM_VECTORS; k++)
+        acc[k] = (v2di_t) {0, 0};
+
+    // SUM_VECTORS int64 vectors are 4 * (SUM_VECTORS / 2) ints per step
+    for (; i + 2 * SUM_VECTORS <= n; i += 2 * SUM_VECTORS) {
+        for (k = 0; k < SUM_VECTORS / 2; k++) {
+            v4si_t x;
+            memcpy(&x, data + i + 4 * k, sizeof(x));
+            acc[2 * k] += __builtin_convertvector(
+                __builtin_shufflevector(x, x, 0, 1), v2di_t);
+            acc[2 * k + 1] += __builtin_convertvector(
+                __builtin_shufflevector(x, x, 2, 3), v2di_t);
+        }
+    }
+
+    for (k = 1; k < SUM_VECTORS; k++)
+        acc[0] += acc[k];
+    sum = acc[0][0] + acc[0][1];
+    for (; i < n; i++)
+        sum += data[i];
+
+    return sum;
+}
+
+#ifdef _OPENMP
+#include <omp.h>
+
+// sum_int64_omp: widening sum of n ints, one contiguous block per thread
+static inline long sum_int64_omp(const int *data, long n)
+{
+    long sum = 0;
+
+    #pragma omp parallel reduction(+:sum)
+    {
+        int tid = omp_get_thread_num();
+        int num_threads = omp_get_num_threads();
+        long start = n * tid / num_threads;
+        long end = n * (tid + 1) / num_threads;
+        sum += sum_int64(data + start, end - start);
+    }
+
+    return sum;
+}
+#endif // #ifdef _OPENMP
+
+#endif // #ifndef SUM_ENGINE_H
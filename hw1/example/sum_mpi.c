@@ -6,7 +6,11 @@
  *
  * Procedure:
  * 1. Each processor generates num_elems random integers in parallel;
- * 2. All the processors run in parallel to compute the final sum using MPI.
+ * 2. Each processor sums its partition with the widening multi-accumulator
+ *    kernel of sum_engine.h;
+ * 3. All the processors run in parallel to compute the final sum using MPI:
+ *    MPI_Reduce to processor 0 (default), MPI_Allreduce to every processor,
+ *    or a binomial tree of point-to-point messages to processor 0.
  */
 
 #include <stdio.h>
@@ -18,6 +22,8 @@
 #include <sys/time.h>
 #include <mpi.h>
 
+#include "sum_engine.h"
+
 #define MAX_INT 2147483647
 //#define PRINT_SUM
 
@@ -28,6 +34,25 @@ inline suseconds_t usec(struct timeval start, struct timeval end)
                      (start.tv_sec * 1000000 + start.tv_usec))));
 }
 
+// tree_reduce: binomial tree sum to processor 0, ceil(log2(num_procs)) steps
+long tree_reduce(long value, int rank, int num_procs)
+{
+    int step;
+    long recv;
+    for (step = 1; step < num_procs; step <<= 1) {
+        if (rank & step) {
+            MPI_Send(&value, 1, MPI_LONG, rank - step, 0, MPI_COMM_WORLD);
+            break;
+        }
+        if (rank + step < num_procs) {
+            MPI_Recv(&recv, 1, MPI_LONG, rank + step, 0, MPI_COMM_WORLD,
+                     MPI_STATUS_IGNORE);
+            value += recv;
+        }
+    }
+    return value;   // the total on processor 0 only
+}
+
 int main(int argc, char *argv[])
 {
     // command line arguments
@@ -59,9 +84,10 @@ int main(int argc, char *argv[])
 
     if (argc < 3) {
         if (rank == 0) {
-            printf("Usage: %s [num_elems] [num_iters]\n", argv[0]);
+            printf("Usage: %s [num_elems] [num_iters] [variant]\n", argv[0]);
             printf("    - num_elems:  number of elements\n");
             printf("    - num_iters: number of iterations\n");
+            printf("    - variant: reduce (default), allreduce or tree\n");
         }
 
         MPI_Finalize();
@@ -71,6 +97,15 @@ int main(int argc, char *argv[])
     num_elems = atoi(argv[1]);
     num_iters = atoi(argv[2]);
 
+    const char *variant = (argc > 3) ? argv[3] : "reduce";
+    if (strcmp(variant, "reduce") && strcmp(variant, "allreduce") &&
+        strcmp(variant, "tree")) {
+        if (rank == 0)
+            printf("Unknown variant %s!\n", variant);
+        MPI_Finalize();
+        exit(-1);
+    }
+
     MPI_Comm_size(MPI_COMM_WORLD, &num_procs); // get the number of processes
 
     char filename[256] = "sum_mpi_";
@@ -88,11 +123,11 @@ int main(int argc, char *argv[])
     if (rank == 0) {
         fp = fopen(filename, "w");
         if (fp) {
-            printf("Command line: mpirun -np %d %s %d %d\n",
-                    num_procs, argv[0], num_elems, num_iters);
+            printf("Command line: mpirun -np %d %s %d %d %s\n",
+                    num_procs, argv[0], num_elems, num_iters, variant);
             printf("Stats file: %s\n\n", filename);
-            fprintf(fp, "Command line: mpirun -np %d %s %d %d\n",
-                    num_procs, argv[0], num_elems, num_iters);
+            fprintf(fp, "Command line: mpirun -np %d %s %d %d %s\n",
+                    num_procs, argv[0], num_elems, num_iters, variant);
             fprintf(fp, "Stats file: %s\n\n", filename);
         } else {
             printf("ERROR: can't open the file %s!\n", filename);
@@ -110,7 +145,7 @@ int main(int argc, char *argv[])
     if (rank < num_elems_remain) {
         my_num_elems = num_elems_mean + 1;
     } else {
-        my_num_elems = num_elems;
+        my_num_elems = num_elems_mean;
     }
 
     int start, end;
@@ -165,13 +200,15 @@ int main(int argc, char *argv[])
         gettimeofday(&start_time, NULL);
 
         // compute the local sum in each process
-        local_sum = 0;
+        local_sum = sum_int64(local_data, my_num_elems);
         sum = 0;
-        for (i = 0; i < my_num_elems; i++) {
-            local_sum += local_data[i];
-        }
 
-        MPI_Reduce(&local_sum, &sum, 1, MPI_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (variant[0] == 'r')
+            MPI_Reduce(&local_sum, &sum, 1, MPI_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+        else if (variant[0] == 'a')
+            MPI_Allreduce(&local_sum, &sum, 1, MPI_LONG, MPI_SUM, MPI_COMM_WORLD);
+        else
+            sum = tree_reduce(local_sum, rank, num_procs);
 
         gettimeofday(&end_time, NULL);
 
@@ -193,6 +230,10 @@ int main(int argc, char *argv[])
                 total_usec / num_iters);
         fprintf(fp, "Sum average elapsed time: %d (usec)\n",
                 total_usec / num_iters);
+        printf("Sum bandwidth: %.2f (GB/s), sum: %ld\n",
+                total_usec > 0 ? (double) sizeof(int) * num_elems * num_iters / total_usec / 1e3 : 0.0, sum);
+        fprintf(fp, "Sum bandwidth: %.2f (GB/s), sum: %ld\n",
+                total_usec > 0 ? (double) sizeof(int) * num_elems * num_iters / total_usec / 1e3 : 0.0, sum);
 
 #ifdef PRINT_SUM
         fprintf(fp, "\nInputs:");
@@ -8,7 +8,9 @@
  * 1. All the threads generate num_elems random integers (in parallel OpenMP
  *    region);
  * 2. All the threads compute the final sum of the inputs in parallel
- *    through shared memory (in parallel OpenMP region).
+ *    through shared memory (in parallel OpenMP region), each thread summing
+ *    its contiguous block with the widening multi-accumulator kernel of
+ *    sum_engine.h.
  */
 
 #include <stdio.h>
@@ -20,6 +22,8 @@
 #include <sys/time.h>
 #include <omp.h>
 
+#include "sum_engine.h"
+
 #define MAX_INT 2147483647
 //#define PRINT_SUM
 
@@ -146,14 +150,9 @@ int main(int argc, char *argv[])
     int i;
     for (iter = 0; iter < num_iters; iter++) {
 
-        sum = 0;
-
         gettimeofday(&start_time, NULL);
         // Parallel sum reduction using OpenMP
-        #pragma omp parallel for reduction(+:sum)
-        for (i = 0; i < num_elems; i++) {
-            sum += data[i];
-        }
+        sum = sum_int64_omp(data, num_elems);
         gettimeofday(&end_time, NULL);
 
         iter_usec = usec(start_time, end_time);
@@ -169,6 +168,10 @@ int main(int argc, char *argv[])
     printf("Sum average elapsed time: %d (usec)\n", total_usec / num_iters);
     fprintf(fp, "Sum average elapsed time: %d (usec)\n",
             total_usec / num_iters);
+    printf("Sum bandwidth: %.2f (GB/s), sum: %ld\n",
+            total_usec > 0 ? (double) sizeof(int) * num_elems * num_iters / total_usec / 1e3 : 0.0, sum);
+    fprintf(fp, "Sum bandwidth: %.2f (GB/s), sum: %ld\n",
+            total_usec > 0 ? (double) sizeof(int) * num_elems * num_iters / total_usec / 1e3 : 0.0, sum);
 
 #ifdef PRINT_SUM
     fprintf(fp, "\nInputs:");
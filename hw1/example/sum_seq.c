@@ -7,7 +7,8 @@
  * Procedure:
  * 1. The processor generates num_elems random integers;
  * 2. The processor compute the sum from the first element to the last
- *    one. The computation complexity is O(N).
+ *    one with the widening multi-accumulator kernel of sum_engine.h. The
+ *    computation complexity is O(N).
  */
 
 #include <stdio.h>
@@ -18,6 +19,8 @@
 #include <sys/resource.h>
 #include <sys/time.h>
 
+#include "sum_engine.h"
+
 #define MAX_INT 2147483647
 //#define PRINT_SUM
 
@@ -90,12 +93,8 @@ int main(int argc, char *argv[])
     int iter;
     for (iter = 0; iter < num_iters; iter++) {
 
-        sum = 0;
-
         gettimeofday(&start, NULL);
-        for (i = 1; i < num_elems; i++) {
-            sum += data[i-1];
-        }
+        sum = sum_int64(data, num_elems);
         gettimeofday(&end, NULL);
 
         iter_usec = usec(start, end);
@@ -111,6 +110,10 @@ int main(int argc, char *argv[])
     printf("Sum average elapsed time: %d (usec)\n", total_usec / num_iters);
     fprintf(fp, "Sum average elapsed time: %d (usec)\n",
             total_usec / num_iters);
+    printf("Sum bandwidth: %.2f (GB/s), sum: %ld\n",
+            total_usec > 0 ? (double) sizeof(int) * num_elems * num_iters / total_usec / 1e3 : 0.0, sum);
+    fprintf(fp, "Sum bandwidth: %.2f (GB/s), sum: %ld\n",
+            total_usec > 0 ? (double) sizeof(int) * num_elems * num_iters / total_usec / 1e3 : 0.0, sum);
 
 #ifdef PRINT_SUM
     fprintf(fp, "\nInputs:");
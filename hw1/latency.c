@@ -1,42 +1,362 @@
+/*
+ * latency.c
+ *
+ * Description: Communication microbenchmarks for modeling the carry phase of
+ * the MPI prefix sums.
+ *
+ * Procedure:
+ * 1. Ping-pong between ranks 0 and 1 over message sizes from 1 byte to
+ *    max_bytes: one-way time percentiles and bandwidth. A least-squares fit
+ *    T(n) = alpha + beta * n of the median one-way times gives the latency
+ *    and bandwidth of the link;
+ * 2. For 2, 4, 8, ... ranks (and all of them): MPI_Exscan, MPI_Scan and
+ *    MPI_Allreduce of one long, the chain carry of prefixsum_mpi.c (receive
+ *    from rank - 1, send to rank + 1) and a tree carry (recursive doubling
+ *    with MPI_Sendrecv). Each repetition takes the slowest rank's time;
+ * 3. Cost model: the chain carry is fitted as a + b * (p - 1) and the other
+ *    patterns as a + b * ceil(log2(p)) over the measured rank counts, and
+ *    the carry time is predicted at rank counts that are not available
+ *    locally, next to the pure ping-pong estimate (alpha + 8 * beta per
+ *    step).
+ */
+
 #include <mpi.h>
+#include <math.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_REPS 1000
+#define DEFAULT_MAX_BYTES (4 << 20)
+#define WARMUP_REPS 10
+#define MIN_LARGE_REPS 20           // repetitions of the largest messages
+
+#define NUM_PATTERNS 5
+#define MAX_RANK_COUNTS 32
+
+static const int predict_procs[] = {64, 128, 256, 512, 1024};
+#define NUM_PREDICT (sizeof(predict_procs) / sizeof(predict_procs[0]))
+
+typedef struct {
+    double min, p50, p90, p99, max;
+} percentiles_t;
+
+static FILE *fp = NULL;
+
+// report: print to stdout and to the stats file
+static void report(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+    va_start(args, fmt);
+    vfprintf(fp, fmt, args);
+    va_end(args);
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+// percentiles: sorts the samples in place
+percentiles_t percentiles(double *samples, int n)
+{
+    percentiles_t p;
+    qsort(samples, n, sizeof(double), compare_double);
+    p.min = samples[0];
+    p.p50 = samples[(int) ceil(0.50 * n) - 1];
+    p.p90 = samples[(int) ceil(0.90 * n) - 1];
+    p.p99 = samples[(int) ceil(0.99 * n) - 1];
+    p.max = samples[n - 1];
+    return p;
+}
+
+// fit_linear: least-squares y = a + b * x
+void fit_linear(const double *x, const double *y, int n, double *a, double *b)
+{
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    int i;
+    for (i = 0; i < n; i++) {
+        sx += x[i];
+        sy += y[i];
+        sxx += x[i] * x[i];
+        sxy += x[i] * y[i];
+    }
+    double det = n * sxx - sx * sx;
+    if (n < 2 || det == 0) {
+        *a = 0;
+        *b = sx > 0 ? sy / sx : 0;
+        return;
+    }
+    *b = (n * sxy - sx * sy) / det;
+    *a = (sy - *b * sx) / n;
+}
+
+static int ceil_log2(int p)
+{
+    int steps = 0;
+    while ((1 << steps) < p)
+        steps++;
+    return steps;
+}
+
+// pingpong: one-way time (usec) of reps round trips of bytes, on rank 0
+void pingpong(char *buf, int bytes, int reps, int rank, double *samples)
+{
+    int r;
+    for (r = -WARMUP_REPS; r < reps; r++) {
+        if (rank == 0) {
+            double t0 = MPI_Wtime();
+            MPI_Send(buf, bytes, MPI_CHAR, 1, 0, MPI_COMM_WORLD);
+            MPI_Recv(buf, bytes, MPI_CHAR, 1, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            if (r >= 0)
+                samples[r] = (MPI_Wtime() - t0) * 1e6 / 2;
+        } else if (rank == 1) {
+            MPI_Recv(buf, bytes, MPI_CHAR, 0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            MPI_Send(buf, bytes, MPI_CHAR, 0, 0, MPI_COMM_WORLD);
+        }
+    }
+}
+
+// carry_chain: exclusive prefix of total, as in prefixsum_mpi.c
+long carry_chain(long total, MPI_Comm comm)
+{
+    int rank, p;
+    long base = 0, send_buf;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &p);
+    if (rank != 0)
+        MPI_Recv(&base, 1, MPI_LONG, rank - 1, 0, comm, MPI_STATUS_IGNORE);
+    if (rank != p - 1) {
+        send_buf = base + total;
+        MPI_Send(&send_buf, 1, MPI_LONG, rank + 1, 0, comm);
+    }
+    return base;
+}
+
+// carry_tree: exclusive prefix of total by recursive doubling, ceil(log2(p))
+// MPI_Sendrecv steps
+long carry_tree(long total, MPI_Comm comm)
+{
+    int rank, p, d;
+    long inclusive = total, base = 0;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &p);
+    for (d = 1; d < p; d <<= 1) {
+        long recv = 0;
+        int to = (rank + d < p) ? rank + d : MPI_PROC_NULL;
+        int from = (rank - d >= 0) ? rank - d : MPI_PROC_NULL;
+        MPI_Sendrecv(&inclusive, 1, MPI_LONG, to, 1, &recv, 1, MPI_LONG, from, 1,
+                     comm, MPI_STATUS_IGNORE);
+        inclusive += recv;
+        base += recv;
+    }
+    return base;
+}
+
+// run_pattern: one operation on one long; returns the exclusive prefix of
+// rank + 1 where the pattern computes one, so it can be checked
+long run_pattern(int pattern, MPI_Comm comm, int rank)
+{
+    long total = rank + 1, result = 0;
+    switch (pattern) {
+    case 0:
+        MPI_Exscan(&total, &result, 1, MPI_LONG, MPI_SUM, comm);
+        if (rank == 0)
+            result = 0;
+        break;
+    case 1:
+        MPI_Scan(&total, &result, 1, MPI_LONG, MPI_SUM, comm);
+        result -= total;
+        break;
+    case 2:
+        MPI_Allreduce(&total, &result, 1, MPI_LONG, MPI_SUM, comm);
+        result = (long) rank * (rank + 1) / 2;  // nothing to check
+        break;
+    case 3:
+        result = carry_chain(total, comm);
+        break;
+    default:
+        result = carry_tree(total, comm);
+        break;
+    }
+    return result;
+}
+
+// time_pattern: per repetition the slowest rank's time (usec), on rank 0
+void time_pattern(int pattern, MPI_Comm comm, int reps,
+                  double *local, double *samples)
+{
+    int rank, r;
+    MPI_Comm_rank(comm, &rank);
+    for (r = -WARMUP_REPS; r < reps; r++) {
+        MPI_Barrier(comm);
+        double t0 = MPI_Wtime();
+        long base = run_pattern(pattern, comm, rank);
+        double t = (MPI_Wtime() - t0) * 1e6;
+        if (base != (long) rank * (rank + 1) / 2) {
+            printf("Wrong carry of pattern %d on rank %d: %ld\n", pattern, rank, base);
+            MPI_Abort(MPI_COMM_WORLD, -1);
+        }
+        if (r >= 0)
+            local[r] = t;
+    }
+    MPI_Reduce(local, samples, reps, MPI_DOUBLE, MPI_MAX, 0, comm);
+}
 
 int main(int argc, char* argv[]) {
     int rank, size;
-    double start_time, end_time, latency;
-    int message = 42;  // 用于测试的消息
+    int num_reps = DEFAULT_REPS;
+    int max_bytes = DEFAULT_MAX_BYTES;
 
-    // 初始化MPI环境
     MPI_Init(&argc, &argv);
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
 
-    if (size != 2) {
+    if (argc > 1)
+        num_reps = atoi(argv[1]);
+    if (argc > 2)
+        max_bytes = atoi(argv[2]);
+
+    if (size < 2 || num_reps < 1 || max_bytes < 1) {
         if (rank == 0) {
-            printf("This program requires exactly 2 MPI processes.\n");
+            printf("Usage: mpirun -np [>= 2] %s [num_reps] [max_bytes]\n", argv[0]);
+            printf("    - num_reps: repetitions per measurement (default %d)\n", DEFAULT_REPS);
+            printf("    - max_bytes: largest ping-pong message (default %d)\n", DEFAULT_MAX_BYTES);
         }
         MPI_Finalize();
         return 1;
     }
 
+    char filename[256];
+    sprintf(filename, "latency_%dreps_%dprocs.txt", num_reps, size);
+    if (rank == 0) {
+        fp = fopen(filename, "w");
+        if (fp == NULL) {
+            printf("ERROR: can't open the file %s!\n", filename);
+            MPI_Abort(MPI_COMM_WORLD, -1);
+        }
+        report("Command line: mpirun -np %d %s %d %d\n", size, argv[0], num_reps, max_bytes);
+        report("Stats file: %s\n\n", filename);
+    }
+
+    char *buf = (char *) malloc(max_bytes);
+    double *samples = (double *) malloc(sizeof(double) * num_reps);
+    double *local = (double *) malloc(sizeof(double) * num_reps);
+    if (buf == NULL || samples == NULL || local == NULL) {
+        printf("Processor %d failed in malloc.\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, -2);
+    }
+    memset(buf, 0, max_bytes);
+
+    // 1. ping-pong between ranks 0 and 1
+    double sizes[64], medians[64];
+    int num_sizes = 0, bytes;
     if (rank == 0) {
-        // 进程0发送消息给进程1
-        start_time = MPI_Wtime();
-        MPI_Send(&message, 1, MPI_INT, 1, 0, MPI_COMM_WORLD);
-        MPI_Recv(&message, 1, MPI_INT, 1, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        end_time = MPI_Wtime();
-
-        // 计算延迟（以微秒为单位）
-        latency = (end_time - start_time) * 1000000;
-        printf("Round-trip latency: %.2f usec\n", latency);
-    } else if (rank == 1) {
-        // 进程1接收消息并立即返回
-        MPI_Recv(&message, 1, MPI_INT, 0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        MPI_Send(&message, 1, MPI_INT, 0, 0, MPI_COMM_WORLD);
-    }
-
-    // 结束MPI环境
+        report("Ping-pong one-way time (usec) between ranks 0 and 1\n");
+        report("%10s %8s %10s %10s %10s %10s %10s %12s\n", "bytes", "reps",
+               "min", "p50", "p90", "p99", "max", "MB/s (p50)");
+    }
+    for (bytes = 1; bytes <= max_bytes; bytes <<= 1) {
+        int reps = num_reps;
+        if (bytes > 65536)
+            reps = num_reps / (bytes / 65536) > MIN_LARGE_REPS ?
+                   num_reps / (bytes / 65536) : MIN_LARGE_REPS;
+        if (reps > num_reps)
+            reps = num_reps;
+        MPI_Barrier(MPI_COMM_WORLD);
+        pingpong(buf, bytes, reps, rank, samples);
+        if (rank == 0) {
+            percentiles_t p = percentiles(samples, reps);
+            report("%10d %8d %10.2f %10.2f %10.2f %10.2f %10.2f %12.1f\n", bytes, reps,
+                   p.min, p.p50, p.p90, p.p99, p.max, bytes / p.p50);
+            sizes[num_sizes] = bytes;
+            medians[num_sizes] = p.p50;
+            num_sizes++;
+        }
+    }
+
+    double alpha = 0, beta = 0;
+    if (rank == 0) {
+        fit_linear(sizes, medians, num_sizes, &alpha, &beta);
+        report("\nModel T(n) = alpha + beta * n: alpha %.3f (usec), beta %.6f (usec/byte), bandwidth %.1f (MB/s)\n\n",
+               alpha, beta, beta > 0 ? 1.0 / beta : 0.0);
+    }
+
+    // 2. collectives and carry patterns over rank counts
+    const char *pattern_names[NUM_PATTERNS] =
+        {"MPI_Exscan", "MPI_Scan", "MPI_Allreduce", "chain carry", "tree carry"};
+    double steps[NUM_PATTERNS][MAX_RANK_COUNTS];
+    double pattern_medians[NUM_PATTERNS][MAX_RANK_COUNTS];
+    int rank_counts[MAX_RANK_COUNTS];
+    int num_counts = 0, c, pattern;
+    for (c = 2; c < size; c *= 2)
+        rank_counts[num_counts++] = c;
+    rank_counts[num_counts++] = size;
+
+    if (rank == 0) {
+        report("Carry patterns, slowest rank per repetition (usec)\n");
+        report("%14s %6s %10s %10s %10s %10s %10s\n", "pattern", "ranks",
+               "min", "p50", "p90", "p99", "max");
+    }
+    for (c = 0; c < num_counts; c++) {
+        int p = rank_counts[c];
+        MPI_Comm comm;
+        MPI_Comm_split(MPI_COMM_WORLD, rank < p ? 0 : MPI_UNDEFINED, rank, &comm);
+        if (comm != MPI_COMM_NULL) {
+            for (pattern = 0; pattern < NUM_PATTERNS; pattern++) {
+                time_pattern(pattern, comm, num_reps, local, samples);
+                if (rank == 0) {
+                    percentiles_t pc = percentiles(samples, num_reps);
+                    report("%14s %6d %10.2f %10.2f %10.2f %10.2f %10.2f\n",
+                           pattern_names[pattern], p, pc.min, pc.p50, pc.p90, pc.p99, pc.max);
+                    pattern_medians[pattern][c] = pc.p50;
+                    steps[pattern][c] = (pattern == 3) ? p - 1 : ceil_log2(p);
+                }
+            }
+            MPI_Comm_free(&comm);
+        }
+        MPI_Barrier(MPI_COMM_WORLD);
+    }
+
+    // 3. cost model and predictions
+    if (rank == 0) {
+        size_t k;
+        double step = alpha + beta * sizeof(long);
+        report("\nCarry cost model T(p) = a + b * steps, steps = p - 1 (chain) or ceil(log2(p))\n");
+        report("%14s %10s %10s", "pattern", "a", "b");
+        for (k = 0; k < NUM_PREDICT; k++)
+            report("  p=%-6d", predict_procs[k]);
+        report("\n");
+        for (pattern = 0; pattern < NUM_PATTERNS; pattern++) {
+            double a, b;
+            fit_linear(steps[pattern], pattern_medians[pattern], num_counts, &a, &b);
+            report("%14s %10.3f %10.3f", pattern_names[pattern], a, b);
+            for (k = 0; k < NUM_PREDICT; k++) {
+                int n = (pattern == 3) ? predict_procs[k] - 1 : ceil_log2(predict_procs[k]);
+                report("  %8.1f", a + b * n);
+            }
+            report("\n");
+        }
+        report("%14s %10.3f %10.3f", "ping-pong", 0.0, step);
+        for (k = 0; k < NUM_PREDICT; k++)
+            report("  %8.1f", step * (predict_procs[k] - 1));
+        report("   (chain)\n");
+        report("%14s %10.3f %10.3f", "ping-pong", 0.0, step);
+        for (k = 0; k < NUM_PREDICT; k++)
+            report("  %8.1f", step * ceil_log2(predict_procs[k]));
+        report("   (tree)\n");
+        fclose(fp);
+    }
+
+    free(buf);
+    free(samples);
+    free(local);
+
     MPI_Finalize();
     return 0;
 }
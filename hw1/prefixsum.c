@@ -0,0 +1,434 @@
+/*
+ * prefixsum.c
+ *
+ * Description: libprefixsum, the scans declared in prefixsum.h. The kernel
+ * is in prefixsum_kernel.h and is instantiated here for int32 -> int64 and
+ * for double; the multi-column scans reuse the int32 -> int64 chunk scan and
+ * the run-length encoded scans its carry exchange.
+ */
+
+#include <stdlib.h>
+#include <omp.h>
+
+#include "prefixsum.h"
+#include "trace.h"
+
+#define SCAN_MODE_INCLUSIVE 0
+#define SCAN_MODE_EXCLUSIVE 1
+#define SCAN_MODE_SEGMENTED 2
+
+// carry of one thread, one cache line each so the threads do not share lines
+typedef struct {
+    int64_t i64;
+    double f64;
+    int flagged;
+} __attribute__((aligned(64))) scan_slot_t;
+
+struct scan_ctx {
+    int num_threads;
+    scan_slot_t *slots;
+    int64_t *column_carries;    // num_threads rows of column carries
+    size_t column_capacity;
+    int64_t *run_lines;         // starts and bases of the dense RLE scan
+    size_t run_capacity;
+};
+
+#define SCAN_NAME(x) x##_i32_i64
+#define SCAN_IN_T int32_t
+#define SCAN_OUT_T int64_t
+#define SCAN_SLOT i64
+#include "prefixsum_kernel.h"
+#undef SCAN_NAME
+#undef SCAN_IN_T
+#undef SCAN_OUT_T
+#undef SCAN_SLOT
+
+#define SCAN_NAME(x) x##_f64
+#define SCAN_IN_T double
+#define SCAN_OUT_T double
+#define SCAN_SLOT f64
+#include "prefixsum_kernel.h"
+#undef SCAN_NAME
+#undef SCAN_IN_T
+#undef SCAN_OUT_T
+#undef SCAN_SLOT
+
+int scan_abi_version(void)
+{
+    return PREFIXSUM_ABI_VERSION;
+}
+
+scan_ctx_t *scan_ctx_create(int num_threads)
+{
+    scan_ctx_t *ctx;
+
+    if (num_threads < 1)
+        num_threads = omp_get_max_threads();
+    ctx = (scan_ctx_t *) malloc(sizeof(scan_ctx_t));
+    if (ctx == NULL)
+        return NULL;
+    ctx->num_threads = num_threads;
+    ctx->column_carries = NULL;
+    ctx->column_capacity = 0;
+    ctx->run_lines = NULL;
+    ctx->run_capacity = 0;
+    ctx->slots = (scan_slot_t *) aligned_alloc(sizeof(scan_slot_t),
+                                               sizeof(scan_slot_t) * num_threads);
+    if (ctx->slots == NULL) {
+        free(ctx);
+        return NULL;
+    }
+
+    return ctx;
+}
+
+void scan_ctx_destroy(scan_ctx_t *ctx)
+{
+    if (ctx == NULL)
+        return;
+    free(ctx->slots);
+    free(ctx->column_carries);
+    free(ctx->run_lines);
+    free(ctx);
+}
+
+int scan_ctx_num_threads(const scan_ctx_t *ctx)
+{
+    return ctx ? ctx->num_threads : SCAN_EINVAL;
+}
+
+// check_args: the buffers may only be NULL for an empty input
+static inline int check_args(const scan_ctx_t *ctx, const void *in,
+                             const void *out, size_t n)
+{
+    if (ctx == NULL || (n > 0 && (in == NULL || out == NULL)))
+        return SCAN_EINVAL;
+    return SCAN_OK;
+}
+
+int scan_i32_i64(scan_ctx_t *ctx, const int32_t *in, int64_t *out, size_t n)
+{
+    if (check_args(ctx, in, out, n) != SCAN_OK)
+        return SCAN_EINVAL;
+    run_i32_i64(ctx, in, NULL, out, n, SCAN_MODE_INCLUSIVE);
+    return SCAN_OK;
+}
+
+int scan_i32_i64_exclusive(scan_ctx_t *ctx, const int32_t *in, int64_t *out,
+                           size_t n)
+{
+    if (check_args(ctx, in, out, n) != SCAN_OK)
+        return SCAN_EINVAL;
+    run_i32_i64(ctx, in, NULL, out, n, SCAN_MODE_EXCLUSIVE);
+    return SCAN_OK;
+}
+
+int scan_i32_i64_segmented(scan_ctx_t *ctx, const int32_t *in,
+                           const uint8_t *flags, int64_t *out, size_t n)
+{
+    if (check_args(ctx, in, out, n) != SCAN_OK || (n > 0 && flags == NULL))
+        return SCAN_EINVAL;
+    run_i32_i64(ctx, in, flags, out, n, SCAN_MODE_SEGMENTED);
+    return SCAN_OK;
+}
+
+int scan_f64(scan_ctx_t *ctx, const double *in, double *out, size_t n)
+{
+    if (check_args(ctx, in, out, n) != SCAN_OK)
+        return SCAN_EINVAL;
+    run_f64(ctx, in, NULL, out, n, SCAN_MODE_INCLUSIVE);
+    return SCAN_OK;
+}
+
+int scan_f64_exclusive(scan_ctx_t *ctx, const double *in, double *out,
+                       size_t n)
+{
+    if (check_args(ctx, in, out, n) != SCAN_OK)
+        return SCAN_EINVAL;
+    run_f64(ctx, in, NULL, out, n, SCAN_MODE_EXCLUSIVE);
+    return SCAN_OK;
+}
+
+int scan_f64_segmented(scan_ctx_t *ctx, const double *in,
+                       const uint8_t *flags, double *out, size_t n)
+{
+    if (check_args(ctx, in, out, n) != SCAN_OK || (n > 0 && flags == NULL))
+        return SCAN_EINVAL;
+    run_f64(ctx, in, flags, out, n, SCAN_MODE_SEGMENTED);
+    return SCAN_OK;
+}
+
+// reserve_columns: room for num_cols carries per thread; returns the stride
+// between the carries of two threads (whole cache lines), 0 if out of memory
+static size_t reserve_columns(scan_ctx_t *ctx, size_t num_cols)
+{
+    size_t stride = (num_cols + 7) & ~(size_t) 7;
+    size_t size = stride * ctx->num_threads;
+
+    if (size > ctx->column_capacity) {
+        int64_t *carries = (int64_t *) aligned_alloc(64, sizeof(int64_t) * size);
+        if (carries == NULL)
+            return 0;
+        free(ctx->column_carries);
+        ctx->column_carries = carries;
+        ctx->column_capacity = size;
+    }
+
+    return stride;
+}
+
+// exchange_column_carries: turn the per-thread column totals into running
+// totals, so the carry of thread t is the row t - 1
+static void exchange_column_carries(int64_t *carries, size_t stride,
+                                    size_t num_cols, int num_threads)
+{
+    for (int t = 1; t < num_threads; t++)
+        for (size_t c = 0; c < num_cols; c++)
+            carries[t * stride + c] += carries[(t - 1) * stride + c];
+}
+
+int scan_i32_i64_columns(scan_ctx_t *ctx, const int32_t *const *in,
+                         int64_t *const *out, size_t num_cols, size_t n)
+{
+    size_t stride;
+
+    if (ctx == NULL || (num_cols > 0 && (in == NULL || out == NULL)))
+        return SCAN_EINVAL;
+    for (size_t c = 0; c < num_cols; c++)
+        if (check_args(ctx, in[c], out[c], n) != SCAN_OK)
+            return SCAN_EINVAL;
+    if (num_cols == 0 || n == 0)
+        return SCAN_OK;
+    if (num_cols == 1)      // a single column is a plain scan
+        return scan_i32_i64(ctx, in[0], out[0], n);
+    stride = reserve_columns(ctx, num_cols);
+    if (stride == 0)
+        return SCAN_ENOMEM;
+
+    #pragma omp parallel num_threads(ctx->num_threads) \
+                         if (n * num_cols >= SCAN_SERIAL_CUTOFF)
+    {
+        int tid = omp_get_thread_num();
+        int num_threads = omp_get_num_threads();
+        size_t start = n * tid / num_threads;
+        size_t end = n * (tid + 1) / num_threads;
+        int64_t *carries = ctx->column_carries;
+        int flagged;
+        size_t c, i;
+
+        for (c = 0; c < num_cols; c++)
+            carries[tid * stride + c] = chunk_i32_i64(in[c], NULL, out[c], start,
+                                                      end, SCAN_MODE_INCLUSIVE,
+                                                      &flagged);
+        #pragma omp barrier
+        #pragma omp single
+        exchange_column_carries(carries, stride, num_cols, num_threads);
+
+        if (tid > 0) {
+            const int64_t *base = carries + (tid - 1) * stride;
+            for (c = 0; c < num_cols; c++)
+                for (i = start; i < end; i++)
+                    out[c][i] += base[c];
+        }
+    }
+
+    return SCAN_OK;
+}
+
+int scan_i32_i64_rows(scan_ctx_t *ctx, const int32_t *in, int64_t *out,
+                      size_t num_cols, size_t n)
+{
+    size_t stride;
+
+    if (check_args(ctx, in, out, n * num_cols) != SCAN_OK)
+        return SCAN_EINVAL;
+    if (num_cols == 0 || n == 0)
+        return SCAN_OK;
+    if (num_cols == 1)      // a single column is a plain scan
+        return scan_i32_i64(ctx, in, out, n);
+    stride = reserve_columns(ctx, num_cols);
+    if (stride == 0)
+        return SCAN_ENOMEM;
+
+    #pragma omp parallel num_threads(ctx->num_threads) \
+                         if (n * num_cols >= SCAN_SERIAL_CUTOFF)
+    {
+        int tid = omp_get_thread_num();
+        int num_threads = omp_get_num_threads();
+        size_t start = n * tid / num_threads;
+        size_t end = n * (tid + 1) / num_threads;
+        int64_t *totals = ctx->column_carries + tid * stride;
+        size_t c, i;
+
+        // every output row is the previous one plus the input row, so the
+        // inner loop runs across the columns of a row
+        if (start < end) {
+            for (c = 0; c < num_cols; c++)
+                out[start * num_cols + c] = in[start * num_cols + c];
+        }
+        for (i = start + 1; i < end; i++) {
+            const int32_t *row = in + i * num_cols;
+            const int64_t *prev_row = out + (i - 1) * num_cols;
+            int64_t *out_row = out + i * num_cols;
+            for (c = 0; c < num_cols; c++)
+                out_row[c] = prev_row[c] + row[c];
+        }
+        for (c = 0; c < num_cols; c++)
+            totals[c] = (start < end) ? out[(end - 1) * num_cols + c] : 0;
+        #pragma omp barrier
+        #pragma omp single
+        exchange_column_carries(ctx->column_carries, stride, num_cols,
+                                num_threads);
+
+        if (tid > 0) {
+            const int64_t *base = ctx->column_carries + (tid - 1) * stride;
+            for (i = start; i < end; i++) {
+                int64_t *out_row = out + i * num_cols;
+                for (c = 0; c < num_cols; c++)
+                    out_row[c] += base[c];
+            }
+        }
+    }
+
+    return SCAN_OK;
+}
+
+// rle_lines: starts and bases of every run. Each thread takes a contiguous
+// range of runs and scans their lengths and sums from zero; the two totals
+// per thread go through the column carry exchange and are added back.
+static void rle_lines(scan_ctx_t *ctx, const int32_t *values,
+                      const uint32_t *lengths, size_t num_runs,
+                      int64_t *starts, int64_t *bases, size_t stride)
+{
+    #pragma omp parallel num_threads(ctx->num_threads) \
+                         if (num_runs >= SCAN_SERIAL_CUTOFF)
+    {
+        int tid = omp_get_thread_num();
+        int num_threads = omp_get_num_threads();
+        size_t start = num_runs * tid / num_threads;
+        size_t end = num_runs * (tid + 1) / num_threads;
+        int64_t *carries = ctx->column_carries;
+        int64_t pos = 0, sum = 0;
+        size_t r;
+
+        for (r = start; r < end; r++) {
+            starts[r] = pos;
+            bases[r] = sum;
+            pos += lengths[r];
+            sum += (int64_t) values[r] * lengths[r];
+        }
+        carries[tid * stride] = pos;
+        carries[tid * stride + 1] = sum;
+        #pragma omp barrier
+        #pragma omp single
+        exchange_column_carries(carries, stride, 2, num_threads);
+
+        if (tid > 0) {
+            const int64_t *base = carries + (tid - 1) * stride;
+            for (r = start; r < end; r++) {
+                starts[r] += base[0];
+                bases[r] += base[1];
+            }
+        }
+    }
+}
+
+// check_rle_args: like check_args, for the values and lengths of the runs
+static inline int check_rle_args(const scan_ctx_t *ctx, const int32_t *values,
+                                 const uint32_t *lengths, size_t num_runs)
+{
+    if (ctx == NULL || (num_runs > 0 && (values == NULL || lengths == NULL)))
+        return SCAN_EINVAL;
+    return SCAN_OK;
+}
+
+int scan_i32_i64_rle_linear(scan_ctx_t *ctx, const int32_t *values,
+                            const uint32_t *lengths, size_t num_runs,
+                            int64_t *starts, int64_t *bases)
+{
+    size_t stride;
+
+    if (check_rle_args(ctx, values, lengths, num_runs) != SCAN_OK ||
+        (num_runs > 0 && (starts == NULL || bases == NULL)))
+        return SCAN_EINVAL;
+    if (num_runs == 0)
+        return SCAN_OK;
+    stride = reserve_columns(ctx, 2);
+    if (stride == 0)
+        return SCAN_ENOMEM;
+    rle_lines(ctx, values, lengths, num_runs, starts, bases, stride);
+
+    return SCAN_OK;
+}
+
+// rle_first_run: the last run starting at or before position i, which is the
+// run holding i (runs of length 0 share their start with the next run)
+static size_t rle_first_run(const int64_t *starts, size_t num_runs, int64_t i)
+{
+    size_t lo = 0, hi = num_runs;
+
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (starts[mid] <= i)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+int scan_i32_i64_rle(scan_ctx_t *ctx, const int32_t *values,
+                     const uint32_t *lengths, size_t num_runs, int64_t *out)
+{
+    size_t stride;
+    int64_t *starts, *bases;
+    int64_t n;
+
+    if (check_rle_args(ctx, values, lengths, num_runs) != SCAN_OK ||
+        (num_runs > 0 && out == NULL))
+        return SCAN_EINVAL;
+    if (num_runs == 0)
+        return SCAN_OK;
+    stride = reserve_columns(ctx, 2);
+    if (stride == 0)
+        return SCAN_ENOMEM;
+    if (2 * num_runs > ctx->run_capacity) {
+        int64_t *lines = (int64_t *) malloc(sizeof(int64_t) * 2 * num_runs);
+        if (lines == NULL)
+            return SCAN_ENOMEM;
+        free(ctx->run_lines);
+        ctx->run_lines = lines;
+        ctx->run_capacity = 2 * num_runs;
+    }
+    starts = ctx->run_lines;
+    bases = ctx->run_lines + num_runs;
+    rle_lines(ctx, values, lengths, num_runs, starts, bases, stride);
+    n = starts[num_runs - 1] + lengths[num_runs - 1];
+
+    // every thread expands an even share of the outputs, starting inside
+    // the run found by a binary search over the starts
+    #pragma omp parallel num_threads(ctx->num_threads) \
+                         if (n >= SCAN_SERIAL_CUTOFF)
+    {
+        int tid = omp_get_thread_num();
+        int num_threads = omp_get_num_threads();
+        int64_t begin = n * tid / num_threads;
+        int64_t end = n * (tid + 1) / num_threads;
+        size_t r = rle_first_run(starts, num_runs, begin);
+        int64_t i = begin;
+
+        while (i < end) {
+            int64_t run_end = starts[r] + lengths[r];
+            int64_t stop = (run_end < end) ? run_end : end;
+            int64_t base = bases[r] - (starts[r] - 1) * (int64_t) values[r];
+            int64_t value = values[r];
+            // out[i] = bases[r] + (i - starts[r] + 1) * values[r]
+            for (; i < stop; i++)
+                out[i] = base + i * value;
+            r++;
+        }
+    }
+
+    return SCAN_OK;
+}
@@ -0,0 +1,151 @@
+/*
+ * prefixsum.h
+ *
+ * Description: C interface of libprefixsum, the OpenMP chunked scan of
+ * prefixsum_omp.c packaged for use from other programs.
+ *
+ * A scan_ctx_t holds the thread count of the team and the per-thread carry
+ * scratch, so repeated calls do no allocation, no I/O and no printing. Every
+ * scan reads n inputs and writes n outputs. The output may alias the input
+ * when both have the same type. Inputs shorter than SCAN_SERIAL_CUTOFF are
+ * scanned by the calling thread.
+ *
+ * Variants:
+ * - inclusive: out[i] = in[0] + ... + in[i];
+ * - exclusive: out[i] = in[0] + ... + in[i-1], out[0] = 0;
+ * - segmented: inclusive scan that restarts wherever flags[i] != 0.
+ *
+ * Multi-column scans (ABI version 2) run num_cols independent inclusive scans
+ * of n rows in one parallel pass that shares the row partition and the carry
+ * exchange. scan_i32_i64_columns takes structure-of-arrays tables,
+ * in[c][i]. scan_i32_i64_rows takes row-major interleaved tables,
+ * in[i * num_cols + c], and vectorizes across the columns of a row. A single
+ * column is a plain scan_i32_i64 in both layouts. The context keeps num_cols
+ * carries per thread and grows them on the first call with a wider table.
+ *
+ * The scan queue (ABI version 3, prefixsum_queue.c) takes int32 -> int64
+ * requests from any number of threads and runs them on one dispatcher
+ * thread that owns the context. scan_queue_submit_i32_i64 returns a future
+ * at once. Requests of at least small_elems run alone with the whole team.
+ * Shorter ones are coalesced: they wait until batch_elems elements are
+ * queued or the oldest has waited max_delay_usec, and then all run in one
+ * parallel launch, one request per thread at a time.
+ *
+ * Run-length encoded scans (ABI version 4) take num_runs runs, run r being
+ * lengths[r] copies of values[r]. scan_i32_i64_rle writes the dense
+ * inclusive scan of the expanded input, sum(lengths) outputs.
+ * scan_i32_i64_rle_linear writes one line per run instead: starts[r] is the
+ * position of the first element of run r and bases[r] is the prefix sum
+ * before it, so the prefix sum at starts[r] + j is
+ * bases[r] + (j + 1) * values[r]. The runs are split over the threads with
+ * the same carry exchange, so the linear form costs O(num_runs). The dense
+ * form then splits the outputs evenly over the threads, whatever the run
+ * lengths. The dense form keeps the lines of the runs in the context.
+ *
+ * The f64 scans add in a different order for different thread counts, so
+ * their results can differ in the last bits between contexts.
+ *
+ * The scans return SCAN_OK or a negative SCAN_E* code. The ABI only
+ * grows: new functions are added, existing signatures and codes never
+ * change, and PREFIXSUM_ABI_VERSION counts the additions.
+ */
+
+#ifndef PREFIXSUM_H
+#define PREFIXSUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PREFIXSUM_ABI_VERSION 4
+#define PREFIXSUM_API __attribute__((visibility("default")))
+
+#define SCAN_OK 0
+#define SCAN_EINVAL -1          // NULL context or buffer
+#define SCAN_ENOMEM -2
+
+#define SCAN_SERIAL_CUTOFF 16384
+
+typedef struct scan_ctx scan_ctx_t;
+
+// scan_abi_version: PREFIXSUM_ABI_VERSION of the library that was loaded
+PREFIXSUM_API int scan_abi_version(void);
+
+// scan_ctx_create: context for num_threads threads (0: the OpenMP default);
+// NULL when out of memory
+PREFIXSUM_API scan_ctx_t *scan_ctx_create(int num_threads);
+PREFIXSUM_API void scan_ctx_destroy(scan_ctx_t *ctx);
+PREFIXSUM_API int scan_ctx_num_threads(const scan_ctx_t *ctx);
+
+// 32-bit inputs, 64-bit sums
+PREFIXSUM_API int scan_i32_i64(scan_ctx_t *ctx, const int32_t *in,
+                               int64_t *out, size_t n);
+PREFIXSUM_API int scan_i32_i64_exclusive(scan_ctx_t *ctx, const int32_t *in,
+                                         int64_t *out, size_t n);
+PREFIXSUM_API int scan_i32_i64_segmented(scan_ctx_t *ctx, const int32_t *in,
+                                         const uint8_t *flags, int64_t *out,
+                                         size_t n);
+
+// doubles
+PREFIXSUM_API int scan_f64(scan_ctx_t *ctx, const double *in, double *out,
+                           size_t n);
+PREFIXSUM_API int scan_f64_exclusive(scan_ctx_t *ctx, const double *in,
+                                     double *out, size_t n);
+PREFIXSUM_API int scan_f64_segmented(scan_ctx_t *ctx, const double *in,
+                                     const uint8_t *flags, double *out,
+                                     size_t n);
+
+// multi-column scans, 32-bit inputs, 64-bit sums
+PREFIXSUM_API int scan_i32_i64_columns(scan_ctx_t *ctx,
+                                       const int32_t *const *in,
+                                       int64_t *const *out, size_t num_cols,
+                                       size_t n);
+PREFIXSUM_API int scan_i32_i64_rows(scan_ctx_t *ctx, const int32_t *in,
+                                    int64_t *out, size_t num_cols, size_t n);
+
+// run-length encoded scans, 32-bit values, 64-bit sums
+PREFIXSUM_API int scan_i32_i64_rle(scan_ctx_t *ctx, const int32_t *values,
+                                   const uint32_t *lengths, size_t num_runs,
+                                   int64_t *out);
+PREFIXSUM_API int scan_i32_i64_rle_linear(scan_ctx_t *ctx,
+                                          const int32_t *values,
+                                          const uint32_t *lengths,
+                                          size_t num_runs, int64_t *starts,
+                                          int64_t *bases);
+
+// asynchronous scans
+typedef struct scan_queue scan_queue_t;
+typedef struct scan_future scan_future_t;
+
+// scan_queue_create: queue whose dispatcher uses ctx, which the caller must
+// not use until scan_queue_destroy; NULL when out of resources
+PREFIXSUM_API scan_queue_t *scan_queue_create(scan_ctx_t *ctx,
+                                              size_t small_elems,
+                                              size_t batch_elems,
+                                              long max_delay_usec);
+// scan_queue_destroy: run the pending requests, then stop the dispatcher;
+// futures not waited for yet stay valid
+PREFIXSUM_API void scan_queue_destroy(scan_queue_t *queue);
+// scan_queue_submit_i32_i64: queue an inclusive scan; NULL on bad arguments
+// or when out of memory
+PREFIXSUM_API scan_future_t *scan_queue_submit_i32_i64(scan_queue_t *queue,
+                                                       const int32_t *in,
+                                                       int64_t *out, size_t n);
+// scan_queue_stats: number of requests and of parallel launches so far
+PREFIXSUM_API void scan_queue_stats(scan_queue_t *queue, long *num_requests,
+                                    long *num_launches);
+
+// scan_future_ready: 1 once the scan is done, 0 before
+PREFIXSUM_API int scan_future_ready(const scan_future_t *future);
+// scan_future_wait: block until the scan is done, release the future and
+// return the status of the scan
+PREFIXSUM_API int scan_future_wait(scan_future_t *future);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // #ifndef PREFIXSUM_H
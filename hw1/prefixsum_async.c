@@ -0,0 +1,323 @@
+/*
+ * prefixsum_async.c
+ *
+ * Description: Load generator for the scan queue of libprefixsum: client
+ * threads issue scan requests of mixed sizes, either straight to
+ * scan_i32_i64 or through scan_queue_submit_i32_i64.
+ *
+ * Procedure:
+ * 1. Every client thread generates LARGE_ELEMS random integers and their
+ *    serial prefix sums as the reference;
+ * 2. Every client issues num_requests requests one after the other (closed
+ *    loop): LARGE_PERCENT% of them scan LARGE_ELEMS elements, the others a
+ *    uniform size in [SMALL_MIN, SMALL_MAX);
+ * 3. direct: every client owns a context of num_threads threads and calls
+ *    scan_i32_i64, so every request of SCAN_SERIAL_CUTOFF elements or more
+ *    starts its own OpenMP team next to the teams of the other clients;
+ * 4. queue: all clients submit to one queue of num_threads threads, which
+ *    runs the large requests alone and coalesces the small ones into one
+ *    parallel launch, holding them back at most max_delay_usec;
+ * 5. Throughput and the latency percentiles of small and large requests are
+ *    reported for both modes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <omp.h>
+
+#include "prefixsum.h"
+
+#define MAX_INT 2147483647
+#define LARGE_ELEMS (1 << 20)
+#define LARGE_PERCENT 5
+#define SMALL_MIN 256
+#define SMALL_MAX 65536
+#define QUEUE_SMALL_ELEMS SMALL_MAX       // coalesce every small request
+#define QUEUE_BATCH_ELEMS (1 << 18)
+#define NUM_MODES 2
+#define VERIFY
+
+// usec: calculate the time interval in microseconds
+inline suseconds_t usec(struct timeval start, struct timeval end)
+{
+  return ((double) (((end.tv_sec * 1000000 + end.tv_usec) -
+                     (start.tv_sec * 1000000 + start.tv_usec))));
+}
+
+typedef struct {
+    int id;
+    int mode;
+    int num_requests;
+    int num_threads;
+    scan_queue_t *queue;
+
+    int *data;
+    long *reference;            // serial prefix sums of data
+    long *prefix_sums;
+
+    suseconds_t *latencies;     // one per request
+    int *sizes;
+    long elems;
+    int errors;
+} client_t;
+
+void *client_thread(void *arg)
+{
+    client_t *client = (client_t *) arg;
+    scan_ctx_t *ctx = NULL;
+    unsigned int seed = 1234 + client->id;
+    struct timeval start_time, end_time;
+
+    if (client->mode == 0)
+        ctx = scan_ctx_create(client->num_threads);
+
+    for (int k = 0; k < client->num_requests; k++) {
+        int n = (rand_r(&seed) % 100 < LARGE_PERCENT) ? LARGE_ELEMS :
+                SMALL_MIN + rand_r(&seed) % (SMALL_MAX - SMALL_MIN);
+        int status;
+
+#ifdef VERIFY
+        // the output buffer is reused and every request scans a prefix of the
+        // same data, so poison it to catch a request that writes nothing
+        client->prefix_sums[0] = client->prefix_sums[n / 2] =
+            client->prefix_sums[n - 1] = -1;
+#endif // #ifdef VERIFY
+        gettimeofday(&start_time, NULL);
+        if (client->mode == 0) {
+            status = scan_i32_i64(ctx, client->data, client->prefix_sums, n);
+        } else {
+            scan_future_t *future = scan_queue_submit_i32_i64(client->queue,
+                                        client->data, client->prefix_sums, n);
+            status = scan_future_wait(future);
+        }
+        gettimeofday(&end_time, NULL);
+
+        client->latencies[k] = usec(start_time, end_time);
+        client->sizes[k] = n;
+        client->elems += n;
+#ifdef VERIFY
+        if (status != SCAN_OK ||
+            memcmp(client->prefix_sums, client->reference, sizeof(long) * n) != 0)
+            client->errors++;
+#else
+        (void) status;
+#endif // #ifdef VERIFY
+    }
+
+    scan_ctx_destroy(ctx);
+    return NULL;
+}
+
+static int compare_usec(const void *a, const void *b)
+{
+    suseconds_t x = *(const suseconds_t *) a;
+    suseconds_t y = *(const suseconds_t *) b;
+    return (x > y) - (x < y);
+}
+
+// report_latencies: percentiles of the latencies of one request class
+void report_latencies(FILE *fp, const char *mode, const char *name,
+                      suseconds_t *latencies, long count)
+{
+    if (count == 0)
+        return;
+    qsort(latencies, count, sizeof(suseconds_t), compare_usec);
+    printf("%-6s %-5s requests: %ld, latency p50 %d, p99 %d, p99.9 %d, max %d (usec)\n",
+            mode, name, count, latencies[count / 2], latencies[count * 99 / 100],
+            latencies[count * 999 / 1000], latencies[count - 1]);
+    fprintf(fp, "%-6s %-5s requests: %ld, latency p50 %d, p99 %d, p99.9 %d, max %d (usec)\n",
+            mode, name, count, latencies[count / 2], latencies[count * 99 / 100],
+            latencies[count * 999 / 1000], latencies[count - 1]);
+}
+
+int main(int argc, char *argv[])
+{
+    int num_clients = 0;
+    int num_requests = 0;
+    int num_threads = 0;
+    long max_delay_usec = 200;
+
+    struct timeval start_time, end_time;  // for gettimeofday to calculate timing
+
+    char filename[256] = "prefixsum_async_";
+    FILE *fp = NULL;
+
+    if (argc < 4) {
+        printf("Usage: %s [num_clients] [num_requests] [num_threads] [max_delay_usec]\n", argv[0]);
+        printf("    - num_clients: number of client threads\n");
+        printf("    - num_requests: number of requests per client\n");
+        printf("    - num_threads: number of scan threads (per context)\n");
+        printf("    - max_delay_usec: longest wait of a small request for coalescing (optional, default 200)\n");
+        exit(-1);
+    }
+
+    num_clients = atoi(argv[1]);
+    num_requests = atoi(argv[2]);
+    num_threads = atoi(argv[3]);
+    if (argc > 4)
+        max_delay_usec = atol(argv[4]);
+
+    if (num_threads < 1) {
+        printf("Number of threads should be more than one!\n");
+        exit(-1);
+    }
+    if (num_clients < 1 || num_requests < 1 || max_delay_usec < 0) {
+        printf("Number of clients and requests should be positive!\n");
+        exit(-1);
+    }
+
+    strcat(filename, argv[1]);
+    strcat(filename, "clients_");
+    strcat(filename, argv[2]);
+    strcat(filename, "reqs_");
+    strcat(filename, argv[3]);
+    strcat(filename, "threads.txt");
+
+    fp = fopen(filename, "w");
+    if (fp) {
+        printf("Command line: %s %d %d %d %ld\n",
+                argv[0], num_clients, num_requests, num_threads, max_delay_usec);
+        printf("Stats file: %s\n\n", filename);
+        fprintf(fp, "Command line: %s %d %d %d %ld\n",
+                argv[0], num_clients, num_requests, num_threads, max_delay_usec);
+        fprintf(fp, "Stats file: %s\n\n", filename);
+    } else {
+        printf("ERROR: can't open the file %s!\n", filename);
+        exit(-1);
+    }
+
+    // Memory allocation and inputs of every client
+    client_t *clients = (client_t *) calloc(num_clients, sizeof(client_t));
+    pthread_t *threads = (pthread_t *) malloc(sizeof(pthread_t) * num_clients);
+    long total_requests = (long) num_clients * num_requests;
+    suseconds_t *small_usecs = (suseconds_t *) malloc(sizeof(suseconds_t) * total_requests);
+    suseconds_t *large_usecs = (suseconds_t *) malloc(sizeof(suseconds_t) * total_requests);
+    if (clients == NULL || threads == NULL || small_usecs == NULL || large_usecs == NULL) {
+        printf("Failed in malloc()\n");
+        exit(-2);
+    }
+    int c;
+    for (c = 0; c < num_clients; c++) {
+        client_t *client = &clients[c];
+        client->id = c;
+        client->num_requests = num_requests;
+        client->num_threads = num_threads;
+        client->data = (int *) malloc(sizeof(int) * LARGE_ELEMS);
+        client->reference = (long *) malloc(sizeof(long) * LARGE_ELEMS);
+        client->prefix_sums = (long *) malloc(sizeof(long) * LARGE_ELEMS);
+        client->latencies = (suseconds_t *) malloc(sizeof(suseconds_t) * num_requests);
+        client->sizes = (int *) malloc(sizeof(int) * num_requests);
+        if (client->data == NULL || client->reference == NULL ||
+            client->prefix_sums == NULL || client->latencies == NULL ||
+            client->sizes == NULL) {
+            printf("Failed in malloc() of client %d\n", c);
+            exit(-2);
+        }
+        unsigned int seed = c + time(NULL);
+        long sum = 0;
+        for (int i = 0; i < LARGE_ELEMS; i++) {
+            client->data[i] = rand_r(&seed) % (MAX_INT / LARGE_ELEMS);
+            sum += client->data[i];
+            client->reference[i] = sum;
+            client->prefix_sums[i] = 0;
+        }
+    }
+
+    printf("Start ...\n");
+    fprintf(fp, "Start ...\n");
+
+    const char *mode_names[NUM_MODES] = {"direct", "queue"};
+    int errors = 0;
+    for (int mode = 0; mode < NUM_MODES; mode++) {
+        scan_ctx_t *ctx = NULL;
+        scan_queue_t *queue = NULL;
+        if (mode == 1) {
+            ctx = scan_ctx_create(num_threads);
+            queue = scan_queue_create(ctx, QUEUE_SMALL_ELEMS, QUEUE_BATCH_ELEMS,
+                                      max_delay_usec);
+            if (queue == NULL) {
+                printf("Failed in scan_queue_create()\n");
+                exit(-2);
+            }
+        }
+
+        gettimeofday(&start_time, NULL);
+        for (c = 0; c < num_clients; c++) {
+            clients[c].mode = mode;
+            clients[c].queue = queue;
+            clients[c].elems = 0;
+            clients[c].errors = 0;
+            pthread_create(&threads[c], NULL, client_thread, &clients[c]);
+        }
+        for (c = 0; c < num_clients; c++)
+            pthread_join(threads[c], NULL);
+        gettimeofday(&end_time, NULL);
+
+        suseconds_t total_usec = usec(start_time, end_time);
+        long num_small = 0, num_large = 0, elems = 0;
+        for (c = 0; c < num_clients; c++) {
+            for (int k = 0; k < num_requests; k++) {
+                if (clients[c].sizes[k] == LARGE_ELEMS)
+                    large_usecs[num_large++] = clients[c].latencies[k];
+                else
+                    small_usecs[num_small++] = clients[c].latencies[k];
+            }
+            elems += clients[c].elems;
+            errors += clients[c].errors;
+        }
+
+        printf("%-6s: %d (usec), %.0f requests/s, %.1f Melems/s\n",
+                mode_names[mode], total_usec,
+                total_usec > 0 ? 1e6 * total_requests / total_usec : 0.0,
+                total_usec > 0 ? (double) elems / total_usec : 0.0);
+        fprintf(fp, "%-6s: %d (usec), %.0f requests/s, %.1f Melems/s\n",
+                mode_names[mode], total_usec,
+                total_usec > 0 ? 1e6 * total_requests / total_usec : 0.0,
+                total_usec > 0 ? (double) elems / total_usec : 0.0);
+        report_latencies(fp, mode_names[mode], "small", small_usecs, num_small);
+        report_latencies(fp, mode_names[mode], "large", large_usecs, num_large);
+
+        if (queue != NULL) {
+            long queued, launches;
+            scan_queue_stats(queue, &queued, &launches);
+            printf("%-6s launches: %ld for %ld requests, %.1f requests per launch\n",
+                    mode_names[mode], launches, queued,
+                    launches > 0 ? (double) queued / launches : 0.0);
+            fprintf(fp, "%-6s launches: %ld for %ld requests, %.1f requests per launch\n",
+                    mode_names[mode], launches, queued,
+                    launches > 0 ? (double) queued / launches : 0.0);
+            scan_queue_destroy(queue);
+            scan_ctx_destroy(ctx);
+        }
+    }
+
+#ifdef VERIFY
+    if (errors > 0)
+        printf("Wrong asynchronous prefix sum implementation: %d wrong requests\n", errors);
+#endif // #ifdef VERIFY
+
+    printf("Finish Asynchronous Prefix Sum load test\n");
+    fprintf(fp, "Finish Asynchronous Prefix Sum load test\n");
+
+    // free the allocated memory
+    for (c = 0; c < num_clients; c++) {
+        free(clients[c].data);
+        free(clients[c].reference);
+        free(clients[c].prefix_sums);
+        free(clients[c].latencies);
+        free(clients[c].sizes);
+    }
+    free(clients);
+    free(threads);
+    free(small_usecs);
+    free(large_usecs);
+
+    fclose(fp);
+
+    return errors ? -1 : 0;
+}
@@ -0,0 +1,429 @@
+/*
+ * prefixsum_balance.c
+ *
+ * Description: Parallel implementation of Prefix Sum program to sum a
+ * sequence of randomly generated integers using MPI, with the element ranges
+ * of the processors sized by their measured scan throughput instead of
+ * evenly, so that slower nodes get fewer elements.
+ *
+ * Procedure:
+ * 1. Each processor generates its even partition (num_elems_mean plus the
+ *    remainder, as in prefixsum_mpi.c);
+ * 2. Calibration: each processor first-touches its buffers and runs one
+ *    untimed warm-up scan, then times at least CALIBRATION_PASSES local scans
+ *    of its partition (and at least CALIBRATION_USEC in total). The fastest
+ *    pass gives its throughput (elements/usec), so page faults and a single
+ *    cold pass do not count as scan time. The throughputs are gathered with
+ *    MPI_Allgather and every processor computes the same weighted ranges:
+ *    processor r starts at num_elems times the throughput share of the
+ *    processors before it, so the global order stays contiguous. Every
+ *    processor keeps at least one element;
+ * 3. The input is moved to the weighted ranges with one MPI_Alltoallv, each
+ *    processor sending the overlap of its old range with every new range;
+ * 4. The scan (local prefix sums, MPI_Exscan of the local totals, add base)
+ *    is timed num_iters times on the even and on the weighted partition,
+ *    each after an untimed warm-up scan on first-touched buffers. The
+ *    imbalance ratio, max / mean of the per-processor compute time, is
+ *    reported for both.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <mpi.h>
+
+#define MAX_INT 2147483647
+#define VERIFY
+
+#define CALIBRATION_USEC 2000   // minimum time spent measuring the throughput
+#define CALIBRATION_PASSES 5    // minimum number of timed calibration scans
+
+// usec: calculate the time interval in microseconds
+inline suseconds_t usec(struct timeval start, struct timeval end)
+{
+  return ((double) (((end.tv_sec * 1000000 + end.tv_usec) -
+                     (start.tv_sec * 1000000 + start.tv_usec))));
+}
+
+double calculate_standard_deviation(suseconds_t *data, int n) {
+    double mean = 0.0;
+    double variance = 0.0;
+    double std_dev = 0.0;
+
+    for (int i = 0; i < n; i++) {
+        mean += (double)data[i];
+    }
+    mean /= n;
+
+    for (int i = 0; i < n; i++) {
+        variance += (data[i] - mean) * (data[i] - mean);
+    }
+    variance /= n;
+
+    std_dev = sqrt(variance);
+
+    return std_dev;
+}
+
+// even_partition: starting IDs of the num_elems_mean plus remainder split,
+// starts[num_procs] = num_elems
+void even_partition(int *starts, int num_elems, int num_procs)
+{
+    int num_elems_mean = num_elems / num_procs;
+    int num_elems_remain = num_elems % num_procs;
+    int r;
+    for (r = 0; r <= num_procs; r++) {
+        if (r < num_elems_remain)
+            starts[r] = r * (num_elems_mean + 1);
+        else
+            starts[r] = r * num_elems_mean + num_elems_remain;
+    }
+}
+
+// weighted_partition: starting IDs proportional to the throughputs, at least
+// one element per processor, starts[num_procs] = num_elems
+void weighted_partition(int *starts, const double *throughputs,
+                        int num_elems, int num_procs)
+{
+    double total = 0, before = 0;
+    int r;
+    for (r = 0; r < num_procs; r++)
+        total += throughputs[r];
+
+    starts[0] = 0;
+    for (r = 1; r < num_procs; r++) {
+        before += throughputs[r-1];
+        int s = (int) llround((double) num_elems * before / total);
+        if (s < starts[r-1] + 1)
+            s = starts[r-1] + 1;                    // keep one element behind
+        if (s > num_elems - (num_procs - r))
+            s = num_elems - (num_procs - r);        // and one for each after
+        starts[r] = s;
+    }
+    starts[num_procs] = num_elems;
+}
+
+// redistribute: move the elements of the old ranges to the new ranges
+int *redistribute(int *local_data, const int *old_starts, const int *new_starts,
+                  int rank, int num_procs)
+{
+    int *send_counts = (int *) malloc(sizeof(int) * num_procs * 4);
+    int *send_displs = send_counts + num_procs;
+    int *recv_counts = send_counts + 2 * num_procs;
+    int *recv_displs = send_counts + 3 * num_procs;
+    int *new_data = (int *) malloc(sizeof(int) *
+                                   (new_starts[rank + 1] - new_starts[rank]));
+    if (send_counts == NULL || new_data == NULL) {
+        printf("Processor %d failed in malloc.\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, -2);
+    }
+
+    int r;
+    for (r = 0; r < num_procs; r++) {
+        // my old range against the new range of r
+        int lo = old_starts[rank] > new_starts[r] ? old_starts[rank] : new_starts[r];
+        int hi = old_starts[rank + 1] < new_starts[r + 1] ? old_starts[rank + 1] : new_starts[r + 1];
+        send_counts[r] = hi > lo ? hi - lo : 0;
+        send_displs[r] = hi > lo ? lo - old_starts[rank] : 0;
+        // the old range of r against my new range
+        lo = old_starts[r] > new_starts[rank] ? old_starts[r] : new_starts[rank];
+        hi = old_starts[r + 1] < new_starts[rank + 1] ? old_starts[r + 1] : new_starts[rank + 1];
+        recv_counts[r] = hi > lo ? hi - lo : 0;
+        recv_displs[r] = hi > lo ? lo - new_starts[rank] : 0;
+    }
+
+    MPI_Alltoallv(local_data, send_counts, send_displs, MPI_INT,
+                  new_data, recv_counts, recv_displs, MPI_INT, MPI_COMM_WORLD);
+
+    free(send_counts);
+    free(local_data);
+    return new_data;
+}
+
+// scan: local prefix sums, carry by MPI_Exscan, add base. Returns the time
+// spent computing (local scan and add base) in usec
+double scan(int *local_data, long *local_prefix_sums, int my_num_elems, int rank)
+{
+    int i;
+    double t0 = MPI_Wtime();
+    local_prefix_sums[0] = local_data[0];
+    for (i = 1; i < my_num_elems; i++)
+        local_prefix_sums[i] = local_prefix_sums[i-1] + local_data[i];
+    double t1 = MPI_Wtime();
+
+    long base = 0;
+    MPI_Exscan(&local_prefix_sums[my_num_elems - 1], &base, 1, MPI_LONG,
+               MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0)
+        base = 0;   // MPI_Exscan leaves it undefined
+
+    double t2 = MPI_Wtime();
+    for (i = 0; i < my_num_elems; i++)
+        local_prefix_sums[i] += base;
+    double t3 = MPI_Wtime();
+
+    return ((t1 - t0) + (t3 - t2)) * 1e6;
+}
+
+#ifdef VERIFY
+// verify_local_prefix_sums: see prefixsum_mpi.c
+int verify_local_prefix_sums(long *local_prefix_sums, int *local_data,
+                             int my_num_elems, long prev_last)
+{
+    int i;
+    for (i = 0; i < my_num_elems; i++) {
+        long prev = (i == 0) ? prev_last : local_prefix_sums[i-1];
+        if (local_prefix_sums[i] - prev != local_data[i])
+            break;
+    }
+    return i;
+}
+#endif // #ifdef VERIFY
+
+int main(int argc, char *argv[])
+{
+    // command line arguments
+    int num_elems = 0;
+    int num_iters = 0;
+    int num_procs = 0;
+
+    int rank;
+
+    // per-processor local memory pointers
+    int *local_data = NULL;
+    long *local_prefix_sums = NULL;
+
+    struct timeval start_time, end_time;  // for gettimeofday to calculate timing
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);  // getting the ID for this process
+
+    if (argc < 3) {
+        if (rank == 0) {
+            printf("Usage: %s [num_elems] [num_iters]\n", argv[0]);
+            printf("    - num_elems:  number of elements\n");
+            printf("    - num_iters: number of iterations\n");
+        }
+
+        MPI_Finalize();
+        exit(-1);
+    }
+
+    num_elems = atoi(argv[1]);
+    num_iters = atoi(argv[2]);
+
+    MPI_Comm_size(MPI_COMM_WORLD, &num_procs); // get the number of processes
+
+    if (num_elems < num_procs || num_iters < 1) {
+        if (rank == 0)
+            printf("Every processor needs at least one element and one iteration!\n");
+        MPI_Finalize();
+        exit(-1);
+    }
+
+    char filename[256] = "prefixsum_balance_";
+    char nprocs[16];
+    sprintf(nprocs, "%d", num_procs);
+    FILE *fp = NULL;
+
+    strcat(filename, argv[1]);
+    strcat(filename, "elems_");
+    strcat(filename, argv[2]);
+    strcat(filename, "iters_");
+    strcat(filename, nprocs);
+    strcat(filename, "procs.txt");
+
+    if (rank == 0) {
+        fp = fopen(filename, "w");
+        if (fp) {
+            printf("Command line: mpirun -np %d %s %d %d\n",
+                    num_procs, argv[0], num_elems, num_iters);
+            printf("Stats file: %s\n\n", filename);
+            fprintf(fp, "Command line: mpirun -np %d %s %d %d\n",
+                    num_procs, argv[0], num_elems, num_iters);
+            fprintf(fp, "Stats file: %s\n\n", filename);
+        } else {
+            printf("ERROR: can't open the file %s!\n", filename);
+            MPI_Abort(MPI_COMM_WORLD, -1);
+        }
+    }
+
+    // even data partition
+    int *even_starts = (int *) malloc(sizeof(int) * (num_procs + 1));
+    int *weighted_starts = (int *) malloc(sizeof(int) * (num_procs + 1));
+    double *throughputs = (double *) malloc(sizeof(double) * num_procs);
+    suseconds_t *usecs = (suseconds_t *) malloc(sizeof(suseconds_t) * num_iters);
+    if (even_starts == NULL || weighted_starts == NULL ||
+        throughputs == NULL || usecs == NULL) {
+        printf("Processor %d failed in malloc.\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, -2);
+    }
+    even_partition(even_starts, num_elems, num_procs);
+    int my_num_elems = even_starts[rank + 1] - even_starts[rank];
+
+    // Memory allocation private to each process
+    local_data = (int *) malloc(sizeof(int) * my_num_elems);
+    local_prefix_sums = (long *) malloc(sizeof(long) * my_num_elems);
+    if (local_data == NULL || local_prefix_sums == NULL) {
+        printf("Processor %d failed in malloc.\n", rank);
+        printf(" - local_data: %p\n", local_data);
+        printf(" - local_prefix_sums: %p\n", local_prefix_sums);
+        MPI_Abort(MPI_COMM_WORLD, -2);
+    }
+
+    // generate input data, first touch of the output
+    srand(rank + time(NULL));
+    int i;
+    int K = MAX_INT / num_elems;
+    for (i = 0; i < my_num_elems; i++) {
+        local_data[i] = rand() % K;
+        local_prefix_sums[i] = 0;
+    }
+    int prefix_capacity = my_num_elems;
+
+    // calibration: local scan throughput of this processor, from the fastest
+    // of the timed passes after a warm-up pass
+    double calib_usec = 0, best_usec = 0;
+    int pass;
+    for (pass = -1; pass < CALIBRATION_PASSES || calib_usec < CALIBRATION_USEC; pass++) {
+        double t0 = MPI_Wtime();
+        local_prefix_sums[0] = local_data[0];
+        for (i = 1; i < my_num_elems; i++)
+            local_prefix_sums[i] = local_prefix_sums[i-1] + local_data[i];
+        double pass_usec = (MPI_Wtime() - t0) * 1e6;
+        if (pass < 0)
+            continue;   // warm-up
+        calib_usec += pass_usec;
+        if (pass == 0 || pass_usec < best_usec)
+            best_usec = pass_usec;
+    }
+    if (best_usec < 1e-3)
+        best_usec = 1e-3;   // below the clock resolution
+    double my_throughput = my_num_elems / best_usec;
+    MPI_Allgather(&my_throughput, 1, MPI_DOUBLE, throughputs, 1, MPI_DOUBLE,
+                  MPI_COMM_WORLD);
+    weighted_partition(weighted_starts, throughputs, num_elems, num_procs);
+
+    if (rank == 0) {
+        printf("Calibrated throughput (elems/usec) and weighted range:\n");
+        fprintf(fp, "Calibrated throughput (elems/usec) and weighted range:\n");
+        for (i = 0; i < num_procs; i++) {
+            printf("  rank %d: %.1f, [%d, %d)\n", i, throughputs[i],
+                    weighted_starts[i], weighted_starts[i+1]);
+            fprintf(fp, "  rank %d: %.1f, [%d, %d)\n", i, throughputs[i],
+                    weighted_starts[i], weighted_starts[i+1]);
+        }
+        printf("\nStart ...\n");
+        fprintf(fp, "\nStart ...\n");
+    }
+
+    const char *partition_names[2] = {"even", "weighted"};
+    double imbalance[2];
+    int partition, iter;
+    for (partition = 0; partition < 2; partition++) {
+        if (partition == 1) {
+            local_data = redistribute(local_data, even_starts, weighted_starts,
+                                      rank, num_procs);
+            my_num_elems = weighted_starts[rank + 1] - weighted_starts[rank];
+            // reuse the output buffer, growing and first-touching it only if
+            // the weighted range is longer
+            if (my_num_elems > prefix_capacity) {
+                long *grown = (long *) realloc(local_prefix_sums,
+                                               sizeof(long) * my_num_elems);
+                if (grown == NULL) {
+                    printf("Processor %d failed in realloc.\n", rank);
+                    MPI_Abort(MPI_COMM_WORLD, -2);
+                }
+                local_prefix_sums = grown;
+                for (i = prefix_capacity; i < my_num_elems; i++)
+                    local_prefix_sums[i] = 0;
+                prefix_capacity = my_num_elems;
+            }
+        }
+
+        // untimed warm-up scan, so no timed iteration pays for cold caches
+        scan(local_data, local_prefix_sums, my_num_elems, rank);
+
+        suseconds_t total_usec = 0;
+        double my_compute_usec = 0;
+        for (iter = 0; iter < num_iters; iter++) {
+            MPI_Barrier(MPI_COMM_WORLD);
+            gettimeofday(&start_time, NULL);
+
+            my_compute_usec += scan(local_data, local_prefix_sums, my_num_elems, rank);
+
+            MPI_Barrier(MPI_COMM_WORLD);
+            gettimeofday(&end_time, NULL);
+
+            usecs[iter] = usec(start_time, end_time);
+            total_usec += usecs[iter];
+
+            if (rank == 0) {
+                printf("%s iteration %d elapsed time: %d (usec)\n",
+                        partition_names[partition], iter, usecs[iter]);
+                fprintf(fp, "%s iteration %d elapsed time: %d (usec)\n",
+                        partition_names[partition], iter, usecs[iter]);
+            }
+        }
+
+        // imbalance ratio of the compute time: max / mean over processors
+        double max_compute = 0, sum_compute = 0;
+        MPI_Reduce(&my_compute_usec, &max_compute, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+        MPI_Reduce(&my_compute_usec, &sum_compute, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+        imbalance[partition] = sum_compute > 0 ? max_compute / (sum_compute / num_procs) : 1.0;
+
+#ifdef VERIFY
+        long my_last = local_prefix_sums[my_num_elems - 1];
+        long prev_last = 0;
+        MPI_Sendrecv(&my_last, 1, MPI_LONG,
+                     (rank == num_procs - 1) ? MPI_PROC_NULL : rank + 1, 1,
+                     &prev_last, 1, MPI_LONG,
+                     (rank == 0) ? MPI_PROC_NULL : rank - 1, 1,
+                     MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        int local_error = verify_local_prefix_sums(local_prefix_sums, local_data,
+                                                   my_num_elems, prev_last);
+        int start = (partition == 0) ? even_starts[rank] : weighted_starts[rank];
+        int my_error = (local_error < my_num_elems) ? start + local_error : num_elems;
+        int first_error = num_elems;
+        MPI_Allreduce(&my_error, &first_error, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+        if (my_error < num_elems && my_error == first_error) {
+            printf("Wrong %s prefix sum implementation: error at position %d\n",
+                    partition_names[partition], my_error);
+        }
+        if (first_error < num_elems)
+            MPI_Abort(MPI_COMM_WORLD, -1);
+#endif // #ifdef VERIFY
+
+        if (rank == 0) {
+            printf("%s partition average elapsed time: %d (usec), std %f, imbalance ratio %.3f\n\n",
+                    partition_names[partition], total_usec / num_iters,
+                    calculate_standard_deviation(usecs, num_iters), imbalance[partition]);
+            fprintf(fp, "%s partition average elapsed time: %d (usec), std %f, imbalance ratio %.3f\n\n",
+                    partition_names[partition], total_usec / num_iters,
+                    calculate_standard_deviation(usecs, num_iters), imbalance[partition]);
+        }
+    }
+
+    if (rank == 0) {
+        printf("Imbalance ratio (max / mean compute time): even %.3f -> weighted %.3f\n",
+                imbalance[0], imbalance[1]);
+        fprintf(fp, "Imbalance ratio (max / mean compute time): even %.3f -> weighted %.3f\n",
+                imbalance[0], imbalance[1]);
+        fclose(fp);
+    }
+
+    free(local_data);
+    free(local_prefix_sums);
+    free(even_starts);
+    free(weighted_starts);
+    free(throughputs);
+    free(usecs);
+
+    MPI_Finalize();
+
+    return 0;
+}
@@ -0,0 +1,252 @@
+/*
+ * prefixsum_columns.c
+ *
+ * Description: Running totals of K columns of the same table using OpenMP,
+ * one scan per column against the multi-column scans of libprefixsum.
+ *
+ * Procedure:
+ * 1. All the threads generate max_cols columns of num_rows random integers
+ *    (in parallel OpenMP region), stored as structure of arrays;
+ * 2. For K = 1, 2, 4, ..., max_cols the first K columns are also copied into
+ *    a row-major interleaved table, row i at in[i * K];
+ * 3. Three methods are timed num_iters times for every K:
+ *    - per column: K calls of scan_i32_i64, K fork/joins and K carry
+ *      exchanges;
+ *    - soa: one scan_i32_i64_columns call over the K column arrays, one
+ *      fork/join and one exchange of K carries per thread;
+ *    - rows: one scan_i32_i64_rows call over the interleaved table, with the
+ *      K running sums of a row updated by one vector loop;
+ * 4. The cost per column (usec and ns per element) is reported as K grows.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <sys/time.h>
+#include <omp.h>
+
+#include "prefixsum.h"
+
+#define MAX_INT 2147483647
+#define NUM_METHODS 3
+#define VERIFY
+
+// usec: calculate the time interval in microseconds
+inline suseconds_t usec(struct timeval start, struct timeval end)
+{
+  return ((double) (((end.tv_sec * 1000000 + end.tv_usec) -
+                     (start.tv_sec * 1000000 + start.tv_usec))));
+}
+
+double calculate_standard_deviation(suseconds_t *data, int n) {
+    double mean = 0.0;
+    double variance = 0.0;
+    double std_dev = 0.0;
+
+    for (int i = 0; i < n; i++) {
+        mean += (double)data[i];
+    }
+    mean /= n;
+
+    for (int i = 0; i < n; i++) {
+        variance += (data[i] - mean) * (data[i] - mean);
+    }
+    variance /= n;
+
+    std_dev = sqrt(variance);
+
+    return std_dev;
+}
+
+int main(int argc, char *argv[])
+{
+    int num_rows = 0;
+    int num_iters = 0;
+    int num_threads = 0;
+    int max_cols = 16;
+
+    struct timeval start_time, end_time;  // for gettimeofday to calculate timing
+
+    char filename[256] = "prefixsum_columns_";
+    FILE *fp = NULL;
+
+    if (argc < 4) {
+        printf("Usage: %s [num_rows] [num_iters] [num_threads] [max_cols]\n", argv[0]);
+        printf("    - num_rows:  number of elements per column\n");
+        printf("    - num_iters: number of iterations\n");
+        printf("    - num_threads: number of threads\n");
+        printf("    - max_cols: largest number of columns (optional, default 16)\n");
+        exit(-1);
+    }
+
+    num_rows = atoi(argv[1]);
+    num_iters = atoi(argv[2]);
+    num_threads = atoi(argv[3]);
+    if (argc > 4)
+        max_cols = atoi(argv[4]);
+
+    if (num_threads < 1) {
+        printf("Number of threads should be more than one!\n");
+        exit(-1);
+    }
+    if (num_rows < 1 || num_iters < 1 || max_cols < 1) {
+        printf("Number of rows, iterations and columns should be positive!\n");
+        exit(-1);
+    }
+
+    strcat(filename, argv[1]);
+    strcat(filename, "rows_");
+    strcat(filename, argv[2]);
+    strcat(filename, "iters_");
+    strcat(filename, argv[3]);
+    strcat(filename, "threads.txt");
+
+    fp = fopen(filename, "w");
+    if (fp) {
+        printf("Command line: %s %d %d %d %d\n",
+                argv[0], num_rows, num_iters, num_threads, max_cols);
+        printf("Stats file: %s\n\n", filename);
+        fprintf(fp, "Command line: %s %d %d %d %d\n",
+                argv[0], num_rows, num_iters, num_threads, max_cols);
+        fprintf(fp, "Stats file: %s\n\n", filename);
+    } else {
+        printf("ERROR: can't open the file %s!\n", filename);
+        exit(-1);
+    }
+
+    // Memory allocation: max_cols input and output columns, their row-major
+    // copies and the reference per-column scans
+    long table_elems = (long) num_rows * max_cols;
+    int *columns = (int *) malloc(sizeof(int) * table_elems);
+    long *col_sums = (long *) malloc(sizeof(long) * table_elems);
+    long *percol_sums = (long *) malloc(sizeof(long) * table_elems);
+    int *rows = (int *) malloc(sizeof(int) * table_elems);
+    long *row_sums = (long *) malloc(sizeof(long) * table_elems);
+    const int32_t **ins = (const int32_t **) malloc(sizeof(int32_t *) * max_cols);
+    int64_t **outs = (int64_t **) malloc(sizeof(int64_t *) * max_cols);
+    suseconds_t *usecs = (suseconds_t *) malloc(sizeof(suseconds_t) * num_iters);
+    scan_ctx_t *ctx = scan_ctx_create(num_threads);
+    if (columns == NULL || col_sums == NULL || percol_sums == NULL ||
+        rows == NULL || row_sums == NULL || ins == NULL || outs == NULL ||
+        usecs == NULL || ctx == NULL) {
+        printf("Failed in malloc()\n");
+        printf(" - columns: %p\n", columns);
+        printf(" - col_sums: %p\n", col_sums);
+        printf(" - percol_sums: %p\n", percol_sums);
+        printf(" - rows: %p\n", rows);
+        printf(" - row_sums: %p\n", row_sums);
+        exit(-2);
+    }
+    int c;
+    for (c = 0; c < max_cols; c++) {
+        ins[c] = columns + (long) c * num_rows;
+        outs[c] = col_sums + (long) c * num_rows;
+    }
+
+    // set number of threads
+    omp_set_num_threads(num_threads);
+
+    // Generate random ints in parallel
+    int K = MAX_INT / num_rows;
+
+    #pragma omp parallel
+    {
+        int tid = omp_get_thread_num();
+        unsigned int seed = tid + time(NULL);
+        long i;
+
+        #pragma omp for schedule(static)
+        for (i = 0; i < table_elems; i++) {
+            columns[i] = rand_r(&seed) % K;
+            col_sums[i] = percol_sums[i] = row_sums[i] = 0;
+        }
+    }
+
+    printf("Start ...\n");
+    fprintf(fp, "Start ...\n");
+
+    const char *method_names[NUM_METHODS] = {"per column", "soa", "rows"};
+    int errors = 0;
+    int num_cols;
+    for (num_cols = 1; num_cols <= max_cols; num_cols *= 2) {
+        long i;
+
+        // row-major copy of the first num_cols columns
+        #pragma omp parallel for schedule(static) private(c)
+        for (i = 0; i < num_rows; i++)
+            for (c = 0; c < num_cols; c++)
+                rows[i * num_cols + c] = ins[c][i];
+
+        for (int method = 0; method < NUM_METHODS; method++) {
+            suseconds_t total_usec = 0;
+            for (int iter = 0; iter < num_iters; iter++) {
+                gettimeofday(&start_time, NULL);
+                if (method == 0) {
+                    for (c = 0; c < num_cols; c++)
+                        scan_i32_i64(ctx, ins[c], percol_sums + (long) c * num_rows,
+                                     num_rows);
+                } else if (method == 1) {
+                    scan_i32_i64_columns(ctx, ins, outs, num_cols, num_rows);
+                } else {
+                    scan_i32_i64_rows(ctx, rows, row_sums, num_cols, num_rows);
+                }
+                gettimeofday(&end_time, NULL);
+                usecs[iter] = usec(start_time, end_time);
+                total_usec += usecs[iter];
+            }
+
+            suseconds_t avg_usec = total_usec / num_iters;
+            double ns_per_elem = 1000.0 * avg_usec / ((double) num_rows * num_cols);
+            printf("K = %3d %-10s: %d (usec), std %f, per column %.1f (usec), %.3f ns/elem\n",
+                    num_cols, method_names[method], avg_usec,
+                    calculate_standard_deviation(usecs, num_iters),
+                    (double) avg_usec / num_cols, ns_per_elem);
+            fprintf(fp, "K = %3d %-10s: %d (usec), std %f, per column %.1f (usec), %.3f ns/elem\n",
+                    num_cols, method_names[method], avg_usec,
+                    calculate_standard_deviation(usecs, num_iters),
+                    (double) avg_usec / num_cols, ns_per_elem);
+        }
+
+#ifdef VERIFY
+        // all three methods against a serial running sum of every column
+        long bad = -1;
+        for (c = 0; c < num_cols && bad < 0; c++) {
+            long ref = 0, r;
+            for (r = 0; r < num_rows; r++) {
+                ref += ins[c][r];
+                i = (long) c * num_rows + r;
+                if (percol_sums[i] != ref || col_sums[i] != ref ||
+                    row_sums[r * num_cols + c] != ref) {
+                    bad = i;
+                    break;
+                }
+            }
+        }
+        if (bad >= 0) {
+            printf("Wrong multi-column prefix sum implementation: K = %d, column %ld, row %ld\n",
+                    num_cols, bad / num_rows, bad % num_rows);
+            errors++;
+        }
+#endif // #ifdef VERIFY
+    }
+
+    printf("Finish OpenMP Multi-Column Prefix Sum\n");
+    fprintf(fp, "Finish OpenMP Multi-Column Prefix Sum\n");
+
+    // free the allocated memory
+    free(columns);
+    free(col_sums);
+    free(percol_sums);
+    free(rows);
+    free(row_sums);
+    free(ins);
+    free(outs);
+    free(usecs);
+    scan_ctx_destroy(ctx);
+
+    fclose(fp);
+
+    return errors ? -1 : 0;
+}
@@ -0,0 +1,425 @@
+/*
+ * prefixsum_compact.c
+ *
+ * Description: Parallel stream compaction (filter) and stable partition of a
+ * sequence of randomly generated integers using OpenMP, with the output
+ * offsets computed by a scan of per-thread counts instead of a scan of the
+ * per-element flags.
+ *
+ * Procedure:
+ * 1. All the threads generate num_elems random integers uniform in
+ *    [0, VALUE_RANGE) (in parallel OpenMP region); the predicate keeps the
+ *    elements below a threshold, so the threshold sets the selectivity;
+ * 2. scan + scatter (baseline): flags are written for every element, scanned
+ *    into a long offsets array with scan_i32_i64 of libprefixsum, and
+ *    a separate pass scatters the kept elements to their offsets;
+ * 3. compact: in one parallel region every thread counts the kept elements
+ *    of its partition, one thread scans the num_threads counts, and every
+ *    thread writes its kept elements straight to its output range. No
+ *    per-element flags or offsets are stored;
+ * 4. partition: the same with two counts per thread, the kept elements go to
+ *    the front and the rejected ones after them, both in input order;
+ * 5. Every selectivity from 1% to 99% is timed num_iters times per method.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <omp.h>
+
+#include "prefixsum.h"
+
+#define VALUE_RANGE 1000000     // data values are uniform in [0, VALUE_RANGE)
+#define NUM_SELECTIVITIES 7
+#define NUM_METHODS 3
+#define VERIFY
+
+// usec: calculate the time interval in microseconds
+inline suseconds_t usec(struct timeval start, struct timeval end)
+{
+  return ((double) (((end.tv_sec * 1000000 + end.tv_usec) -
+                     (start.tv_sec * 1000000 + start.tv_usec))));
+}
+
+double calculate_standard_deviation(suseconds_t *data, int n) {
+    double mean = 0.0;
+    double variance = 0.0;
+    double std_dev = 0.0;
+
+    for (int i = 0; i < n; i++) {
+        mean += (double)data[i];
+    }
+    mean /= n;
+
+    for (int i = 0; i < n; i++) {
+        variance += (data[i] - mean) * (data[i] - mean);
+    }
+    variance /= n;
+
+    std_dev = sqrt(variance);
+
+    return std_dev;
+}
+
+// keep: the predicate, an element survives when it is below threshold
+static inline int keep(int x, int threshold)
+{
+    return x < threshold;
+}
+
+// scan_then_scatter: flags, scan of the flags, scatter; returns the number
+// of kept elements
+long scan_then_scatter(int *out, int *data, int *flags, long *offsets,
+                       int *starts, int *ends, scan_ctx_t *ctx,
+                       int num_threads, int threshold)
+{
+    #pragma omp parallel
+    {
+        int tid = omp_get_thread_num();
+        int i;
+        for (i = starts[tid]; i < ends[tid]; i++)
+            flags[i] = keep(data[i], threshold);
+    }
+
+    scan_i32_i64(ctx, flags, offsets, ends[num_threads - 1]);
+
+    #pragma omp parallel
+    {
+        int tid = omp_get_thread_num();
+        int i;
+        for (i = starts[tid]; i < ends[tid]; i++)
+            if (flags[i])
+                out[offsets[i] - 1] = data[i];
+    }
+
+    return offsets[ends[num_threads - 1] - 1];
+}
+
+// compact: fused count, scan of the counts and write; tmp_sums holds
+// num_threads + 1 counts. Returns the number of kept elements
+long compact(int *out, int *data, int *starts, int *ends, long *tmp_sums,
+             int num_threads, int threshold)
+{
+    #pragma omp parallel
+    {
+        int tid = omp_get_thread_num();
+        int start = starts[tid];
+        int end = ends[tid];
+        int i;
+
+        long count = 0;
+        for (i = start; i < end; i++)
+            count += keep(data[i], threshold);
+        tmp_sums[tid] = count;
+
+        #pragma omp barrier
+        #pragma omp single
+        {
+            long carry = 0;
+            for (int ii = 0; ii < num_threads; ii++) {
+                long local = tmp_sums[ii];
+                tmp_sums[ii] = carry;
+                carry += local;
+            }
+            tmp_sums[num_threads] = carry;
+        }
+
+        // branch-free write: every element is stored at the current
+        // position, which only advances past the kept ones. The store is
+        // skipped once the range is full so the rejected tail cannot spill
+        // into the next thread's range
+        long pos = tmp_sums[tid];
+        long pos_end = pos + count;
+        for (i = start; i < end; i++) {
+            int x = data[i];
+            if (pos < pos_end)
+                out[pos] = x;
+            pos += keep(x, threshold);
+        }
+    }
+
+    return tmp_sums[num_threads];
+}
+
+// partition: stable partition, kept elements first; tmp_sums holds
+// 2 * (num_threads + 1) counts. Returns the number of kept elements
+long partition(int *out, int *data, int *starts, int *ends, long *tmp_sums,
+               int num_threads, int threshold)
+{
+    long *kept_sums = tmp_sums;
+    long *rejected_sums = tmp_sums + num_threads + 1;
+
+    #pragma omp parallel
+    {
+        int tid = omp_get_thread_num();
+        int start = starts[tid];
+        int end = ends[tid];
+        int i;
+
+        long count = 0;
+        for (i = start; i < end; i++)
+            count += keep(data[i], threshold);
+        kept_sums[tid] = count;
+        rejected_sums[tid] = (end - start) - count;
+
+        #pragma omp barrier
+        #pragma omp single
+        {
+            long kept = 0, rejected = 0;
+            for (int ii = 0; ii < num_threads; ii++) {
+                long local_kept = kept_sums[ii];
+                long local_rejected = rejected_sums[ii];
+                kept_sums[ii] = kept;
+                rejected_sums[ii] = rejected;
+                kept += local_kept;
+                rejected += local_rejected;
+            }
+            kept_sums[num_threads] = kept;
+            for (int ii = 0; ii < num_threads; ii++)
+                rejected_sums[ii] += kept;
+        }
+
+        long kept_pos = kept_sums[tid];
+        long kept_end = kept_pos + count;
+        long rejected_pos = rejected_sums[tid];
+        long rejected_end = rejected_pos + (end - start) - count;
+        for (i = start; i < end; i++) {
+            int x = data[i];
+            int k = keep(x, threshold);
+            if (kept_pos < kept_end)
+                out[kept_pos] = x;
+            if (rejected_pos < rejected_end)
+                out[rejected_pos] = x;
+            kept_pos += k;
+            rejected_pos += 1 - k;
+        }
+    }
+
+    return kept_sums[num_threads];
+}
+
+int main(int argc, char *argv[])
+{
+    int num_elems = 0;
+    int num_iters = 0;
+    int num_threads = 0;
+
+    int *data = NULL;
+    int *out = NULL;
+    int *flags = NULL;
+    long *offsets = NULL;
+    long *tmp_sums = NULL;
+    scan_ctx_t *ctx = NULL;
+
+    struct timeval start_time, end_time;  // for gettimeofday to calculate timing
+
+    char filename[256] = "prefixsum_compact_";
+    FILE *fp = NULL;
+
+    if (argc < 4) {
+        printf("Usage: %s [num_elems] [num_iters] [num_threads]\n", argv[0]);
+        printf("    - num_elems:  number of elements\n");
+        printf("    - num_iters: number of iterations\n");
+        printf("    - num_threads: number of threads\n");
+        exit(-1);
+    }
+
+    num_elems = atoi(argv[1]);
+    num_iters = atoi(argv[2]);
+    num_threads = atoi(argv[3]);
+
+    if (num_threads < 1) {
+        printf("Number of threads should be more than one!\n");
+        exit(-1);
+    }
+    if (num_elems < 1 || num_iters < 1) {
+        printf("Number of elements and iterations should be positive!\n");
+        exit(-1);
+    }
+
+    strcat(filename, argv[1]);
+    strcat(filename, "elems_");
+    strcat(filename, argv[2]);
+    strcat(filename, "iters_");
+    strcat(filename, argv[3]);
+    strcat(filename, "threads.txt");
+
+    fp = fopen(filename, "w");
+    if (fp) {
+        printf("Command line: %s %d %d %d\n",
+                argv[0], num_elems, num_iters, num_threads);
+        printf("Stats file: %s\n\n", filename);
+        fprintf(fp, "Command line: %s %d %d %d\n",
+                argv[0], num_elems, num_iters, num_threads);
+        fprintf(fp, "Stats file: %s\n\n", filename);
+    } else {
+        printf("ERROR: can't open the file %s!\n", filename);
+        exit(-1);
+    }
+
+    // data partition and allocation
+    int num_elems_mean = num_elems / num_threads;
+    int num_elems_remain = num_elems % num_threads;
+    // starting and ending IDs of data partition for each thread
+    int *starts;
+    int *ends;
+    starts = (int *) malloc(sizeof(int) * num_threads);
+    ends = (int *) malloc(sizeof(int) * num_threads);
+    int id;
+    for (id = 0; id < num_threads; id++) {
+        if (id < num_elems_remain) {
+            starts[id] = id * (num_elems_mean + 1);
+            ends[id] = starts[id] + (num_elems_mean + 1);
+        } else {
+            starts[id] = id * num_elems_mean + num_elems_remain;
+            ends[id] = starts[id] + num_elems_mean;
+        }
+    }
+
+    // Memory allocation
+    data = (int *) malloc(sizeof(int) * num_elems);
+    out = (int *) malloc(sizeof(int) * num_elems);
+    flags = (int *) malloc(sizeof(int) * num_elems);
+    offsets = (long *) malloc(sizeof(long) * num_elems);
+    tmp_sums = (long *) malloc(sizeof(long) * 2 * (num_threads + 1));
+    ctx = scan_ctx_create(num_threads);
+    suseconds_t *usecs = (suseconds_t *) malloc(sizeof(suseconds_t) * num_iters);
+    if (data == NULL || out == NULL || flags == NULL || offsets == NULL ||
+        tmp_sums == NULL || ctx == NULL || usecs == NULL) {
+        printf("Failed in malloc()\n");
+        printf(" - data: %p\n", data);
+        printf(" - out: %p\n", out);
+        printf(" - flags: %p\n", flags);
+        printf(" - offsets: %p\n", offsets);
+        free(data);
+        free(out);
+        free(flags);
+        free(offsets);
+        free(tmp_sums);
+        scan_ctx_destroy(ctx);
+        free(usecs);
+        exit(-2);
+    }
+
+    // set number of threads
+    omp_set_num_threads(num_threads);
+
+    // Generate random ints in parallel, first touch of the other arrays
+    #pragma omp parallel shared(starts, ends, data)
+    {
+        // get the local thread ID
+        int tid = omp_get_thread_num();
+        srand(tid + time(NULL));  // Seed rand function
+
+        int start = starts[tid];
+        int end = ends[tid];
+
+        int i;
+        for (i = start; i < end; i++) {
+            data[i] = rand() % VALUE_RANGE;
+            out[i] = 0;
+            flags[i] = 0;
+            offsets[i] = 0;
+        }
+    }
+
+    printf("Start ...\n");
+    fprintf(fp, "Start ...\n");
+    printf("%12s %10s %16s %16s %16s %9s\n", "selectivity", "kept",
+            "scan+scatter", "compact", "partition", "speedup");
+    fprintf(fp, "%12s %10s %16s %16s %16s %9s\n", "selectivity", "kept",
+            "scan+scatter", "compact", "partition", "speedup");
+
+    const int selectivities[NUM_SELECTIVITIES] = {1, 10, 25, 50, 75, 90, 99};
+    int s, method, iter;
+    for (s = 0; s < NUM_SELECTIVITIES; s++) {
+        int threshold = (int) ((long) VALUE_RANGE * selectivities[s] / 100);
+        suseconds_t avg_usecs[NUM_METHODS];
+        double std_usecs[NUM_METHODS];
+        long kept[NUM_METHODS];
+
+        for (method = 0; method < NUM_METHODS; method++) {
+            suseconds_t total_usec = 0;
+#ifdef VERIFY
+            // poison the output (-1, never an input value), so a method is not
+            // checked against what the previous one left in out
+            memset(out, 0xff, sizeof(int) * num_elems);
+#endif // #ifdef VERIFY
+            for (iter = 0; iter < num_iters; iter++) {
+                gettimeofday(&start_time, NULL);
+                if (method == 0)
+                    kept[method] = scan_then_scatter(out, data, flags, offsets,
+                            starts, ends, ctx, num_threads, threshold);
+                else if (method == 1)
+                    kept[method] = compact(out, data, starts, ends, tmp_sums,
+                            num_threads, threshold);
+                else
+                    kept[method] = partition(out, data, starts, ends, tmp_sums,
+                            num_threads, threshold);
+                gettimeofday(&end_time, NULL);
+                usecs[iter] = usec(start_time, end_time);
+                total_usec += usecs[iter];
+            }
+            avg_usecs[method] = total_usec / num_iters;
+            std_usecs[method] = calculate_standard_deviation(usecs, num_iters);
+
+#ifdef VERIFY
+            // kept elements in input order, then (partition) the rejected
+            // ones in input order
+            long pos = 0, num_kept;
+            int i, bad = -1;
+            for (i = 0; i < num_elems && bad < 0; i++) {
+                if (keep(data[i], threshold)) {
+                    if (out[pos] != data[i])
+                        bad = i;
+                    pos++;
+                }
+            }
+            num_kept = pos;
+            for (i = 0; method == 2 && i < num_elems && bad < 0; i++) {
+                if (!keep(data[i], threshold)) {
+                    if (out[pos] != data[i])
+                        bad = i;
+                    pos++;
+                }
+            }
+            if (bad >= 0 || kept[method] != num_kept) {
+                printf("Wrong %s implementation at %d%% selectivity: error at input position %d\n",
+                        method == 0 ? "scan+scatter" : method == 1 ? "compact" : "partition",
+                        selectivities[s], bad);
+                exit(-1);
+            }
+#endif // #ifdef VERIFY
+        }
+
+        printf("%11d%% %10ld %9d (usec) %9d (usec) %9d (usec) %8.2fx\n",
+                selectivities[s], kept[1], avg_usecs[0], avg_usecs[1], avg_usecs[2],
+                avg_usecs[1] > 0 ? (double) avg_usecs[0] / avg_usecs[1] : 0.0);
+        fprintf(fp, "%11d%% %10ld %9d (usec) %9d (usec) %9d (usec) %8.2fx\n",
+                selectivities[s], kept[1], avg_usecs[0], avg_usecs[1], avg_usecs[2],
+                avg_usecs[1] > 0 ? (double) avg_usecs[0] / avg_usecs[1] : 0.0);
+        fprintf(fp, "    std: %f / %f / %f\n", std_usecs[0], std_usecs[1], std_usecs[2]);
+    }
+
+    printf("Finish OpenMP Parallel Compaction\n");
+    fprintf(fp, "Finish OpenMP Parallel Compaction\n");
+
+    // free the allocated memory
+    free(starts);
+    free(ends);
+    free(data);
+    free(out);
+    free(flags);
+    free(offsets);
+    free(tmp_sums);
+    scan_ctx_destroy(ctx);
+    free(usecs);
+
+    fclose(fp);
+
+    return 0;
+}
@@ -0,0 +1,536 @@
+/*
+ * prefixsum_compressed.c
+ *
+ * Description: Parallel prefix sums of a sequence of randomly generated
+ * integers stored in a compressed form with O(1) random access, using
+ * OpenMP. The inputs are small (K = MAX_INT / num_elems), so the prefix sums
+ * inside a block of BLOCK_ELEMS elements only span a narrow range and are
+ * stored as 8/16/32-bit deltas from a 64-bit per-block base instead of 8-byte
+ * longs.
+ *
+ * Procedure:
+ * 1. All the threads generate num_elems random integers (in parallel OpenMP
+ *    region);
+ * 2. Each thread takes a contiguous range of blocks and, for every block,
+ *    scans it locally to find its total and the minimum and maximum of the
+ *    local prefix sums, which give the narrowest delta width for the block
+ *    and so its size in bytes (in parallel OpenMP region);
+ * 3. The per-thread data totals and byte counts are scanned, which gives
+ *    every thread the prefix sum before its first block and the payload
+ *    offset of its first block;
+ * 4. Each thread scans its blocks again and writes the block bases, payload
+ *    offsets and narrow deltas directly (in parallel OpenMP region), so the
+ *    full 8-byte prefix sums are never materialized;
+ * 5. prefix(i) is bases[b] + delta[b][j] with b = i / BLOCK_ELEMS, and the
+ *    decoder expands whole blocks with one tight loop per delta width.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <omp.h>
+
+#include "prefixsum.h"
+
+#define MAX_INT 2147483647
+#define BLOCK_SHIFT 8
+#define BLOCK_ELEMS (1 << BLOCK_SHIFT)  // elements per compressed block
+#define NUM_READS 1000000               // random accesses timed per iteration
+//#define PRINT_PREFIXSUM
+#define VERIFY
+
+// usec: calculate the time interval in microseconds
+inline suseconds_t usec(struct timeval start, struct timeval end)
+{
+  return ((double) (((end.tv_sec * 1000000 + end.tv_usec) -
+                     (start.tv_sec * 1000000 + start.tv_usec))));
+}
+
+double calculate_standard_deviation(suseconds_t *data, int n) {
+    double mean = 0.0;
+    double variance = 0.0;
+    double std_dev = 0.0;
+
+    for (int i = 0; i < n; i++) {
+        mean += (double)data[i];
+    }
+    mean /= n;
+
+    for (int i = 0; i < n; i++) {
+        variance += (data[i] - mean) * (data[i] - mean);
+    }
+    variance /= n;
+
+    std_dev = sqrt(variance);
+
+    return std_dev;
+}
+
+// Compressed prefix sums: prefix(i) = bases[b] + delta, where the delta of
+// element j of block b is stored with widths[b] bytes at
+// payload + offsets[b] + j * widths[b].
+typedef struct {
+    long *bases;
+    long *offsets;
+    unsigned char *widths;
+    unsigned char *payload;
+    long payload_capacity;
+    long payload_bytes;
+    int num_elems;
+    int num_blocks;
+} compressed_t;
+
+// delta_width: smallest of 1, 2, 4 or 8 bytes holding values in [0, range]
+static inline int delta_width(long range)
+{
+    if (range < (1L << 8))
+        return 1;
+    if (range < (1L << 16))
+        return 2;
+    if (range < (1L << 32))
+        return 4;
+    return 8;
+}
+
+static inline int block_end(compressed_t *cp, int b)
+{
+    int end = (b + 1) * BLOCK_ELEMS;
+    return end < cp->num_elems ? end : cp->num_elems;
+}
+
+// compressed_scan: compute the prefix sums of data directly into cp.
+// thread_sums and thread_bytes hold one entry per thread. Returns -1 if the
+// payload does not fit into the current capacity (cp->payload_bytes then
+// holds the size needed), 0 on success.
+int compressed_scan(compressed_t *cp, int *data, long *thread_sums,
+                    long *thread_bytes)
+{
+    int overflow = 0;
+
+    #pragma omp parallel shared(cp, data, thread_sums, thread_bytes, overflow)
+    {
+        int num_threads = omp_get_num_threads();
+        int tid = omp_get_thread_num();
+        int b_start = (long) cp->num_blocks * tid / num_threads;
+        int b_end = (long) cp->num_blocks * (tid + 1) / num_threads;
+        int b, i;
+
+        // 1. block totals, delta ranges and widths; bases temporarily hold
+        //    the minimum local prefix sum and offsets the block byte size
+        long sum = 0, bytes = 0;
+        for (b = b_start; b < b_end; b++) {
+            int start = b * BLOCK_ELEMS;
+            int end = block_end(cp, b);
+            long local = 0;
+            long min_local = data[start], max_local = data[start];
+            for (i = start; i < end; i++) {
+                local += data[i];
+                if (local < min_local) min_local = local;
+                if (local > max_local) max_local = local;
+            }
+            int width = delta_width(max_local - min_local);
+            cp->widths[b] = width;
+            cp->bases[b] = min_local;
+            cp->offsets[b] = bytes;
+            bytes += (long) width * (end - start);
+            sum += local;
+        }
+        thread_sums[tid] = sum;
+        thread_bytes[tid] = bytes;
+        #pragma omp barrier
+
+        // 2. carries of the data totals and of the byte counts
+        #pragma omp single
+        {
+            long sum_carry = 0, bytes_carry = 0;
+            int t;
+            for (t = 0; t < num_threads; t++) {
+                long s = thread_sums[t], n = thread_bytes[t];
+                thread_sums[t] = sum_carry;
+                thread_bytes[t] = bytes_carry;
+                sum_carry += s;
+                bytes_carry += n;
+            }
+            cp->payload_bytes = bytes_carry;
+            overflow = bytes_carry > cp->payload_capacity;
+        }
+
+        // 3. bases, offsets and deltas
+        if (!overflow) {
+            long prefix = thread_sums[tid];
+            long byte_base = thread_bytes[tid];
+            for (b = b_start; b < b_end; b++) {
+                int start = b * BLOCK_ELEMS;
+                int end = block_end(cp, b);
+                long min_local = cp->bases[b];
+                long base = prefix + min_local;
+                long offset = byte_base + cp->offsets[b];
+                long local = -min_local;    // local prefix minus min_local
+                cp->bases[b] = base;
+                cp->offsets[b] = offset;
+                switch (cp->widths[b]) {
+                case 1: {
+                    unsigned char *out = cp->payload + offset;
+                    for (i = start; i < end; i++) {
+                        local += data[i];
+                        out[i - start] = local;
+                    }
+                    break;
+                }
+                case 2: {
+                    unsigned short *out = (unsigned short *) (cp->payload + offset);
+                    for (i = start; i < end; i++) {
+                        local += data[i];
+                        out[i - start] = local;
+                    }
+                    break;
+                }
+                case 4: {
+                    unsigned int *out = (unsigned int *) (cp->payload + offset);
+                    for (i = start; i < end; i++) {
+                        local += data[i];
+                        out[i - start] = local;
+                    }
+                    break;
+                }
+                default: {
+                    long *out = (long *) (cp->payload + offset);
+                    for (i = start; i < end; i++) {
+                        local += data[i];
+                        out[i - start] = local;
+                    }
+                    break;
+                }
+                }
+                prefix = base + local;
+            }
+        }
+    }
+    return overflow ? -1 : 0;
+}
+
+// compressed_get: prefix sum of data[0..i] in O(1)
+static inline long compressed_get(compressed_t *cp, int i)
+{
+    int b = i >> BLOCK_SHIFT;
+    int j = i & (BLOCK_ELEMS - 1);
+    unsigned char *p = cp->payload + cp->offsets[b];
+    switch (cp->widths[b]) {
+    case 1:
+        return cp->bases[b] + p[j];
+    case 2:
+        return cp->bases[b] + ((unsigned short *) p)[j];
+    case 4:
+        return cp->bases[b] + ((unsigned int *) p)[j];
+    default:
+        return cp->bases[b] + ((long *) p)[j];
+    }
+}
+
+// compressed_decode: expand all the prefix sums into prefix_sums
+void compressed_decode(compressed_t *cp, long *prefix_sums)
+{
+    int b;
+    #pragma omp parallel for schedule(static)
+    for (b = 0; b < cp->num_blocks; b++) {
+        int start = b * BLOCK_ELEMS;
+        int n = block_end(cp, b) - start;
+        long base = cp->bases[b];
+        long *out = prefix_sums + start;
+        unsigned char *p = cp->payload + cp->offsets[b];
+        int j;
+        switch (cp->widths[b]) {
+        case 1:
+            for (j = 0; j < n; j++)
+                out[j] = base + p[j];
+            break;
+        case 2:
+            for (j = 0; j < n; j++)
+                out[j] = base + ((unsigned short *) p)[j];
+            break;
+        case 4:
+            for (j = 0; j < n; j++)
+                out[j] = base + ((unsigned int *) p)[j];
+            break;
+        default:
+            for (j = 0; j < n; j++)
+                out[j] = base + ((long *) p)[j];
+            break;
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int num_elems = 0;
+    int num_iters = 0;
+    int num_threads = 0;
+
+    int *data = NULL;
+    long *prefix_sums = NULL;
+    long *tmp_sums = NULL;
+    scan_ctx_t *ctx = NULL;
+    long *tmp_bytes = NULL;
+    compressed_t cp;
+
+    struct timeval start_time, end_time;  // for gettimeofday to calculate timing
+
+    char filename[256] = "prefixsum_compressed_";
+    FILE *fp = NULL;
+
+    if (argc < 4) {
+        printf("Usage: %s [num_elems] [num_iters] [num_threads]\n", argv[0]);
+        printf("    - num_elems:  number of elements\n");
+        printf("    - num_iters: number of iterations\n");
+        printf("    - num_threads: number of threads\n");
+        exit(-1);
+    }
+
+    num_elems = atoi(argv[1]);
+    num_iters = atoi(argv[2]);
+    num_threads = atoi(argv[3]);
+
+    if (num_threads < 1) {
+        printf("Number of threads should be more than one!\n");
+        exit(-1);
+    }
+    if (num_elems < 1 || num_iters < 1) {
+        printf("Number of elements and iterations should be positive!\n");
+        exit(-1);
+    }
+
+    strcat(filename, argv[1]);
+    strcat(filename, "elems_");
+    strcat(filename, argv[2]);
+    strcat(filename, "iters_");
+    strcat(filename, argv[3]);
+    strcat(filename, "threads.txt");
+
+    fp = fopen(filename, "w");
+    if (fp) {
+        printf("Command line: %s %d %d %d\n",
+                argv[0], num_elems, num_iters, num_threads);
+        printf("Stats file: %s\n\n", filename);
+        fprintf(fp, "Command line: %s %d %d %d\n",
+                argv[0], num_elems, num_iters, num_threads);
+        fprintf(fp, "Stats file: %s\n\n", filename);
+    } else {
+        printf("ERROR: can't open the file %s!\n", filename);
+        exit(-1);
+    }
+
+    // data partition and allocation
+    int num_elems_mean = num_elems / num_threads;
+    int num_elems_remain = num_elems % num_threads;
+    // starting and ending IDs of data partition for each thread
+    int *starts;
+    int *ends;
+    starts = (int *) malloc(sizeof(int) * num_threads);
+    ends = (int *) malloc(sizeof(int) * num_threads);
+    int id;
+    for (id = 0; id < num_threads; id++) {
+        if (id < num_elems_remain) {
+            starts[id] = id * (num_elems_mean + 1);
+            ends[id] = starts[id] + (num_elems_mean + 1);
+        } else {
+            starts[id] = id * num_elems_mean + num_elems_remain;
+            ends[id] = starts[id] + num_elems_mean;
+        }
+    }
+
+    // Memory allocation; the payload starts at 2 bytes per element and
+    // grows if the data needs wider deltas
+    cp.num_elems = num_elems;
+    cp.num_blocks = (num_elems + BLOCK_ELEMS - 1) / BLOCK_ELEMS;
+    cp.bases = (long *) malloc(sizeof(long) * cp.num_blocks);
+    cp.offsets = (long *) malloc(sizeof(long) * cp.num_blocks);
+    cp.widths = (unsigned char *) malloc(cp.num_blocks);
+    cp.payload_capacity = 2L * num_elems;
+    cp.payload = (unsigned char *) malloc(cp.payload_capacity);
+    data = (int *) malloc(sizeof(int) * num_elems);
+    prefix_sums = (long *) malloc(sizeof(long) * num_elems);
+    tmp_sums = (long *) malloc(sizeof(long) * num_threads);
+    ctx = scan_ctx_create(num_threads);
+    tmp_bytes = (long *) malloc(sizeof(long) * num_threads);
+    int *reads = (int *) malloc(sizeof(int) * NUM_READS);
+    suseconds_t *plain_usecs = (suseconds_t *) malloc(sizeof(suseconds_t) * num_iters);
+    suseconds_t *comp_usecs = (suseconds_t *) malloc(sizeof(suseconds_t) * num_iters);
+    if (cp.bases == NULL || cp.offsets == NULL || cp.widths == NULL ||
+        cp.payload == NULL || data == NULL || prefix_sums == NULL ||
+        tmp_sums == NULL || ctx == NULL || tmp_bytes == NULL || reads == NULL ||
+        plain_usecs == NULL || comp_usecs == NULL) {
+        printf("Failed in malloc()\n");
+        printf(" - data: %p\n", data);
+        printf(" - prefix_sums: %p\n", prefix_sums);
+        printf(" - payload: %p\n", cp.payload);
+        exit(-2);
+    }
+
+    // set number of threads
+    omp_set_num_threads(num_threads);
+
+    // Generate random ints in parallel
+    int K = MAX_INT / num_elems;
+
+    #pragma omp parallel shared(starts, ends, K, data)
+    {
+        // get the local thread ID
+        int tid = omp_get_thread_num();
+        srand(tid + time(NULL));  // Seed rand function
+
+        int start = starts[tid];
+        int end = ends[tid];
+
+        int i;
+        for (i = start; i < end; i++) {
+            data[i] = rand() % K;
+        }
+    }
+
+    int i;
+    for (i = 0; i < NUM_READS; i++)
+        reads[i] = rand() % num_elems;
+
+    // size the payload once so that the timed iterations never reallocate
+    if (compressed_scan(&cp, data, tmp_sums, tmp_bytes) != 0) {
+        cp.payload_capacity = cp.payload_bytes;
+        free(cp.payload);
+        cp.payload = (unsigned char *) malloc(cp.payload_capacity);
+        if (cp.payload == NULL) {
+            printf("Failed in malloc() of %ld payload bytes\n", cp.payload_capacity);
+            exit(-2);
+        }
+        compressed_scan(&cp, data, tmp_sums, tmp_bytes);
+    }
+
+    printf("Start ...\n");
+    fprintf(fp, "Start ...\n");
+
+    suseconds_t plain_total = 0, comp_total = 0;
+    int iter;
+    for (iter = 0; iter < num_iters; iter++) {
+        gettimeofday(&start_time, NULL);
+        scan_i32_i64(ctx, data, prefix_sums, num_elems);
+        gettimeofday(&end_time, NULL);
+        plain_usecs[iter] = usec(start_time, end_time);
+        plain_total += plain_usecs[iter];
+
+        gettimeofday(&start_time, NULL);
+        compressed_scan(&cp, data, tmp_sums, tmp_bytes);
+        gettimeofday(&end_time, NULL);
+        comp_usecs[iter] = usec(start_time, end_time);
+        comp_total += comp_usecs[iter];
+
+        printf("iteration %d elapsed time: plain %d (usec), compressed %d (usec)\n",
+                iter, plain_usecs[iter], comp_usecs[iter]);
+        fprintf(fp, "iteration %d elapsed time: plain %d (usec), compressed %d (usec)\n",
+                iter, plain_usecs[iter], comp_usecs[iter]);
+    }
+
+    // random access: plain array vs compressed
+    long checksum_plain = 0, checksum_comp = 0;
+    suseconds_t plain_read_usec, comp_read_usec;
+    gettimeofday(&start_time, NULL);
+    for (i = 0; i < NUM_READS; i++)
+        checksum_plain += prefix_sums[reads[i]];
+    gettimeofday(&end_time, NULL);
+    plain_read_usec = usec(start_time, end_time);
+
+    gettimeofday(&start_time, NULL);
+    for (i = 0; i < NUM_READS; i++)
+        checksum_comp += compressed_get(&cp, reads[i]);
+    gettimeofday(&end_time, NULL);
+    comp_read_usec = usec(start_time, end_time);
+
+    // full decode into the plain array
+    suseconds_t decode_usec;
+    gettimeofday(&start_time, NULL);
+    compressed_decode(&cp, prefix_sums);
+    gettimeofday(&end_time, NULL);
+    decode_usec = usec(start_time, end_time);
+
+    long plain_bytes = sizeof(long) * (long) num_elems;
+    long comp_bytes = cp.payload_bytes +
+                      (sizeof(long) * 2 + 1) * (long) cp.num_blocks;
+    long width_counts[9] = {0};
+    int b;
+    for (b = 0; b < cp.num_blocks; b++)
+        width_counts[cp.widths[b]]++;
+
+    printf("Finish Compressed Prefix Sum calculation\n\n");
+    fprintf(fp, "Finish Compressed Prefix Sum calculation\n\n");
+    printf("Plain prefix sum average elapsed time: %d (usec), std %f\n",
+            plain_total / num_iters, calculate_standard_deviation(plain_usecs, num_iters));
+    fprintf(fp, "Plain prefix sum average elapsed time: %d (usec), std %f\n",
+            plain_total / num_iters, calculate_standard_deviation(plain_usecs, num_iters));
+    printf("Compressed prefix sum average elapsed time: %d (usec), std %f\n",
+            comp_total / num_iters, calculate_standard_deviation(comp_usecs, num_iters));
+    fprintf(fp, "Compressed prefix sum average elapsed time: %d (usec), std %f\n",
+            comp_total / num_iters, calculate_standard_deviation(comp_usecs, num_iters));
+    printf("Memory: plain %ld bytes, compressed %ld bytes, ratio %.2fx (blocks with 1/2/4/8-byte deltas: %ld/%ld/%ld/%ld)\n",
+            plain_bytes, comp_bytes, (double) plain_bytes / comp_bytes,
+            width_counts[1], width_counts[2], width_counts[4], width_counts[8]);
+    fprintf(fp, "Memory: plain %ld bytes, compressed %ld bytes, ratio %.2fx (blocks with 1/2/4/8-byte deltas: %ld/%ld/%ld/%ld)\n",
+            plain_bytes, comp_bytes, (double) plain_bytes / comp_bytes,
+            width_counts[1], width_counts[2], width_counts[4], width_counts[8]);
+    printf("%d random reads: plain %d (usec), compressed %d (usec)\n",
+            NUM_READS, plain_read_usec, comp_read_usec);
+    fprintf(fp, "%d random reads: plain %d (usec), compressed %d (usec)\n",
+            NUM_READS, plain_read_usec, comp_read_usec);
+    printf("Full decode elapsed time: %d (usec)\n", decode_usec);
+    fprintf(fp, "Full decode elapsed time: %d (usec)\n", decode_usec);
+
+#ifdef PRINT_PREFIXSUM
+    fprintf(fp, "\nInputs:");
+    for (i = 0; i < num_elems; i++) {
+        fprintf(fp, " %d:%d", i, data[i]);
+    }
+    fprintf(fp, "\n\nPrefix Sums:");
+    for (i = 0; i < num_elems; i++) {
+        fprintf(fp, " %d:%ld", i, compressed_get(&cp, i));
+    }
+    fprintf(fp, "\n");
+#endif // #ifdef PRINT_PREFIXSUM
+
+#ifdef VERIFY
+    if (checksum_plain != checksum_comp) {
+        printf("Wrong compressed prefix sum implementation: random read checksum %ld, expected %ld\n",
+                checksum_comp, checksum_plain);
+        exit(-1);
+    }
+    // prefix_sums holds the decoded values, check them against the inputs
+    long verify_sum = 0;
+    for (i = 0; i < num_elems; i++) {
+        verify_sum += data[i];
+        if (verify_sum != prefix_sums[i] || verify_sum != compressed_get(&cp, i)) {
+            printf("Wrong compressed prefix sum implementation: error at position %d, true prefix sum: %ld, decoded prefix sum: %ld, random access: %ld\n",
+                    i, verify_sum, prefix_sums[i], compressed_get(&cp, i));
+            exit(-1);
+        }
+    }
+#endif // #ifdef VERIFY
+
+    // free the allocated memory
+    free(starts);
+    free(ends);
+    free(cp.bases);
+    free(cp.offsets);
+    free(cp.widths);
+    free(cp.payload);
+    free(data);
+    free(prefix_sums);
+    free(tmp_sums);
+    scan_ctx_destroy(ctx);
+    free(tmp_bytes);
+    free(reads);
+    free(plain_usecs);
+    free(comp_usecs);
+
+    fclose(fp);
+
+    return 0;
+}
@@ -0,0 +1,491 @@
+/*
+ * prefixsum_fenwick.c
+ *
+ * Description: Updatable prefix sums for a sequence of randomly generated
+ * integers using a Fenwick (binary indexed) tree built in parallel with
+ * OpenMP. Point updates and prefix/range queries cost O(log N) instead of
+ * the O(N) rescan done by prefixsum_seq.c/prefixsum_omp.c.
+ *
+ * Procedure:
+ * 1. All the threads generate num_elems random integers (in parallel OpenMP
+ *    region);
+ * 2. The prefix sums are computed with the chunked parallel scan of
+ *    prefixsum_omp.c, and every tree node tree[i] is derived from them as
+ *    prefix(i) - prefix(i - lowbit(i)) (in parallel OpenMP region), so the
+ *    build is O(N) and embarrassingly parallel.
+ * 3. For every update batch size, a batch of random point updates is applied
+ *    to the tree (tree nodes are updated with atomic adds, so a batch can be
+ *    applied by all the threads at once) followed by a batch of random range
+ *    queries. The same work is timed against the full rescan approach:
+ *    update data, rescan all the elements, then answer the queries.
+ * 4. Readers may query the tree while a writer applies updates. The writer
+ *    brackets every batch with a sequence counter (odd while a batch is in
+ *    flight); a reader retries its query until it observes the same even
+ *    counter before and after, so readers never take a lock nor block the
+ *    writer and always see a fully applied batch.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <omp.h>
+
+#include "prefixsum.h"
+
+#define MAX_INT 2147483647
+#define NUM_QUERIES 1024        // range queries after every update batch
+#define NUM_BATCH_SIZES 6
+#define CONCURRENT_BATCHES 256  // writer batches during the concurrent test
+//#define PRINT_PREFIXSUM
+#define VERIFY
+
+// usec: calculate the time interval in microseconds
+inline suseconds_t usec(struct timeval start, struct timeval end)
+{
+  return ((double) (((end.tv_sec * 1000000 + end.tv_usec) -
+                     (start.tv_sec * 1000000 + start.tv_usec))));
+}
+
+double calculate_standard_deviation(suseconds_t *data, int n) {
+    double mean = 0.0;
+    double variance = 0.0;
+    double std_dev = 0.0;
+
+    for (int i = 0; i < n; i++) {
+        mean += (double)data[i];
+    }
+    mean /= n;
+
+    for (int i = 0; i < n; i++) {
+        variance += (data[i] - mean) * (data[i] - mean);
+    }
+    variance /= n;
+
+    std_dev = sqrt(variance);
+
+    return std_dev;
+}
+
+// Fenwick tree over num_elems elements. tree is 1-indexed: tree[j] holds the
+// sum of data[j - lowbit(j) .. j - 1].
+typedef struct {
+    long *tree;
+    int num_elems;
+    unsigned long seq;  // sequence counter, odd while a batch is in flight
+} fenwick_t;
+
+#define LOWBIT(j) ((j) & -(j))
+
+// fenwick_build: derive every node from the prefix sums in parallel
+void fenwick_build(fenwick_t *fw, long *prefix_sums)
+{
+    int n = fw->num_elems;
+    long *tree = fw->tree;
+    int j;
+
+    tree[0] = 0;
+    #pragma omp parallel for schedule(static)
+    for (j = 1; j <= n; j++) {
+        int lo = j - LOWBIT(j);
+        tree[j] = prefix_sums[j-1] - (lo > 0 ? prefix_sums[lo-1] : 0);
+    }
+    fw->seq = 0;
+}
+
+// fenwick_add: data[idx] += delta, safe against concurrent fenwick_add calls
+static inline void fenwick_add(fenwick_t *fw, int idx, long delta)
+{
+    int j;
+    for (j = idx + 1; j <= fw->num_elems; j += LOWBIT(j))
+        __atomic_fetch_add(&fw->tree[j], delta, __ATOMIC_RELAXED);
+}
+
+// fenwick_prefix: sum of data[0..idx], no consistency guarantee against
+// in-flight batches
+static inline long fenwick_prefix(fenwick_t *fw, int idx)
+{
+    long sum = 0;
+    int j;
+    for (j = idx + 1; j > 0; j -= LOWBIT(j))
+        sum += __atomic_load_n(&fw->tree[j], __ATOMIC_RELAXED);
+    return sum;
+}
+
+// fenwick_range: sum of data[l..r]
+static inline long fenwick_range(fenwick_t *fw, int l, int r)
+{
+    return fenwick_prefix(fw, r) - (l > 0 ? fenwick_prefix(fw, l - 1) : 0);
+}
+
+// fenwick_batch_begin/end: bracket a batch of updates for concurrent readers
+// (only one writer batch may be in flight at a time)
+static inline void fenwick_batch_begin(fenwick_t *fw)
+{
+    unsigned long seq = __atomic_load_n(&fw->seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&fw->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void fenwick_batch_end(fenwick_t *fw)
+{
+    unsigned long seq = __atomic_load_n(&fw->seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&fw->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+// fenwick_add_batch: apply num_updates point updates with the whole thread
+// team; small batches are applied by the calling thread only
+void fenwick_add_batch(fenwick_t *fw, int *idxs, long *deltas, int num_updates)
+{
+    int u;
+
+    fenwick_batch_begin(fw);
+    #pragma omp parallel for schedule(static) if(num_updates >= 4096)
+    for (u = 0; u < num_updates; u++)
+        fenwick_add(fw, idxs[u], deltas[u]);
+    fenwick_batch_end(fw);
+}
+
+// fenwick_range_snapshot: lock-free reader path, returns a range sum that
+// reflects only fully applied batches; *retries counts the discarded reads
+static inline long fenwick_range_snapshot(fenwick_t *fw, int l, int r,
+                                          long *retries)
+{
+    unsigned long seq_before, seq_after;
+    long sum;
+
+    for (;;) {
+        seq_before = __atomic_load_n(&fw->seq, __ATOMIC_ACQUIRE);
+        if (seq_before & 1)
+            continue;   // batch in flight, nothing read yet
+        sum = fenwick_range(fw, l, r);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        seq_after = __atomic_load_n(&fw->seq, __ATOMIC_RELAXED);
+        if (seq_before == seq_after)
+            return sum;
+        (*retries)++;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int num_elems = 0;
+    int num_iters = 0;
+    int num_threads = 0;
+
+    int *data = NULL;
+    long *prefix_sums = NULL;
+    scan_ctx_t *ctx = NULL;
+    fenwick_t fw;
+
+    struct timeval start_time, end_time;  // for gettimeofday to calculate timing
+
+    char filename[256] = "prefixsum_fenwick_";
+    FILE *fp = NULL;
+
+    if (argc < 4) {
+        printf("Usage: %s [num_elems] [num_iters] [num_threads]\n", argv[0]);
+        printf("    - num_elems:  number of elements\n");
+        printf("    - num_iters: number of iterations per update batch size\n");
+        printf("    - num_threads: number of threads\n");
+        exit(-1);
+    }
+
+    num_elems = atoi(argv[1]);
+    num_iters = atoi(argv[2]);
+    num_threads = atoi(argv[3]);
+
+    if (num_threads < 1) {
+        printf("Number of threads should be more than one!\n");
+        exit(-1);
+    }
+    if (num_elems < 1 || num_iters < 1) {
+        printf("Number of elements and iterations should be positive!\n");
+        exit(-1);
+    }
+
+    strcat(filename, argv[1]);
+    strcat(filename, "elems_");
+    strcat(filename, argv[2]);
+    strcat(filename, "iters_");
+    strcat(filename, argv[3]);
+    strcat(filename, "threads.txt");
+
+    fp = fopen(filename, "w");
+    if (fp) {
+        printf("Command line: %s %d %d %d\n",
+                argv[0], num_elems, num_iters, num_threads);
+        printf("Stats file: %s\n\n", filename);
+        fprintf(fp, "Command line: %s %d %d %d\n",
+                argv[0], num_elems, num_iters, num_threads);
+        fprintf(fp, "Stats file: %s\n\n", filename);
+    } else {
+        printf("ERROR: can't open the file %s!\n", filename);
+        exit(-1);
+    }
+
+    // data partition and allocation
+    int num_elems_mean = num_elems / num_threads;
+    int num_elems_remain = num_elems % num_threads;
+    // starting and ending IDs of data partition for each thread
+    int *starts;
+    int *ends;
+    starts = (int *) malloc(sizeof(int) * num_threads);
+    ends = (int *) malloc(sizeof(int) * num_threads);
+    int id;
+    for (id = 0; id < num_threads; id++) {
+        if (id < num_elems_remain) {
+            starts[id] = id * (num_elems_mean + 1);
+            ends[id] = starts[id] + (num_elems_mean + 1);
+        } else {
+            starts[id] = id * num_elems_mean + num_elems_remain;
+            ends[id] = starts[id] + num_elems_mean;
+        }
+    }
+
+    // update batch sizes, from single point updates up to a tenth of the array
+    int batch_sizes[NUM_BATCH_SIZES] = {1, 16, 256, 4096, 65536, 1048576};
+    int max_batch = 1;
+    int b;
+    for (b = 0; b < NUM_BATCH_SIZES; b++) {
+        if (batch_sizes[b] > num_elems / 10 && b > 0)
+            batch_sizes[b] = 0;
+        else if (batch_sizes[b] > max_batch)
+            max_batch = batch_sizes[b];
+    }
+
+    // Memory allocation
+    data = (int *) malloc(sizeof(int) * num_elems);
+    prefix_sums = (long *) malloc(sizeof(long) * num_elems);
+    ctx = scan_ctx_create(num_threads);
+    fw.tree = (long *) malloc(sizeof(long) * (num_elems + 1));
+    fw.num_elems = num_elems;
+    int *update_idxs = (int *) malloc(sizeof(int) * max_batch);
+    long *update_deltas = (long *) malloc(sizeof(long) * max_batch);
+    int *query_ls = (int *) malloc(sizeof(int) * NUM_QUERIES);
+    int *query_rs = (int *) malloc(sizeof(int) * NUM_QUERIES);
+    suseconds_t *fenwick_usecs = (suseconds_t *) malloc(sizeof(suseconds_t) * num_iters);
+    suseconds_t *rescan_usecs = (suseconds_t *) malloc(sizeof(suseconds_t) * num_iters);
+    if (data == NULL || prefix_sums == NULL || ctx == NULL ||
+        fw.tree == NULL || update_idxs == NULL || update_deltas == NULL ||
+        query_ls == NULL || query_rs == NULL ||
+        fenwick_usecs == NULL || rescan_usecs == NULL) {
+        printf("Failed in malloc()\n");
+        printf(" - data: %p\n", data);
+        printf(" - prefix_sums: %p\n", prefix_sums);
+        printf(" - ctx: %p\n", ctx);
+        printf(" - tree: %p\n", fw.tree);
+        free(data);
+        free(prefix_sums);
+        scan_ctx_destroy(ctx);
+        free(fw.tree);
+        free(update_idxs);
+        free(update_deltas);
+        free(query_ls);
+        free(query_rs);
+        free(fenwick_usecs);
+        free(rescan_usecs);
+        exit(-2);
+    }
+
+    // set number of threads
+    omp_set_num_threads(num_threads);
+
+    // Generate random ints in parallel
+    int K = MAX_INT / num_elems;
+
+    #pragma omp parallel shared(starts, ends, K, data)
+    {
+        // get the local thread ID
+        int tid = omp_get_thread_num();
+        srand(tid + time(NULL));  // Seed rand function
+
+        int start = starts[tid];
+        int end = ends[tid];
+
+        int i;
+        for (i = start; i < end; i++) {
+            data[i] = rand() % K;
+        }
+    }
+
+    printf("Start ...\n");
+    fprintf(fp, "Start ...\n");
+
+    // Build: one full scan plus the parallel node derivation
+    suseconds_t scan_usec, build_usec;
+    gettimeofday(&start_time, NULL);
+    scan_i32_i64(ctx, data, prefix_sums, num_elems);
+    gettimeofday(&end_time, NULL);
+    scan_usec = usec(start_time, end_time);
+
+    gettimeofday(&start_time, NULL);
+    fenwick_build(&fw, prefix_sums);
+    gettimeofday(&end_time, NULL);
+    build_usec = usec(start_time, end_time);
+
+    printf("full scan elapsed time: %d (usec)\n", scan_usec);
+    printf("tree build elapsed time: %d (usec) on top of the scan\n\n", build_usec);
+    fprintf(fp, "full scan elapsed time: %d (usec)\n", scan_usec);
+    fprintf(fp, "tree build elapsed time: %d (usec) on top of the scan\n\n", build_usec);
+
+    // Updates followed by range queries: Fenwick tree vs full rescan
+    long checksum_fenwick = 0, checksum_rescan = 0;
+    int iter, u, q;
+    for (b = 0; b < NUM_BATCH_SIZES; b++) {
+        int num_updates = batch_sizes[b];
+        if (num_updates == 0)
+            continue;
+
+        suseconds_t fenwick_total = 0, rescan_total = 0;
+        for (iter = 0; iter < num_iters; iter++) {
+            for (u = 0; u < num_updates; u++) {
+                update_idxs[u] = rand() % num_elems;
+                update_deltas[u] = rand() % K - K / 2;
+            }
+            for (q = 0; q < NUM_QUERIES; q++) {
+                int l = rand() % num_elems;
+                int r = rand() % num_elems;
+                query_ls[q] = l < r ? l : r;
+                query_rs[q] = l < r ? r : l;
+            }
+
+            gettimeofday(&start_time, NULL);
+            fenwick_add_batch(&fw, update_idxs, update_deltas, num_updates);
+            for (q = 0; q < NUM_QUERIES; q++)
+                checksum_fenwick += fenwick_range(&fw, query_ls[q], query_rs[q]);
+            gettimeofday(&end_time, NULL);
+            fenwick_usecs[iter] = usec(start_time, end_time);
+            fenwick_total += fenwick_usecs[iter];
+
+            gettimeofday(&start_time, NULL);
+            for (u = 0; u < num_updates; u++)
+                data[update_idxs[u]] += update_deltas[u];
+            scan_i32_i64(ctx, data, prefix_sums, num_elems);
+            for (q = 0; q < NUM_QUERIES; q++) {
+                int l = query_ls[q];
+                checksum_rescan += prefix_sums[query_rs[q]] -
+                                   (l > 0 ? prefix_sums[l-1] : 0);
+            }
+            gettimeofday(&end_time, NULL);
+            rescan_usecs[iter] = usec(start_time, end_time);
+            rescan_total += rescan_usecs[iter];
+        }
+
+        suseconds_t fenwick_avg = fenwick_total / num_iters;
+        suseconds_t rescan_avg = rescan_total / num_iters;
+        double speedup = fenwick_avg > 0 ? (double) rescan_avg / fenwick_avg : 0.0;
+        printf("batch of %d updates + %d queries: fenwick %d (usec, std %f), rescan %d (usec, std %f), speedup %.2f\n",
+                num_updates, NUM_QUERIES,
+                fenwick_avg, calculate_standard_deviation(fenwick_usecs, num_iters),
+                rescan_avg, calculate_standard_deviation(rescan_usecs, num_iters),
+                speedup);
+        fprintf(fp, "batch of %d updates + %d queries: fenwick %d (usec, std %f), rescan %d (usec, std %f), speedup %.2f\n",
+                num_updates, NUM_QUERIES,
+                fenwick_avg, calculate_standard_deviation(fenwick_usecs, num_iters),
+                rescan_avg, calculate_standard_deviation(rescan_usecs, num_iters),
+                speedup);
+    }
+
+    if (checksum_fenwick != checksum_rescan) {
+        printf("Wrong Fenwick tree implementation: query checksum %ld, rescan checksum %ld\n",
+                checksum_fenwick, checksum_rescan);
+        exit(-1);
+    }
+
+    // Concurrent readers: thread 0 applies single-threaded batches while the
+    // other threads keep querying through the lock-free snapshot path
+    if (num_threads > 1) {
+        int num_updates = batch_sizes[2] > 0 ? batch_sizes[2] : 1;
+        long total_reads = 0, total_retries = 0, read_checksum = 0;
+        int writer_done = 0;
+
+        gettimeofday(&start_time, NULL);
+        #pragma omp parallel shared(fw, writer_done) reduction(+:total_reads, total_retries, read_checksum)
+        {
+            int tid = omp_get_thread_num();
+            unsigned int seed = tid + time(NULL);
+            if (tid == 0) {
+                int bb, uu;
+                for (bb = 0; bb < CONCURRENT_BATCHES; bb++) {
+                    fenwick_batch_begin(&fw);
+                    for (uu = 0; uu < num_updates; uu++) {
+                        int idx = rand_r(&seed) % num_elems;
+                        int delta = rand_r(&seed) % K - K / 2;
+                        fenwick_add(&fw, idx, delta);
+                        data[idx] += delta;
+                    }
+                    fenwick_batch_end(&fw);
+                }
+                __atomic_store_n(&writer_done, 1, __ATOMIC_RELEASE);
+            } else {
+                while (!__atomic_load_n(&writer_done, __ATOMIC_ACQUIRE)) {
+                    int l = rand_r(&seed) % num_elems;
+                    int r = rand_r(&seed) % num_elems;
+                    if (l > r) { int t = l; l = r; r = t; }
+                    read_checksum += fenwick_range_snapshot(&fw, l, r, &total_retries);
+                    total_reads++;
+                }
+            }
+        }
+        gettimeofday(&end_time, NULL);
+
+        suseconds_t concurrent_usec = usec(start_time, end_time);
+        printf("\nconcurrent: %d batches of %d updates in %d (usec), %ld snapshot reads by %d readers, %ld retries, read checksum %ld\n",
+                CONCURRENT_BATCHES, num_updates, concurrent_usec,
+                total_reads, num_threads - 1, total_retries, read_checksum);
+        fprintf(fp, "\nconcurrent: %d batches of %d updates in %d (usec), %ld snapshot reads by %d readers, %ld retries, read checksum %ld\n",
+                CONCURRENT_BATCHES, num_updates, concurrent_usec,
+                total_reads, num_threads - 1, total_retries, read_checksum);
+    }
+
+    printf("Finish Fenwick Tree Prefix Sum benchmark\n\n");
+    fprintf(fp, "Finish Fenwick Tree Prefix Sum benchmark\n\n");
+
+    int i;
+#ifdef PRINT_PREFIXSUM
+    fprintf(fp, "\nInputs:");
+    for (i = 0; i < num_elems; i++) {
+        fprintf(fp, " %d:%d", i, data[i]);
+    }
+    fprintf(fp, "\n\nPrefix Sums:");
+    for (i = 0; i < num_elems; i++) {
+        fprintf(fp, " %d:%ld", i, fenwick_prefix(&fw, i));
+    }
+    fprintf(fp, "\n");
+#endif // #ifdef PRINT_PREFIXSUM
+
+#ifdef VERIFY
+    // data now holds every update, so a fresh scan is the ground truth
+    scan_i32_i64(ctx, data, prefix_sums, num_elems);
+    for (i = 0; i < num_elems; i++) {
+        long fenwick_sum = fenwick_prefix(&fw, i);
+        if (fenwick_sum != prefix_sums[i]) {
+            printf("Wrong Fenwick tree implementation: error at position %d, true prefix sum: %ld, computed prefix sum: %ld\n",
+                    i, prefix_sums[i], fenwick_sum);
+            exit(-1);
+        }
+    }
+#endif // #ifdef VERIFY
+
+    // free the allocated memory
+    free(starts);
+    free(ends);
+    free(data);
+    free(prefix_sums);
+    scan_ctx_destroy(ctx);
+    free(fw.tree);
+    free(update_idxs);
+    free(update_deltas);
+    free(query_ls);
+    free(query_rs);
+    free(fenwick_usecs);
+    free(rescan_usecs);
+
+    fclose(fp);
+
+    return 0;
+}
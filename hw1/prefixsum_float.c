@@ -0,0 +1,514 @@
+/*
+ * prefixsum_float.c
+ *
+ * Description: Parallel implementation of Prefix Sum program for a sequence
+ * of randomly generated floating-point numbers using OpenMP, with selectable
+ * accuracy. Built as prefixsum_float.exe for float and, with -DUSE_DOUBLE, as
+ * prefixsum_double.exe for double.
+ *
+ * Procedure:
+ * 1. All the threads generate num_elems random numbers in [0, 1) with full
+ *    mantissas (in parallel OpenMP region), and the reference prefix sums
+ *    are computed in long double;
+ * 2. Every accuracy mode is run on the same thread partition as
+ *    prefixsum_omp.c:
+ *    - naive: each thread scans its partition with an in-register SIMD scan
+ *      (log2(lanes) shift-and-add steps per vector), the partition totals are
+ *      scanned, and each thread adds its base, as in prefixsum_omp.c;
+ *    - kahan: each thread computes its compensated partition total (one
+ *      compensated accumulator per SIMD lane), the totals are summed with
+ *      compensation, and each thread runs a Kahan-compensated scan of its
+ *      partition seeded with its compensated base: the vectors are scanned
+ *      in register and the compensated running sum is updated once per
+ *      vector;
+ *    - pairwise: each thread computes a pairwise total of its partition, the
+ *      totals are scanned, and each thread scans its partition recursively:
+ *      the left half first, then the right half with the left half total
+ *      added to its base, down to PAIRWISE_BLOCK elements that are scanned
+ *      with the SIMD scan. Every output is its base plus a short local sum,
+ *      and every base is a sum of O(log N) pairwise sums.
+ * 3. Throughput and the maximum and last-element relative errors against
+ *    the long double reference are reported for every mode.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <omp.h>
+
+//#define PRINT_PREFIXSUM
+#define PAIRWISE_BLOCK 64       // elements scanned directly by the pairwise mode
+#define NUM_MODES 3
+
+#ifdef USE_DOUBLE
+typedef double real_t;
+typedef double vec_t __attribute__((vector_size(16)));
+typedef long mask_t __attribute__((vector_size(16)));
+#define VEC_LANES 2
+#define REAL_NAME "double"
+#else
+typedef float real_t;
+typedef float vec_t __attribute__((vector_size(16)));
+typedef int mask_t __attribute__((vector_size(16)));
+#define VEC_LANES 4
+#define REAL_NAME "float"
+#endif
+
+// usec: calculate the time interval in microseconds
+inline suseconds_t usec(struct timeval start, struct timeval end)
+{
+  return ((double) (((end.tv_sec * 1000000 + end.tv_usec) -
+                     (start.tv_sec * 1000000 + start.tv_usec))));
+}
+
+double calculate_standard_deviation(suseconds_t *data, int n) {
+    double mean = 0.0;
+    double variance = 0.0;
+    double std_dev = 0.0;
+
+    for (int i = 0; i < n; i++) {
+        mean += (double)data[i];
+    }
+    mean /= n;
+
+    for (int i = 0; i < n; i++) {
+        variance += (data[i] - mean) * (data[i] - mean);
+    }
+    variance /= n;
+
+    std_dev = sqrt(variance);
+
+    return std_dev;
+}
+
+// vec_scan: inclusive scan of the lanes of v
+static inline vec_t vec_scan(vec_t v)
+{
+    vec_t zero = {0};
+#ifdef USE_DOUBLE
+    v += __builtin_shuffle(zero, v, (mask_t) {0, 2});
+#else
+    v += __builtin_shuffle(zero, v, (mask_t) {0, 4, 5, 6});
+    v += __builtin_shuffle(zero, v, (mask_t) {0, 1, 4, 5});
+#endif
+    return v;
+}
+
+// scan_simd: out[i] = base + in[0] + ... + in[i] for a short run, the local
+// sum starts from zero so that its error does not depend on base; returns
+// the local total
+static inline real_t scan_simd(const real_t *in, real_t *out, long n,
+                               real_t base)
+{
+    vec_t vlocal = {0};
+    long i = 0;
+    for (; i + VEC_LANES <= n; i += VEC_LANES) {
+        vec_t v;
+        memcpy(&v, in + i, sizeof(v));
+        v = vec_scan(v) + vlocal;
+        vlocal = (vec_t) {0} + v[VEC_LANES - 1];
+        v += base;
+        memcpy(out + i, &v, sizeof(v));
+    }
+    real_t local = vlocal[0];
+    for (; i < n; i++) {
+        local += in[i];
+        out[i] = base + local;
+    }
+    return local;
+}
+
+// random_real: uniform in [0, 1) with every mantissa bit random, from two
+// 31-bit rand_r draws (one draw alone leaves the low bits of a double zero,
+// and the sums of such inputs are exact)
+static inline real_t random_real(unsigned int *seed)
+{
+    unsigned long bits = ((unsigned long) rand_r(seed) << 31) | rand_r(seed);
+#ifdef USE_DOUBLE
+    return (bits >> 9) * 0x1.0p-53;
+#else
+    return (bits >> 38) * 0x1.0p-24;
+#endif
+}
+
+// sum_simd: sum of a short run, one accumulator per lane
+static inline real_t sum_simd(const real_t *in, long n)
+{
+    vec_t vsum = {0};
+    long i = 0;
+    int lane;
+    for (; i + VEC_LANES <= n; i += VEC_LANES) {
+        vec_t v;
+        memcpy(&v, in + i, sizeof(v));
+        vsum += v;
+    }
+    real_t sum = 0;
+    for (lane = 0; lane < VEC_LANES; lane++)
+        sum += vsum[lane];
+    for (; i < n; i++)
+        sum += in[i];
+    return sum;
+}
+
+// kahan_sum: compensated sum with one compensated accumulator per lane,
+// returns the sum and stores the compensation (to be subtracted) in *comp
+static real_t kahan_sum(const real_t *in, long n, real_t *comp)
+{
+    vec_t vs = {0}, vc = {0};
+    long i = 0;
+    int lane;
+    for (; i + VEC_LANES <= n; i += VEC_LANES) {
+        vec_t v, y, t;
+        memcpy(&v, in + i, sizeof(v));
+        y = v - vc;
+        t = vs + y;
+        vc = (t - vs) - y;
+        vs = t;
+    }
+    real_t s = 0, c = 0;
+    for (lane = 0; lane < VEC_LANES; lane++) {
+        real_t y = vs[lane] - c;
+        real_t t = s + y;
+        c = (t - s) - y;
+        s = t;
+        y = -vc[lane] - c;
+        t = s + y;
+        c = (t - s) - y;
+        s = t;
+    }
+    for (; i < n; i++) {
+        real_t y = in[i] - c;
+        real_t t = s + y;
+        c = (t - s) - y;
+        s = t;
+    }
+    *comp = c;
+    return s;
+}
+
+// kahan_scan: compensated scan seeded with the running sum s and its
+// compensation c. Every vector is scanned in register, each lane of the
+// output is s plus its lane prefix with the compensation subtracted, and the
+// compensated running sum takes one Kahan step per vector with the vector
+// total, so the serial chain is per vector instead of per element
+static void kahan_scan(const real_t *in, real_t *out, long n, real_t s,
+                       real_t c)
+{
+    vec_t zero = {0};
+    long i = 0;
+    for (; i + VEC_LANES <= n; i += VEC_LANES) {
+        vec_t v, t;
+        memcpy(&v, in + i, sizeof(v));
+        v = vec_scan(v);
+        t = (zero + s) + (v - c);
+        memcpy(out + i, &t, sizeof(t));
+        real_t y = v[VEC_LANES - 1] - c;
+        real_t u = s + y;
+        c = (u - s) - y;
+        s = u;
+    }
+    for (; i < n; i++) {
+        real_t y = in[i] - c;
+        real_t t = s + y;
+        c = (t - s) - y;
+        s = t;
+        out[i] = s;
+    }
+}
+
+// pairwise_split: left half size, a multiple of PAIRWISE_BLOCK
+static inline long pairwise_split(long n)
+{
+    return (n / 2 + PAIRWISE_BLOCK - 1) / PAIRWISE_BLOCK * PAIRWISE_BLOCK;
+}
+
+// pairwise_sum: pairwise total with the same tree as pairwise_scan
+static real_t pairwise_sum(const real_t *in, long n)
+{
+    if (n <= PAIRWISE_BLOCK)
+        return sum_simd(in, n);
+    long h = pairwise_split(n);
+    return pairwise_sum(in, h) + pairwise_sum(in + h, n - h);
+}
+
+// pairwise_scan: out[i] = base + in[0] + ... + in[i], returns the pairwise
+// total of in
+static real_t pairwise_scan(const real_t *in, real_t *out, long n, real_t base)
+{
+    if (n <= PAIRWISE_BLOCK)
+        return scan_simd(in, out, n, base);
+    long h = pairwise_split(n);
+    real_t left = pairwise_scan(in, out, h, base);
+    real_t right = pairwise_scan(in + h, out + h, n - h, base + left);
+    return left + right;
+}
+
+// parallel_scan: scan data into prefix_sums with the given accuracy mode;
+// tmp_sums and tmp_comps hold one entry per thread
+void parallel_scan(int mode, real_t *data, real_t *prefix_sums, int *starts,
+                   int *ends, real_t *tmp_sums, real_t *tmp_comps,
+                   int num_threads)
+{
+    #pragma omp parallel shared(starts, ends, data, prefix_sums, tmp_sums, tmp_comps)
+    {
+        int tid = omp_get_thread_num(); // get the local thread ID
+        int start = starts[tid];
+        int end = ends[tid];
+        long n = end - start;
+
+        // 1. partition totals (the naive mode scans right away)
+        if (mode == 0) {
+            tmp_sums[tid] = scan_simd(data + start, prefix_sums + start, n, 0);
+        } else if (mode == 1) {
+            tmp_sums[tid] = kahan_sum(data + start, n, &tmp_comps[tid]);
+        } else {
+            tmp_sums[tid] = pairwise_sum(data + start, n);
+        }
+        #pragma omp barrier
+
+        // 2. exclusive scan of the partition totals
+        #pragma omp single
+        {
+            int t;
+            if (mode == 1) {
+                real_t s = 0, c = 0;
+                for (t = 0; t < num_threads; t++) {
+                    real_t total = tmp_sums[t], total_comp = tmp_comps[t];
+                    tmp_sums[t] = s;
+                    tmp_comps[t] = c;
+                    real_t y = total - c;
+                    real_t u = s + y;
+                    c = (u - s) - y;
+                    s = u;
+                    y = -total_comp - c;
+                    u = s + y;
+                    c = (u - s) - y;
+                    s = u;
+                }
+            } else {
+                real_t carry = 0;
+                for (t = 0; t < num_threads; t++) {
+                    real_t total = tmp_sums[t];
+                    tmp_sums[t] = carry;
+                    carry += total;
+                }
+            }
+        }
+
+        // 3. scan (or add the base) with the partition base
+        real_t base = tmp_sums[tid];
+        int i;
+        if (mode == 0) {
+            if (base != 0)
+                for (i = start; i < end; i++)
+                    prefix_sums[i] += base;
+        } else if (mode == 1) {
+            kahan_scan(data + start, prefix_sums + start, n, base, tmp_comps[tid]);
+        } else {
+            pairwise_scan(data + start, prefix_sums + start, n, base);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int num_elems = 0;
+    int num_iters = 0;
+    int num_threads = 0;
+
+    real_t *data = NULL;
+    real_t *prefix_sums = NULL;
+    real_t *tmp_sums = NULL;
+    real_t *tmp_comps = NULL;
+    long double *reference = NULL;
+
+    struct timeval start_time, end_time;  // for gettimeofday to calculate timing
+
+    char filename[256] = "prefixsum_" REAL_NAME "_";
+    FILE *fp = NULL;
+
+    if (argc < 4) {
+        printf("Usage: %s [num_elems] [num_iters] [num_threads]\n", argv[0]);
+        printf("    - num_elems:  number of elements\n");
+        printf("    - num_iters: number of iterations\n");
+        printf("    - num_threads: number of threads\n");
+        exit(-1);
+    }
+
+    num_elems = atoi(argv[1]);
+    num_iters = atoi(argv[2]);
+    num_threads = atoi(argv[3]);
+
+    if (num_threads < 1) {
+        printf("Number of threads should be more than one!\n");
+        exit(-1);
+    }
+    if (num_elems < 1 || num_iters < 1) {
+        printf("Number of elements and iterations should be positive!\n");
+        exit(-1);
+    }
+
+    strcat(filename, argv[1]);
+    strcat(filename, "elems_");
+    strcat(filename, argv[2]);
+    strcat(filename, "iters_");
+    strcat(filename, argv[3]);
+    strcat(filename, "threads.txt");
+
+    fp = fopen(filename, "w");
+    if (fp) {
+        printf("Command line: %s %d %d %d\n",
+                argv[0], num_elems, num_iters, num_threads);
+        printf("Stats file: %s\n\n", filename);
+        fprintf(fp, "Command line: %s %d %d %d\n",
+                argv[0], num_elems, num_iters, num_threads);
+        fprintf(fp, "Stats file: %s\n\n", filename);
+    } else {
+        printf("ERROR: can't open the file %s!\n", filename);
+        exit(-1);
+    }
+
+    // data partition and allocation
+    int num_elems_mean = num_elems / num_threads;
+    int num_elems_remain = num_elems % num_threads;
+    // starting and ending IDs of data partition for each thread
+    int *starts;
+    int *ends;
+    starts = (int *) malloc(sizeof(int) * num_threads);
+    ends = (int *) malloc(sizeof(int) * num_threads);
+    int id;
+    for (id = 0; id < num_threads; id++) {
+        if (id < num_elems_remain) {
+            starts[id] = id * (num_elems_mean + 1);
+            ends[id] = starts[id] + (num_elems_mean + 1);
+        } else {
+            starts[id] = id * num_elems_mean + num_elems_remain;
+            ends[id] = starts[id] + num_elems_mean;
+        }
+    }
+
+    // Memory allocation
+    data = (real_t *) malloc(sizeof(real_t) * num_elems);
+    prefix_sums = (real_t *) malloc(sizeof(real_t) * num_elems);
+    tmp_sums = (real_t *) malloc(sizeof(real_t) * num_threads);
+    tmp_comps = (real_t *) malloc(sizeof(real_t) * num_threads);
+    reference = (long double *) malloc(sizeof(long double) * num_elems);
+    suseconds_t *usecs = (suseconds_t *) malloc(sizeof(suseconds_t) * num_iters);
+    if (data == NULL || prefix_sums == NULL || tmp_sums == NULL ||
+        tmp_comps == NULL || reference == NULL || usecs == NULL) {
+        printf("Failed in malloc()\n");
+        printf(" - data: %p\n", data);
+        printf(" - prefix_sums: %p\n", prefix_sums);
+        printf(" - reference: %p\n", reference);
+        free(data);
+        free(prefix_sums);
+        free(tmp_sums);
+        free(tmp_comps);
+        free(reference);
+        free(usecs);
+        exit(-2);
+    }
+
+    // set number of threads
+    omp_set_num_threads(num_threads);
+
+    // Generate random numbers in [0, 1) in parallel
+    #pragma omp parallel shared(starts, ends, data)
+    {
+        // get the local thread ID
+        int tid = omp_get_thread_num();
+        unsigned int seed = tid + time(NULL);
+
+        int start = starts[tid];
+        int end = ends[tid];
+
+        int i;
+        for (i = start; i < end; i++) {
+            data[i] = random_real(&seed);
+        }
+    }
+
+    // long double reference
+    int i;
+    long double ref_sum = 0;
+    for (i = 0; i < num_elems; i++) {
+        ref_sum += data[i];
+        reference[i] = ref_sum;
+    }
+
+    printf("Start ...\n");
+    fprintf(fp, "Start ...\n");
+
+    const char *mode_names[NUM_MODES] = {"naive", "kahan", "pairwise"};
+    int mode, iter;
+    for (mode = 0; mode < NUM_MODES; mode++) {
+        suseconds_t total_usec = 0;
+        for (iter = 0; iter < num_iters; iter++) {
+            gettimeofday(&start_time, NULL);
+            parallel_scan(mode, data, prefix_sums, starts, ends,
+                          tmp_sums, tmp_comps, num_threads);
+            gettimeofday(&end_time, NULL);
+            usecs[iter] = usec(start_time, end_time);
+            total_usec += usecs[iter];
+        }
+
+        // relative error against the long double reference
+        double max_rel_err = 0.0;
+        #pragma omp parallel for reduction(max:max_rel_err)
+        for (i = 0; i < num_elems; i++) {
+            if (reference[i] != 0) {
+                double rel_err = fabsl((prefix_sums[i] - reference[i]) / reference[i]);
+                if (rel_err > max_rel_err)
+                    max_rel_err = rel_err;
+            }
+        }
+        long double last = reference[num_elems - 1];
+        double last_rel_err = last != 0 ?
+                fabsl((prefix_sums[num_elems - 1] - last) / last) : 0.0;
+
+        suseconds_t avg_usec = total_usec / num_iters;
+        double gbps = avg_usec > 0 ?
+                2.0 * sizeof(real_t) * num_elems / (avg_usec * 1e3) : 0.0;
+        printf("%s %s: %d (usec, std %f), %.2f GB/s, max rel err %.3e, last rel err %.3e\n",
+                REAL_NAME, mode_names[mode], avg_usec,
+                calculate_standard_deviation(usecs, num_iters), gbps,
+                max_rel_err, last_rel_err);
+        fprintf(fp, "%s %s: %d (usec, std %f), %.2f GB/s, max rel err %.3e, last rel err %.3e\n",
+                REAL_NAME, mode_names[mode], avg_usec,
+                calculate_standard_deviation(usecs, num_iters), gbps,
+                max_rel_err, last_rel_err);
+    }
+
+    printf("Finish OpenMP Parrallel Floating-Point Prefix Sum calculation\n\n");
+    fprintf(fp, "Finish OpenMP Parrallel Floating-Point Prefix Sum calculation\n\n");
+
+#ifdef PRINT_PREFIXSUM
+    fprintf(fp, "\nInputs:");
+    for (i = 0; i < num_elems; i++) {
+        fprintf(fp, " %d:%g", i, (double) data[i]);
+    }
+    fprintf(fp, "\n\nPrefix Sums:");
+    for (i = 0; i < num_elems; i++) {
+        fprintf(fp, " %d:%g", i, (double) prefix_sums[i]);
+    }
+    fprintf(fp, "\n");
+#endif // #ifdef PRINT_PREFIXSUM
+
+    // free the allocated memory
+    free(starts);
+    free(ends);
+    free(data);
+    free(prefix_sums);
+    free(tmp_sums);
+    free(tmp_comps);
+    free(reference);
+    free(usecs);
+
+    fclose(fp);
+
+    return 0;
+}
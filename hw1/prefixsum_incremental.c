@@ -0,0 +1,516 @@
+/*
+ * prefixsum_incremental.c
+ *
+ * Description: Incremental recomputation of the prefix sums of a sequence of
+ * randomly generated integers after contiguous range modifications, using
+ * OpenMP for the initial build and for full materialization.
+ *
+ * Procedure:
+ * 1. All the threads generate num_elems random integers (in parallel OpenMP
+ *    region);
+ * 2. The array is cut into blocks of BLOCK_SIZE elements. Each thread scans
+ *    its blocks and records the block totals next to prefix_sums, the block
+ *    totals are scanned to get the block bases, and each thread adds the
+ *    bases to its blocks (in parallel OpenMP region).
+ * 3. When data[l..r] changes, the prefix sums before l are still valid and
+ *    the ones after r all shift by the same delta. Only the dirty blocks
+ *    covering [l, r] are recomputed. The delta is recorded as a pending
+ *    offset for all the downstream blocks in a Fenwick tree over blocks
+ *    (range add in O(log num_blocks)), instead of touching their elements.
+ * 4. A read returns prefix_sums[i] plus the pending offset of its block. A
+ *    block is materialized (pending offset folded into its elements) before
+ *    it is recomputed, or on demand, so an edit of m elements costs
+ *    O(m + BLOCK_SIZE + log num_blocks) instead of O(N).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <omp.h>
+
+#include "prefixsum.h"
+
+#define MAX_INT 2147483647
+#define BLOCK_SIZE 4096         // elements per block
+#define NUM_EDIT_SIZES 5
+#define NUM_READS 1024          // random reads after every edit
+//#define PRINT_PREFIXSUM
+#define VERIFY
+
+// usec: calculate the time interval in microseconds
+inline suseconds_t usec(struct timeval start, struct timeval end)
+{
+  return ((double) (((end.tv_sec * 1000000 + end.tv_usec) -
+                     (start.tv_sec * 1000000 + start.tv_usec))));
+}
+
+double calculate_standard_deviation(suseconds_t *data, int n) {
+    double mean = 0.0;
+    double variance = 0.0;
+    double std_dev = 0.0;
+
+    for (int i = 0; i < n; i++) {
+        mean += (double)data[i];
+    }
+    mean /= n;
+
+    for (int i = 0; i < n; i++) {
+        variance += (data[i] - mean) * (data[i] - mean);
+    }
+    variance /= n;
+
+    std_dev = sqrt(variance);
+
+    return std_dev;
+}
+
+// Incrementally maintained prefix sums. Element i of block b is
+// prefix_sums[i] + pending(b), where pending(b) is the prefix sum of
+// pending_tree (a 1-indexed Fenwick tree over the per-block offset deltas).
+typedef struct {
+    long *prefix_sums;
+    long *block_totals;     // sum of data over each block
+    long *pending_tree;
+    int num_elems;
+    int num_blocks;
+} incremental_t;
+
+#define LOWBIT(j) ((j) & -(j))
+
+// pending_add: pending(b) += delta for all the blocks b >= first
+static inline void pending_add(incremental_t *inc, int first, long delta)
+{
+    int j;
+    for (j = first + 1; j <= inc->num_blocks; j += LOWBIT(j))
+        inc->pending_tree[j] += delta;
+}
+
+static inline long pending_get(incremental_t *inc, int b)
+{
+    long sum = 0;
+    int j;
+    for (j = b + 1; j > 0; j -= LOWBIT(j))
+        sum += inc->pending_tree[j];
+    return sum;
+}
+
+// incremental_build: full parallel build, clears every pending offset
+void incremental_build(incremental_t *inc, int *data)
+{
+    long *prefix_sums = inc->prefix_sums;
+    long *block_totals = inc->block_totals;
+    int num_elems = inc->num_elems;
+    int num_blocks = inc->num_blocks;
+    long *bases = inc->pending_tree + 1;    // reused as scratch before clearing
+    int b;
+
+    #pragma omp parallel shared(prefix_sums, block_totals, data, bases)
+    {
+        int i;
+        #pragma omp for schedule(static)
+        for (b = 0; b < num_blocks; b++) {
+            int start = b * BLOCK_SIZE;
+            int end = start + BLOCK_SIZE < num_elems ? start + BLOCK_SIZE : num_elems;
+            long sum = 0;
+            for (i = start; i < end; i++) {
+                sum += data[i];
+                prefix_sums[i] = sum;
+            }
+            block_totals[b] = sum;
+        }
+
+        #pragma omp single
+        {
+            long carry = 0;
+            int bb;
+            for (bb = 0; bb < num_blocks; bb++) {
+                bases[bb] = carry;
+                carry += block_totals[bb];
+            }
+        }
+
+        #pragma omp for schedule(static)
+        for (b = 1; b < num_blocks; b++) {
+            int start = b * BLOCK_SIZE;
+            int end = start + BLOCK_SIZE < num_elems ? start + BLOCK_SIZE : num_elems;
+            long base = bases[b];
+            for (i = start; i < end; i++)
+                prefix_sums[i] += base;
+        }
+    }
+    memset(inc->pending_tree, 0, sizeof(long) * (num_blocks + 1));
+}
+
+// incremental_materialize_block: fold the pending offset of block b into its
+// elements
+void incremental_materialize_block(incremental_t *inc, int b)
+{
+    long pending = pending_get(inc, b);
+    if (pending == 0)
+        return;
+
+    int start = b * BLOCK_SIZE;
+    int end = start + BLOCK_SIZE < inc->num_elems ? start + BLOCK_SIZE : inc->num_elems;
+    int i;
+    for (i = start; i < end; i++)
+        inc->prefix_sums[i] += pending;
+    pending_add(inc, b, -pending);
+    pending_add(inc, b + 1, pending);
+}
+
+// incremental_materialize_all: fold every pending offset (in parallel)
+void incremental_materialize_all(incremental_t *inc)
+{
+    int num_elems = inc->num_elems;
+    int num_blocks = inc->num_blocks;
+    long *pendings = (long *) malloc(sizeof(long) * num_blocks);
+    int b;
+
+    #pragma omp parallel for schedule(static)
+    for (b = 0; b < num_blocks; b++)
+        pendings[b] = pending_get(inc, b);
+
+    #pragma omp parallel for schedule(static)
+    for (b = 0; b < num_blocks; b++) {
+        int start = b * BLOCK_SIZE;
+        int end = start + BLOCK_SIZE < num_elems ? start + BLOCK_SIZE : num_elems;
+        long pending = pendings[b];
+        int i;
+        if (pending != 0)
+            for (i = start; i < end; i++)
+                inc->prefix_sums[i] += pending;
+    }
+    memset(inc->pending_tree, 0, sizeof(long) * (num_blocks + 1));
+    free(pendings);
+}
+
+// incremental_read: prefix sum of data[0..i]
+static inline long incremental_read(incremental_t *inc, int i)
+{
+    return inc->prefix_sums[i] + pending_get(inc, i / BLOCK_SIZE);
+}
+
+// incremental_update: data[l..r] = values[0..r-l], recompute only the dirty
+// blocks and push the resulting delta to the downstream blocks lazily
+void incremental_update(incremental_t *inc, int *data, int l, int r, int *values)
+{
+    int num_elems = inc->num_elems;
+    int first_block = l / BLOCK_SIZE;
+    int last_block = r / BLOCK_SIZE;
+    int b, i;
+
+    for (i = l; i <= r; i++)
+        data[i] = values[i - l];
+
+    // elements of the first dirty block before l are kept, make them absolute
+    incremental_materialize_block(inc, first_block);
+    long sum = l > 0 ? incremental_read(inc, l - 1) : 0;
+
+    i = l;
+    for (b = first_block; b <= last_block; b++) {
+        int start = b * BLOCK_SIZE;
+        int end = start + BLOCK_SIZE < num_elems ? start + BLOCK_SIZE : num_elems;
+        long base;
+        if (b == first_block) {
+            base = start > 0 ? incremental_read(inc, start - 1) : 0;
+        } else {
+            base = sum;
+        }
+        long old_last = incremental_read(inc, end - 1);
+
+        // the block is rewritten with absolute values, drop its offset
+        if (b != first_block) {
+            long pending = pending_get(inc, b);
+            pending_add(inc, b, -pending);
+            pending_add(inc, b + 1, pending);
+        }
+
+        for (; i < end; i++) {
+            sum += data[i];
+            inc->prefix_sums[i] = sum;
+        }
+        inc->block_totals[b] = sum - base;
+
+        // everything after the edit shifts by the same delta
+        if (b == last_block)
+            pending_add(inc, b + 1, sum - old_last);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int num_elems = 0;
+    int num_iters = 0;
+    int num_threads = 0;
+
+    int *data = NULL;
+    long *rescan_sums = NULL;
+    scan_ctx_t *ctx = NULL;
+    incremental_t inc;
+
+    struct timeval start_time, end_time;  // for gettimeofday to calculate timing
+
+    char filename[256] = "prefixsum_incremental_";
+    FILE *fp = NULL;
+
+    if (argc < 4) {
+        printf("Usage: %s [num_elems] [num_iters] [num_threads]\n", argv[0]);
+        printf("    - num_elems:  number of elements\n");
+        printf("    - num_iters: number of edits per edit length\n");
+        printf("    - num_threads: number of threads\n");
+        exit(-1);
+    }
+
+    num_elems = atoi(argv[1]);
+    num_iters = atoi(argv[2]);
+    num_threads = atoi(argv[3]);
+
+    if (num_threads < 1) {
+        printf("Number of threads should be more than one!\n");
+        exit(-1);
+    }
+    if (num_elems < 1 || num_iters < 1) {
+        printf("Number of elements and iterations should be positive!\n");
+        exit(-1);
+    }
+
+    strcat(filename, argv[1]);
+    strcat(filename, "elems_");
+    strcat(filename, argv[2]);
+    strcat(filename, "iters_");
+    strcat(filename, argv[3]);
+    strcat(filename, "threads.txt");
+
+    fp = fopen(filename, "w");
+    if (fp) {
+        printf("Command line: %s %d %d %d\n",
+                argv[0], num_elems, num_iters, num_threads);
+        printf("Stats file: %s\n\n", filename);
+        fprintf(fp, "Command line: %s %d %d %d\n",
+                argv[0], num_elems, num_iters, num_threads);
+        fprintf(fp, "Stats file: %s\n\n", filename);
+    } else {
+        printf("ERROR: can't open the file %s!\n", filename);
+        exit(-1);
+    }
+
+    // data partition and allocation
+    int num_elems_mean = num_elems / num_threads;
+    int num_elems_remain = num_elems % num_threads;
+    // starting and ending IDs of data partition for each thread
+    int *starts;
+    int *ends;
+    starts = (int *) malloc(sizeof(int) * num_threads);
+    ends = (int *) malloc(sizeof(int) * num_threads);
+    int id;
+    for (id = 0; id < num_threads; id++) {
+        if (id < num_elems_remain) {
+            starts[id] = id * (num_elems_mean + 1);
+            ends[id] = starts[id] + (num_elems_mean + 1);
+        } else {
+            starts[id] = id * num_elems_mean + num_elems_remain;
+            ends[id] = starts[id] + num_elems_mean;
+        }
+    }
+
+    // edit lengths, from a single element up to a quarter of the array
+    int edit_sizes[NUM_EDIT_SIZES] = {1, 64, 4096, 262144, 4194304};
+    int max_edit = 1;
+    int e;
+    for (e = 0; e < NUM_EDIT_SIZES; e++) {
+        if (edit_sizes[e] > num_elems / 4 && e > 0)
+            edit_sizes[e] = 0;
+        else if (edit_sizes[e] > max_edit)
+            max_edit = edit_sizes[e];
+    }
+
+    // Memory allocation
+    inc.num_elems = num_elems;
+    inc.num_blocks = (num_elems + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    inc.prefix_sums = (long *) malloc(sizeof(long) * num_elems);
+    inc.block_totals = (long *) malloc(sizeof(long) * inc.num_blocks);
+    inc.pending_tree = (long *) malloc(sizeof(long) * (inc.num_blocks + 1));
+    data = (int *) malloc(sizeof(int) * num_elems);
+    rescan_sums = (long *) malloc(sizeof(long) * num_elems);
+    ctx = scan_ctx_create(num_threads);
+    int *values = (int *) malloc(sizeof(int) * max_edit);
+    int *reads = (int *) malloc(sizeof(int) * NUM_READS);
+    suseconds_t *inc_usecs = (suseconds_t *) malloc(sizeof(suseconds_t) * num_iters);
+    suseconds_t *rescan_usecs = (suseconds_t *) malloc(sizeof(suseconds_t) * num_iters);
+    if (inc.prefix_sums == NULL || inc.block_totals == NULL ||
+        inc.pending_tree == NULL || data == NULL || rescan_sums == NULL ||
+        ctx == NULL || values == NULL || reads == NULL ||
+        inc_usecs == NULL || rescan_usecs == NULL) {
+        printf("Failed in malloc()\n");
+        printf(" - data: %p\n", data);
+        printf(" - prefix_sums: %p\n", inc.prefix_sums);
+        printf(" - block_totals: %p\n", inc.block_totals);
+        printf(" - rescan_sums: %p\n", rescan_sums);
+        free(inc.prefix_sums);
+        free(inc.block_totals);
+        free(inc.pending_tree);
+        free(data);
+        free(rescan_sums);
+        scan_ctx_destroy(ctx);
+        free(values);
+        free(reads);
+        free(inc_usecs);
+        free(rescan_usecs);
+        exit(-2);
+    }
+
+    // set number of threads
+    omp_set_num_threads(num_threads);
+
+    // Generate random ints in parallel
+    int K = MAX_INT / num_elems;
+
+    #pragma omp parallel shared(starts, ends, K, data)
+    {
+        // get the local thread ID
+        int tid = omp_get_thread_num();
+        srand(tid + time(NULL));  // Seed rand function
+
+        int start = starts[tid];
+        int end = ends[tid];
+
+        int i;
+        for (i = start; i < end; i++) {
+            data[i] = rand() % K;
+        }
+    }
+
+    printf("Start ...\n");
+    fprintf(fp, "Start ...\n");
+
+    suseconds_t build_usec;
+    gettimeofday(&start_time, NULL);
+    incremental_build(&inc, data);
+    gettimeofday(&end_time, NULL);
+    build_usec = usec(start_time, end_time);
+    printf("blocked build elapsed time: %d (usec), %d blocks of %d elements\n\n",
+            build_usec, inc.num_blocks, BLOCK_SIZE);
+    fprintf(fp, "blocked build elapsed time: %d (usec), %d blocks of %d elements\n\n",
+            build_usec, inc.num_blocks, BLOCK_SIZE);
+
+    // Range edits followed by random reads: incremental vs full rescan
+    long checksum_inc = 0, checksum_rescan = 0;
+    int iter, i, q;
+    for (e = 0; e < NUM_EDIT_SIZES; e++) {
+        int edit_len = edit_sizes[e];
+        if (edit_len == 0)
+            continue;
+
+        suseconds_t inc_total = 0, rescan_total = 0;
+        for (iter = 0; iter < num_iters; iter++) {
+            int l = rand() % (num_elems - edit_len + 1);
+            for (i = 0; i < edit_len; i++)
+                values[i] = rand() % K;
+            for (q = 0; q < NUM_READS; q++)
+                reads[q] = rand() % num_elems;
+
+            gettimeofday(&start_time, NULL);
+            incremental_update(&inc, data, l, l + edit_len - 1, values);
+            for (q = 0; q < NUM_READS; q++)
+                checksum_inc += incremental_read(&inc, reads[q]);
+            gettimeofday(&end_time, NULL);
+            inc_usecs[iter] = usec(start_time, end_time);
+            inc_total += inc_usecs[iter];
+
+            // data already holds the edit, the rescan pays only for the scan
+            gettimeofday(&start_time, NULL);
+            scan_i32_i64(ctx, data, rescan_sums, num_elems);
+            for (q = 0; q < NUM_READS; q++)
+                checksum_rescan += rescan_sums[reads[q]];
+            gettimeofday(&end_time, NULL);
+            rescan_usecs[iter] = usec(start_time, end_time);
+            rescan_total += rescan_usecs[iter];
+        }
+
+        suseconds_t inc_avg = inc_total / num_iters;
+        suseconds_t rescan_avg = rescan_total / num_iters;
+        double speedup = inc_avg > 0 ? (double) rescan_avg / inc_avg : 0.0;
+        printf("edit of %d elements + %d reads: incremental %d (usec, std %f), rescan %d (usec, std %f), speedup %.2f\n",
+                edit_len, NUM_READS,
+                inc_avg, calculate_standard_deviation(inc_usecs, num_iters),
+                rescan_avg, calculate_standard_deviation(rescan_usecs, num_iters),
+                speedup);
+        fprintf(fp, "edit of %d elements + %d reads: incremental %d (usec, std %f), rescan %d (usec, std %f), speedup %.2f\n",
+                edit_len, NUM_READS,
+                inc_avg, calculate_standard_deviation(inc_usecs, num_iters),
+                rescan_avg, calculate_standard_deviation(rescan_usecs, num_iters),
+                speedup);
+    }
+
+    if (checksum_inc != checksum_rescan) {
+        printf("Wrong incremental prefix sum implementation: read checksum %ld, rescan checksum %ld\n",
+                checksum_inc, checksum_rescan);
+        exit(-1);
+    }
+
+    suseconds_t materialize_usec;
+    gettimeofday(&start_time, NULL);
+    incremental_materialize_all(&inc);
+    gettimeofday(&end_time, NULL);
+    materialize_usec = usec(start_time, end_time);
+    printf("\nfull materialization elapsed time: %d (usec)\n", materialize_usec);
+    fprintf(fp, "\nfull materialization elapsed time: %d (usec)\n", materialize_usec);
+
+    printf("Finish Incremental Prefix Sum benchmark\n\n");
+    fprintf(fp, "Finish Incremental Prefix Sum benchmark\n\n");
+
+#ifdef PRINT_PREFIXSUM
+    fprintf(fp, "\nInputs:");
+    for (i = 0; i < num_elems; i++) {
+        fprintf(fp, " %d:%d", i, data[i]);
+    }
+    fprintf(fp, "\n\nPrefix Sums:");
+    for (i = 0; i < num_elems; i++) {
+        fprintf(fp, " %d:%ld", i, inc.prefix_sums[i]);
+    }
+    fprintf(fp, "\n");
+#endif // #ifdef PRINT_PREFIXSUM
+
+#ifdef VERIFY
+    scan_i32_i64(ctx, data, rescan_sums, num_elems);
+    for (i = 0; i < num_elems; i++) {
+        if (inc.prefix_sums[i] != rescan_sums[i]) {
+            printf("Wrong incremental prefix sum implementation: error at position %d, true prefix sum: %ld, computed prefix sum: %ld\n",
+                    i, rescan_sums[i], inc.prefix_sums[i]);
+            exit(-1);
+        }
+    }
+    int b;
+    for (b = 0; b < inc.num_blocks; b++) {
+        int last = (b + 1) * BLOCK_SIZE < num_elems ? (b + 1) * BLOCK_SIZE - 1 : num_elems - 1;
+        long total = rescan_sums[last] - (b > 0 ? rescan_sums[b * BLOCK_SIZE - 1] : 0);
+        if (inc.block_totals[b] != total) {
+            printf("Wrong incremental prefix sum implementation: block %d total %ld, expected %ld\n",
+                    b, inc.block_totals[b], total);
+            exit(-1);
+        }
+    }
+#endif // #ifdef VERIFY
+
+    // free the allocated memory
+    free(starts);
+    free(ends);
+    free(inc.prefix_sums);
+    free(inc.block_totals);
+    free(inc.pending_tree);
+    free(data);
+    free(rescan_sums);
+    scan_ctx_destroy(ctx);
+    free(values);
+    free(reads);
+    free(inc_usecs);
+    free(rescan_usecs);
+
+    fclose(fp);
+
+    return 0;
+}
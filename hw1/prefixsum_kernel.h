@@ -0,0 +1,109 @@
+/*
+ * prefixsum_kernel.h
+ *
+ * Description: Chunked scan of prefixsum_omp.c, included by prefixsum.c once
+ * per element type. The includer defines SCAN_NAME(x) (the suffix of the
+ * generated functions), SCAN_IN_T, SCAN_OUT_T and SCAN_SLOT (the field of
+ * scan_slot_t that carries SCAN_OUT_T).
+ *
+ * Procedure:
+ * 1. Each thread scans its contiguous chunk without a carry and stores the
+ *    chunk aggregate (for segmented scans, the sum after the last segment
+ *    head and whether the chunk has a head at all);
+ * 2. One thread turns the aggregates into the carry of every chunk;
+ * 3. Each thread adds its carry (for segmented scans, only up to the first
+ *    segment head of its chunk).
+ *
+ * With -DTRACE the phases of every thread are recorded (trace.h): local scan,
+ * barrier (waiting for the slowest chunk), carry (the single thread, and the
+ * wait for it) and add base.
+ */
+
+// chunk: scan in[start, end) into out without a carry; returns the chunk
+// aggregate and sets *flagged when the chunk has a segment head
+static SCAN_OUT_T SCAN_NAME(chunk)(const SCAN_IN_T *in, const uint8_t *flags,
+                                   SCAN_OUT_T *out, size_t start, size_t end,
+                                   int mode, int *flagged)
+{
+    SCAN_OUT_T sum = 0;
+    size_t i;
+
+    *flagged = 0;
+    if (mode == SCAN_MODE_INCLUSIVE) {
+        for (i = start; i < end; i++) {
+            sum += in[i];
+            out[i] = sum;
+        }
+    } else if (mode == SCAN_MODE_EXCLUSIVE) {
+        for (i = start; i < end; i++) {
+            SCAN_OUT_T x = in[i];
+            out[i] = sum;
+            sum += x;
+        }
+    } else {
+        for (i = start; i < end; i++) {
+            if (flags[i]) {
+                sum = 0;
+                *flagged = 1;
+            }
+            sum += in[i];
+            out[i] = sum;
+        }
+    }
+
+    return sum;
+}
+
+static void SCAN_NAME(run)(scan_ctx_t *ctx, const SCAN_IN_T *in,
+                           const uint8_t *flags, SCAN_OUT_T *out, size_t n,
+                           int mode)
+{
+    int flagged;
+
+    if (n < SCAN_SERIAL_CUTOFF || ctx->num_threads == 1) {
+        TRACE_BEGIN(t_scan);
+        SCAN_NAME(chunk)(in, flags, out, 0, n, mode, &flagged);
+        TRACE_END("local scan", t_scan);
+        return;
+    }
+
+    #pragma omp parallel num_threads(ctx->num_threads) private(flagged)
+    {
+        int tid = omp_get_thread_num();
+        int num_threads = omp_get_num_threads();
+        size_t start = n * tid / num_threads;
+        size_t end = n * (tid + 1) / num_threads;
+        size_t i;
+
+        TRACE_BEGIN(t_scan);
+        ctx->slots[tid].SCAN_SLOT = SCAN_NAME(chunk)(in, flags, out, start,
+                                                     end, mode, &flagged);
+        ctx->slots[tid].flagged = flagged;
+        TRACE_END("local scan", t_scan);
+        TRACE_BEGIN(t_wait);
+        #pragma omp barrier
+        TRACE_END("barrier", t_wait);
+        TRACE_BEGIN(t_carry);
+        #pragma omp single
+        {
+            SCAN_OUT_T carry = 0;
+            for (int t = 0; t < num_threads; t++) {
+                SCAN_OUT_T local = ctx->slots[t].SCAN_SLOT;
+                ctx->slots[t].SCAN_SLOT = carry;
+                carry = ctx->slots[t].flagged ? local : carry + local;
+            }
+        }
+        TRACE_END("carry", t_carry);
+
+        TRACE_BEGIN(t_add);
+        SCAN_OUT_T base = ctx->slots[tid].SCAN_SLOT;
+        if (mode == SCAN_MODE_SEGMENTED) {
+            for (i = start; i < end && !flags[i]; i++)
+                out[i] += base;
+        } else {
+            for (i = start; i < end; i++)
+                out[i] += base;
+        }
+        TRACE_END("add base", t_add);
+    }
+}
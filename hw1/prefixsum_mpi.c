@@ -15,6 +15,15 @@
  *    previous data.
  * 4. Finally, each processor uses the sum of all the previous data to update
  *    the local prefix sum to get the final result.
+ *
+ * With a baseline (a stats file of an earlier run of the same arguments and
+ * number of processes) the run is written to <stats file>_compare.txt and
+ * the iteration times of rank 0 are tested against the baseline
+ * (compare.h); a significant slowdown exits with COMPARE_REGRESSION.
+ *
+ * prefixsum_mpi_trace.exe is built with -DTRACE and also writes the phases
+ * of every iteration (trace.h), one process per rank, to
+ * <stats file>_trace.json, to be opened in chrome://tracing or Perfetto.
  */
 
 #include <stdio.h>
@@ -26,8 +35,13 @@
 #include <sys/time.h>
 #include <mpi.h>
 
+#include "compare.h"
+#include "trace.h"
+
 #define MAX_INT 2147483647
 //#define PRINT_PREFIXSUM
+#define VERIFY
+#define PHASE_TIMERS
 
 // usec: calculate the time interval in microseconds
 inline suseconds_t usec(struct timeval start, struct timeval end)
@@ -56,6 +70,99 @@ double calculate_standard_deviation(suseconds_t *data, int n) {
     return std_dev;
 }
 
+#ifdef PHASE_TIMERS
+// Per-rank phase timers: the local scan and the add base are timed with
+// MPI_Wtime around the loops, the carry wait (MPI_Recv, MPI_Isend, MPI_Wait)
+// and the barrier by the PMPI wrappers below. Only the timed region is
+// recorded.
+#define PHASE_SCAN 0
+#define PHASE_CARRY 1
+#define PHASE_ADD 2
+#define PHASE_BARRIER 3
+#define NUM_PHASES 4
+
+static const char *phase_names[NUM_PHASES] =
+    {"local scan", "carry wait", "add base", "barrier"};
+static double phase_usec[NUM_PHASES];
+static int phase_recording = 0;
+
+#ifdef TRACE
+// every timed phase is also an event of the trace timeline: per iteration
+// the copy, the local scan, the carry wait three times (MPI_Recv, MPI_Isend,
+// MPI_Wait), the add base and the barrier
+#define TRACE_EVENTS_PER_ITER 7
+#define PHASE_BEGIN(t) double t = MPI_Wtime(); TRACE_BEGIN(t##_trace)
+#define PHASE_END(phase, t) (phase_usec[phase] += (MPI_Wtime() - (t)) * 1e6, \
+                             TRACE_END(phase_names[phase], t##_trace))
+#else
+#define PHASE_BEGIN(t) double t = MPI_Wtime()
+#define PHASE_END(phase, t) (phase_usec[phase] += (MPI_Wtime() - (t)) * 1e6)
+#endif // #ifdef TRACE
+
+int MPI_Recv(void *buf, int count, MPI_Datatype datatype, int source,
+             int tag, MPI_Comm comm, MPI_Status *status)
+{
+    PHASE_BEGIN(t);
+    int err = PMPI_Recv(buf, count, datatype, source, tag, comm, status);
+    if (phase_recording)
+        PHASE_END(PHASE_CARRY, t);
+    return err;
+}
+
+int MPI_Isend(const void *buf, int count, MPI_Datatype datatype, int dest,
+              int tag, MPI_Comm comm, MPI_Request *request)
+{
+    PHASE_BEGIN(t);
+    int err = PMPI_Isend(buf, count, datatype, dest, tag, comm, request);
+    if (phase_recording)
+        PHASE_END(PHASE_CARRY, t);
+    return err;
+}
+
+int MPI_Wait(MPI_Request *request, MPI_Status *status)
+{
+    PHASE_BEGIN(t);
+    int err = PMPI_Wait(request, status);
+    if (phase_recording)
+        PHASE_END(PHASE_CARRY, t);
+    return err;
+}
+
+int MPI_Barrier(MPI_Comm comm)
+{
+    PHASE_BEGIN(t);
+    int err = PMPI_Barrier(comm);
+    if (phase_recording)
+        PHASE_END(PHASE_BARRIER, t);
+    return err;
+}
+#else
+#ifdef TRACE
+#error "the trace of prefixsum_mpi.c records the PHASE_TIMERS phases"
+#endif
+#define PHASE_BEGIN(t)
+#define PHASE_END(phase, t)
+#endif // #ifdef PHASE_TIMERS
+
+#ifdef VERIFY
+// verify_local_prefix_sums: check this rank's scan in place, without a second
+// array: local_prefix_sums[i] - local_prefix_sums[i-1] == local_data[i], where
+// the element before the first one is prev_last, the last prefix sum of the
+// previous rank (0 on rank 0). Returns the first wrong local position, or
+// my_num_elems if all is right.
+int verify_local_prefix_sums(long *local_prefix_sums, int *local_data,
+                             int my_num_elems, long prev_last)
+{
+    int i;
+    for (i = 0; i < my_num_elems; i++) {
+        long prev = (i == 0) ? prev_last : local_prefix_sums[i-1];
+        if (local_prefix_sums[i] - prev != local_data[i])
+            break;
+    }
+    return i;
+}
+#endif // #ifdef VERIFY
+
 int main(int argc, char *argv[])
 {
     // command line arguments
@@ -90,9 +197,10 @@ int main(int argc, char *argv[])
 
     if (argc < 3) {
         if (rank == 0) {
-            printf("Usage: %s [num_elems] [num_iters]\n", argv[0]);
+            printf("Usage: %s [num_elems] [num_iters] [baseline]\n", argv[0]);
             printf("    - num_elems:  number of elements\n");
             printf("    - num_iters: number of iterations\n");
+            printf("    - baseline: stats file to compare with (optional)\n");
         }
 
         MPI_Finalize();
@@ -116,6 +224,27 @@ int main(int argc, char *argv[])
     strcat(filename, nprocs);
     strcat(filename, "procs.txt");
 
+    // compare mode: rank 0 reads the baseline before a stats file of the
+    // same name is written, and all ranks write this run to _compare.txt
+    suseconds_t *baseline = NULL;
+    int num_baseline = 0;
+    int regression = 0;
+    if (argc > 3) {
+        if (rank == 0) {
+            num_baseline = compare_load_baseline(argv[3], filename, &baseline);
+            if (num_baseline == -2)
+                printf("ERROR: %s is not a baseline of %s!\n", argv[3], filename);
+            else if (num_baseline < 0)
+                printf("ERROR: can't read the baseline %s!\n", argv[3]);
+        }
+        MPI_Bcast(&num_baseline, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        if (num_baseline < 0) {
+            MPI_Finalize();
+            exit(-1);
+        }
+        strcpy(filename + strlen(filename) - strlen(".txt"), "_compare.txt");
+    }
+
     if (rank == 0) {
         fp = fopen(filename, "w");
         if (fp) {
@@ -196,23 +325,39 @@ int main(int argc, char *argv[])
     suseconds_t iter_usec = 0;
     suseconds_t total_usec = 0;
     suseconds_t *usecs;
-    usecs = (suseconds_t *)malloc(sizeof(suseconds_t) * 10);
+    usecs = (suseconds_t *)malloc(sizeof(suseconds_t) * num_iters);
+
+#ifdef TRACE
+    // TRACE_EVENTS_PER_ITER events per iteration; the clocks of the ranks
+    // start together at the barrier above
+    if (trace_init(1, (long) num_iters * TRACE_EVENTS_PER_ITER) != 0) {
+        printf("Processor %d failed in trace_init().\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, -2);
+    }
+#endif // #ifdef TRACE
 
     int iter;
     for (iter = 0; iter < num_iters; iter++) {
         // copy the input array to the prefix sum array for initialization
+        TRACE_BEGIN(t_copy);
         for (i = 0; i < my_num_elems; i++) {
             local_prefix_sums[i] = local_data[i];
         }
+        TRACE_END("copy", t_copy);
 
         gettimeofday(&start_time, NULL);
+#ifdef PHASE_TIMERS
+        phase_recording = 1;
+#endif
         /************************************************************/
         /* PLEASE COMPLETE THE CODE - Begin                         */
         /************************************************************/
 
+        PHASE_BEGIN(scan_start);
         for (int ii = 1; ii < my_num_elems; ii++) {
             local_prefix_sums[ii] += local_prefix_sums[ii-1];
         }
+        PHASE_END(PHASE_SCAN, scan_start);
         if (rank != 0) {
             MPI_Recv(buffer, 1, MPI_LONG, rank - 1, 0, MPI_COMM_WORLD, &status);
             buffer_update[0] = local_prefix_sums[my_num_elems - 1] + buffer[0];
@@ -224,14 +369,23 @@ int main(int argc, char *argv[])
         if (rank != num_procs - 1) {
             MPI_Isend(buffer_update, 1, MPI_LONG, rank + 1, 0, MPI_COMM_WORLD, &request);
         }
+        PHASE_BEGIN(add_start);
         for (int ii = 0; ii < my_num_elems; ii++) {
             local_prefix_sums[ii] += buffer[0];
         }
+        PHASE_END(PHASE_ADD, add_start);
 
+        // buffer_update is rewritten next iteration, so the send completes here
+        if (rank != num_procs - 1) {
+            MPI_Wait(&request, MPI_STATUS_IGNORE);
+        }
         MPI_Barrier(MPI_COMM_WORLD);
         /************************************************************/
         /* PLEASE COMPLETE THE CODE - End                           */
         /************************************************************/
+#ifdef PHASE_TIMERS
+        phase_recording = 0;
+#endif
         gettimeofday(&end_time, NULL);
 
         iter_usec = usec(start_time, end_time);
@@ -245,6 +399,52 @@ int main(int argc, char *argv[])
         }
     }
 
+#ifdef TRACE
+    // one trace file for all the ranks: each rank appends its events after
+    // the previous one, rank 0 opens the array and the last rank closes it
+    char trace_filename[256];
+    char process_name[32];
+    int trace_first = 1;
+    long trace_dropped = 0;
+    strcpy(trace_filename, filename);
+    strcpy(trace_filename + strlen(trace_filename) - strlen(".txt"), "_trace.json");
+    sprintf(process_name, "rank %d", rank);
+    if (rank != 0)
+        MPI_Recv(&trace_first, 1, MPI_INT, rank - 1, 1, MPI_COMM_WORLD, &status);
+    FILE *trace_fp = fopen(trace_filename, rank == 0 ? "w" : "a");
+    if (trace_fp) {
+        if (rank == 0)
+            fprintf(trace_fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+        trace_first = trace_write_events(trace_fp, rank, process_name, trace_first);
+        if (rank == num_procs - 1)
+            fprintf(trace_fp, "]}\n");
+        fclose(trace_fp);
+    } else {
+        printf("ERROR: can't open the file %s!\n", trace_filename);
+    }
+    if (rank != num_procs - 1)
+        MPI_Send(&trace_first, 1, MPI_INT, rank + 1, 1, MPI_COMM_WORLD);
+    MPI_Reduce(&trace_state.dropped, &trace_dropped, 1, MPI_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    trace_free();
+#endif // #ifdef TRACE
+
+#ifdef PHASE_TIMERS
+    // per-iteration phase times reduced over the ranks: min and max with the
+    // rank holding them, and the mean
+    struct { double usec; int rank; } my_phases[NUM_PHASES],
+        min_phases[NUM_PHASES], max_phases[NUM_PHASES];
+    double my_phase_usec[NUM_PHASES], sum_phases[NUM_PHASES];
+    int p;
+    for (p = 0; p < NUM_PHASES; p++) {
+        my_phase_usec[p] = phase_usec[p] / num_iters;
+        my_phases[p].usec = my_phase_usec[p];
+        my_phases[p].rank = rank;
+    }
+    MPI_Reduce(my_phases, min_phases, NUM_PHASES, MPI_DOUBLE_INT, MPI_MINLOC, 0, MPI_COMM_WORLD);
+    MPI_Reduce(my_phases, max_phases, NUM_PHASES, MPI_DOUBLE_INT, MPI_MAXLOC, 0, MPI_COMM_WORLD);
+    MPI_Reduce(my_phase_usec, sum_phases, NUM_PHASES, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+#endif // #ifdef PHASE_TIMERS
+
     // print timing stats
     if (rank == 0) {
         printf("Finish MPI Parallel Prefix Sum calculation\n\n");
@@ -254,11 +454,35 @@ int main(int argc, char *argv[])
         fprintf(fp, "Prefix Sum average elapsed time: %d (usec)\n",
                 total_usec / num_iters);
 
-    double std_dev = calculate_standard_deviation(usecs, 10);
+    double std_dev = calculate_standard_deviation(usecs, num_iters);
     printf("Prefix Sum std: %f (std_dev)\n",
             std_dev);
     fprintf(fp, "Prefix Sum std: %f (std_dev)\n",
             std_dev);
+#ifdef PHASE_TIMERS
+        // imbalance: max / mean of the phase over the ranks
+        printf("\nPer-rank phase time per iteration (usec): min (rank) / mean / max (rank), imbalance\n");
+        fprintf(fp, "\nPer-rank phase time per iteration (usec): min (rank) / mean / max (rank), imbalance\n");
+        for (p = 0; p < NUM_PHASES; p++) {
+            double mean = sum_phases[p] / num_procs;
+            double imbalance = mean > 0 ? max_phases[p].usec / mean : 1.0;
+            printf("  %-10s: %.1f (%d) / %.1f / %.1f (%d), %.2f\n", phase_names[p],
+                    min_phases[p].usec, min_phases[p].rank, mean,
+                    max_phases[p].usec, max_phases[p].rank, imbalance);
+            fprintf(fp, "  %-10s: %.1f (%d) / %.1f / %.1f (%d), %.2f\n", phase_names[p],
+                    min_phases[p].usec, min_phases[p].rank, mean,
+                    max_phases[p].usec, max_phases[p].rank, imbalance);
+        }
+#endif // #ifdef PHASE_TIMERS
+#ifdef TRACE
+        printf("\nTrace file: %s (%ld events dropped)\n", trace_filename,
+                trace_dropped);
+        fprintf(fp, "\nTrace file: %s (%ld events dropped)\n", trace_filename,
+                trace_dropped);
+#endif // #ifdef TRACE
+        if (baseline != NULL)
+            regression = compare_report(fp, argv[3], baseline, num_baseline,
+                                        usecs, num_iters);
 #ifdef PRINT_PREFIXSUM
         fprintf(fp, "\nInputs:");
 #endif // #ifdef PRINT_PREFIXSUM
@@ -327,11 +551,42 @@ int main(int argc, char *argv[])
     }
 #endif // #ifdef PRINT_PREFIXSUM
 
+#ifdef VERIFY
+    // every rank checks its own block; the rank boundaries only need the
+    // last prefix sum of the left neighbour
+    long my_last = (my_num_elems > 0) ? local_prefix_sums[my_num_elems - 1] : 0;
+    long prev_last = 0;
+    MPI_Sendrecv(&my_last, 1, MPI_LONG,
+                 (rank == num_procs - 1) ? MPI_PROC_NULL : rank + 1, 1,
+                 &prev_last, 1, MPI_LONG,
+                 (rank == 0) ? MPI_PROC_NULL : rank - 1, 1,
+                 MPI_COMM_WORLD, &status);
+
+    int local_error = verify_local_prefix_sums(local_prefix_sums, local_data,
+                                               my_num_elems, prev_last);
+    int my_error = (local_error < my_num_elems) ? start + local_error : num_elems;
+    int first_error = num_elems;
+    MPI_Allreduce(&my_error, &first_error, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+    if (my_error < num_elems && my_error == first_error) {
+        long prev = (local_error == 0) ? prev_last : local_prefix_sums[local_error-1];
+        printf("Wrong parallel prefix sum implementation: error at position %d, true prefix sum: %ld, computed prefix sum: %ld\n",
+                my_error, prev + local_data[local_error], local_prefix_sums[local_error]);
+    }
+    if (first_error < num_elems) {
+        free(local_data);
+        free(local_prefix_sums);
+        free(buffer);
+        MPI_Finalize();
+        exit(-1);
+    }
+#endif // #ifdef VERIFY
+
     free(local_data);
     free(local_prefix_sums);
     free(buffer);
+    free(baseline);
 
     MPI_Finalize();
 
-    return 0;
+    return regression ? COMPARE_REGRESSION : 0;
 }
@@ -16,6 +16,18 @@
  *    has the sum of the previous input data and its local largest prefix sum.
  * 4. Each thread updates the local prefix sums using the corresponding
  *    temporary array element (in parallel OpenMP region).
+ *
+ * Steps 2-4 are scan_i32_i64 of libprefixsum (prefixsum.h); this driver only
+ * generates the input, times the calls and verifies the result.
+ *
+ * With a baseline (a stats file of an earlier run of the same arguments) the
+ * run is written to <stats file>_compare.txt and its iteration times are
+ * tested against the baseline (compare.h); a significant slowdown exits
+ * with COMPARE_REGRESSION.
+ *
+ * prefixsum_omp_trace.exe is built with -DTRACE together with the library
+ * sources and writes the per-thread phases of every iteration (trace.h) to
+ * <stats file>_trace.json, to be opened in chrome://tracing or Perfetto.
  */
 
 #include <stdio.h>
@@ -27,6 +39,10 @@
 #include <sys/time.h>
 #include <omp.h>
 
+#include "prefixsum.h"
+#include "compare.h"
+#include "trace.h"
+
 #define MAX_INT 2147483647
 //#define PRINT_PREFIXSUM
 #define VERIFY
@@ -58,6 +74,37 @@ double calculate_standard_deviation(suseconds_t *data, int n) {
     return std_dev;
 }
 
+#ifdef VERIFY
+// verify_prefix_sums: check the scan in place, without a second array. Each
+// thread checks prefix_sums[i] - prefix_sums[i-1] == data[i] over its own
+// partition; the first element of a partition is checked against the last
+// one of the previous partition, so the chunk boundaries are covered too.
+// Returns the first wrong position, or ends[num_threads-1] if all is right.
+int verify_prefix_sums(long *prefix_sums, int *data, int *starts, int *ends,
+                       int num_threads)
+{
+    int first_error = ends[num_threads - 1];
+
+    #pragma omp parallel num_threads(num_threads) reduction(min:first_error)
+    {
+        int tid = omp_get_thread_num();
+        int start = starts[tid];
+        int end = ends[tid];
+
+        int i;
+        for (i = start; i < end; i++) {
+            long prev = (i == 0) ? 0 : prefix_sums[i-1];
+            if (prefix_sums[i] - prev != data[i]) {
+                first_error = i;
+                break;
+            }
+        }
+    }
+
+    return first_error;
+}
+#endif // #ifdef VERIFY
+
 int main(int argc, char *argv[])
 {
     int num_elems = 0;
@@ -66,7 +113,7 @@ int main(int argc, char *argv[])
 
     int *data = NULL;
     long *prefix_sums = NULL;
-    long *tmp_sums = NULL;
+    scan_ctx_t *ctx = NULL;
 
     struct timeval start_time, end_time;  // for gettimeofday to calculate timing
 
@@ -74,10 +121,11 @@ int main(int argc, char *argv[])
     FILE *fp = NULL;
 
     if (argc < 4) {
-        printf("Usage: %s [num_elems] [num_iters] [num_threads]\n", argv[0]);
+        printf("Usage: %s [num_elems] [num_iters] [num_threads] [baseline]\n", argv[0]);
         printf("    - num_elems:  number of elements\n");
         printf("    - num_iters: number of iterations\n");
         printf("    - num_threads: number of threads\n");
+        printf("    - baseline: stats file to compare with (optional)\n");
         exit(-1);
     }
 
@@ -97,6 +145,22 @@ int main(int argc, char *argv[])
     strcat(filename, argv[3]);
     strcat(filename, "threads.txt");
 
+    // compare mode: read the baseline before a stats file of the same name
+    // is written, and keep it by writing this run to _compare.txt
+    suseconds_t *baseline = NULL;
+    int num_baseline = 0;
+    if (argc > 4) {
+        num_baseline = compare_load_baseline(argv[4], filename, &baseline);
+        if (num_baseline == -2) {
+            printf("ERROR: %s is not a baseline of %s!\n", argv[4], filename);
+            exit(-1);
+        } else if (num_baseline < 0) {
+            printf("ERROR: can't read the baseline %s!\n", argv[4]);
+            exit(-1);
+        }
+        strcpy(filename + strlen(filename) - strlen(".txt"), "_compare.txt");
+    }
+
     fp = fopen(filename, "w");
     if (fp) {
         printf("Command line: %s %d %d %d\n",
@@ -137,20 +201,19 @@ int main(int argc, char *argv[])
     // Memory allocation
     data = (int *) malloc(sizeof(int) * num_elems);
     prefix_sums = (long *) malloc(sizeof(long) * num_elems);
-    tmp_sums = (long *) malloc(sizeof(long) * num_threads);
-    if (data == NULL || prefix_sums == NULL || tmp_sums == NULL) {
+    ctx = scan_ctx_create(num_threads);
+    if (data == NULL || prefix_sums == NULL || ctx == NULL) {
         printf("Failed in malloc()\n");
         printf(" - data: %p\n", data);
         printf(" - prefix_sums: %p\n", prefix_sums);
-        printf(" - tmp_sums: %p\n", tmp_sums);
+        printf(" - ctx: %p\n", ctx);
         free(data);
         free(prefix_sums);
-        free(tmp_sums);
+        scan_ctx_destroy(ctx);
         exit(-2);
     }
-    memset(data, 0, num_elems);
-    memset(prefix_sums, 0, num_elems);
-    memset(tmp_sums, 0, num_threads);
+    memset(data, 0, sizeof(int) * num_elems);
+    memset(prefix_sums, 0, sizeof(long) * num_elems);
 
     // set number of threads
     omp_set_num_threads(num_threads);
@@ -181,55 +244,21 @@ int main(int argc, char *argv[])
     suseconds_t iter_usec = 0;
     suseconds_t total_usec = 0;
     suseconds_t *usecs;
-    usecs = (suseconds_t *)malloc(sizeof(suseconds_t) * 10);
+    usecs = (suseconds_t *)malloc(sizeof(suseconds_t) * num_iters);
+#ifdef TRACE
+    // the kernel records 4 phases per thread and iteration, plus the
+    // iteration itself on thread 0
+    if (trace_init(num_threads, (long) num_iters * 5) != 0) {
+        printf("Failed in trace_init()\n");
+        exit(-2);
+    }
+#endif // #ifdef TRACE
     int iter;
     for (iter = 0; iter < num_iters; iter++) {
-        // copy the input array to the prefix sum array for initialization
-        #pragma omp parallel shared(starts, ends, data, prefix_sums)
-        {
-            int tid = omp_get_thread_num(); // get the local thread ID
-
-            int start = starts[tid];
-            int end = ends[tid];
-
-            int i;
-            for (i = start; i < end; i++)
-                prefix_sums[i] = data[i];
-        }
-
         gettimeofday(&start_time, NULL);
-        /************************************************************/
-        /* PLEASE COMPLETE THE CODE - Begin                         */
-        /************************************************************/
-        #pragma omp parallel shared(starts, ends, prefix_sums, tmp_sums, num_threads)
-        {
-            int tid = omp_get_thread_num(); // get the local thread ID
-            int start = starts[tid];
-            int end = ends[tid];
-            int i;
-            for (i = start+1; i < end; i++)
-                prefix_sums[i] += prefix_sums[i-1];
-            if (tid != num_threads - 1) {
-                tmp_sums[tid+1] = prefix_sums[end-1];
-            }
-        }
-        #pragma omp barrier
-        for (int ii = 1; ii < num_threads; ii++) {
-            tmp_sums[ii] += tmp_sums[ii-1];
-        }
-
-        #pragma omp parallel shared(starts, ends, prefix_sums, tmp_sums)
-        {
-            int tid = omp_get_thread_num(); // get the local thread ID
-            int start = starts[tid];
-            int end = ends[tid];
-            int i;
-            for (i = start; i < end; i++)
-                prefix_sums[i] += tmp_sums[tid];
-        }
-        /************************************************************/
-        /* PLEASE COMPLETE THE CODE - End                           */
-        /************************************************************/
+        TRACE_BEGIN(t_iter);
+        scan_i32_i64(ctx, data, prefix_sums, num_elems);
+        TRACE_END("iteration", t_iter);
         gettimeofday(&end_time, NULL);
 
         iter_usec = usec(start_time, end_time);
@@ -248,12 +277,27 @@ int main(int argc, char *argv[])
     fprintf(fp, "Prefix Sum average elapsed time: %d (usec)\n",
             total_usec / num_iters);
 
-    double std_dev = calculate_standard_deviation(usecs, 10);
+    double std_dev = calculate_standard_deviation(usecs, num_iters);
     printf("Prefix Sum std: %f (std_dev)\n",
             std_dev);
     fprintf(fp, "Prefix Sum std: %f (std_dev)\n",
             std_dev);
 
+#ifdef TRACE
+    char trace_filename[256];
+    strcpy(trace_filename, filename);
+    strcpy(trace_filename + strlen(trace_filename) - strlen(".txt"), "_trace.json");
+    if (trace_dump(trace_filename, 0, "prefixsum_omp") == 0) {
+        printf("Trace file: %s (%ld events dropped)\n", trace_filename,
+                trace_state.dropped);
+        fprintf(fp, "Trace file: %s (%ld events dropped)\n", trace_filename,
+                trace_state.dropped);
+    } else {
+        printf("ERROR: can't open the file %s!\n", trace_filename);
+    }
+    trace_free();
+#endif // #ifdef TRACE
+
 #ifdef PRINT_PREFIXSUM
     fprintf(fp, "\nInputs:");
     for (i = 0; i < num_elems; i++) {
@@ -267,17 +311,11 @@ int main(int argc, char *argv[])
 #endif // #ifdef PRINT_PREFIXSUM
 
 #ifdef VERIFY
-    long *verify_prefix_sums = malloc(sizeof(long) * num_elems);
-    memset(verify_prefix_sums, 0, num_elems);
-    verify_prefix_sums[0] = data[0];
-    int i;
-    for (i = 1; i < num_elems; i++) {
-        verify_prefix_sums[i] = data[i] + verify_prefix_sums[i-1];
-        if (verify_prefix_sums[i] != prefix_sums[i]) {
-            printf("Wrong parallel prefix sum implementation: error at position %d, true prefix sum: %ld, computed prefix sum: %ld\n",
-                    i, verify_prefix_sums[i], prefix_sums[i]);
-            exit(-1);
-        }
+    int i = verify_prefix_sums(prefix_sums, data, starts, ends, num_threads);
+    if (i < num_elems) {
+        printf("Wrong parallel prefix sum implementation: error at position %d, true prefix sum: %ld, computed prefix sum: %ld\n",
+                i, (i == 0 ? 0 : prefix_sums[i-1]) + data[i], prefix_sums[i]);
+        exit(-1);
     }
 #endif // #ifdef VERIFY
 
@@ -286,9 +324,16 @@ int main(int argc, char *argv[])
     free(ends);
     free(data);
     free(prefix_sums);
-    free(tmp_sums);
+    scan_ctx_destroy(ctx);
+
+    int regression = 0;
+    if (baseline != NULL)
+        regression = compare_report(fp, argv[4], baseline, num_baseline,
+                                    usecs, num_iters);
+    free(baseline);
+    free(usecs);
 
     fclose(fp);
 
-    return 0;
+    return regression ? COMPARE_REGRESSION : 0;
 }
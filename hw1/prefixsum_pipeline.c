@@ -0,0 +1,385 @@
+/*
+ * prefixsum_pipeline.c
+ *
+ * Description: Pipelined Prefix Sum over a stream of batches using OpenMP
+ * for the scan and one thread for each of the other two stages.
+ *
+ * Procedure:
+ * 1. A ring of ring_depth batch slots is allocated; every slot holds the
+ *    input ints and the prefix sums of one batch and cycles through the
+ *    states EMPTY -> FILLED -> SCANNED -> EMPTY;
+ * 2. The producer thread fills batch k + 1 (random ints, or the next
+ *    batch_elems ints of input_file) as soon as its slot is EMPTY;
+ * 3. The main thread scans batch k with the OpenMP team (scan_i32_i64 of
+ *    libprefixsum) as soon as its slot is FILLED;
+ * 4. The consumer thread checks batch k - 1 (VERIFY) and folds its total into
+ *    a checksum as soon as its slot is SCANNED, then returns the slot;
+ * 5. The same stages are also run one after the other in a single loop, and
+ *    both runs report the end-to-end throughput, the busy time of every
+ *    stage and the scan kernel time.
+ *
+ * The three stages hold three batches at once, so ring_depth = 3 (the
+ * default) is the smallest ring in which producing batch k + 1, scanning
+ * batch k and consuming batch k - 1 overlap; with 2 slots the producer and
+ * the consumer take turns on the slot the scan is not using. A deeper ring
+ * absorbs jitter between the stages.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <omp.h>
+
+#include "prefixsum.h"
+
+#define MAX_INT 2147483647
+#define VERIFY
+
+#define SLOT_EMPTY 0
+#define SLOT_FILLED 1
+#define SLOT_SCANNED 2
+
+// usec: calculate the time interval in microseconds
+inline suseconds_t usec(struct timeval start, struct timeval end)
+{
+  return ((double) (((end.tv_sec * 1000000 + end.tv_usec) -
+                     (start.tv_sec * 1000000 + start.tv_usec))));
+}
+
+double calculate_standard_deviation(suseconds_t *data, int n) {
+    double mean = 0.0;
+    double variance = 0.0;
+    double std_dev = 0.0;
+
+    for (int i = 0; i < n; i++) {
+        mean += (double)data[i];
+    }
+    mean /= n;
+
+    for (int i = 0; i < n; i++) {
+        variance += (data[i] - mean) * (data[i] - mean);
+    }
+    variance /= n;
+
+    std_dev = sqrt(variance);
+
+    return std_dev;
+}
+
+typedef struct {
+    int *data;
+    long *prefix_sums;
+    int state;
+} slot_t;
+
+typedef struct {
+    slot_t *slots;
+    int depth;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+
+    int batch_elems;
+    int num_batches;
+    int K;                      // random ints are in [0, K)
+    FILE *input;                // NULL: generate the batches
+
+    suseconds_t produce_usec;   // busy time of every stage
+    suseconds_t consume_usec;
+    long checksum;
+    int errors;
+} ring_t;
+
+// ring_wait: block until the slot of batch k is in the given state
+slot_t *ring_wait(ring_t *ring, int k, int state)
+{
+    slot_t *slot = &ring->slots[k % ring->depth];
+    pthread_mutex_lock(&ring->lock);
+    while (slot->state != state)
+        pthread_cond_wait(&ring->changed, &ring->lock);
+    pthread_mutex_unlock(&ring->lock);
+    return slot;
+}
+
+// ring_set: move a slot to the given state and wake the other stages
+void ring_set(ring_t *ring, slot_t *slot, int state)
+{
+    pthread_mutex_lock(&ring->lock);
+    slot->state = state;
+    pthread_cond_broadcast(&ring->changed);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+// produce: fill batch k, from the input file (wrapping around at its end)
+// or with random ints seeded by the batch number
+void produce(ring_t *ring, int *data, int k)
+{
+    int n = ring->batch_elems;
+    if (ring->input) {
+        int got = 0;
+        while (got < n) {
+            int read = fread(data + got, sizeof(int), n - got, ring->input);
+            if (read == 0)
+                rewind(ring->input);
+            got += read;
+        }
+    } else {
+        unsigned int seed = k + 1;
+        for (int i = 0; i < n; i++)
+            data[i] = rand_r(&seed) % ring->K;
+    }
+}
+
+// consume: check the prefix sums of a batch and fold its total into the
+// checksum
+void consume(ring_t *ring, slot_t *slot, int k)
+{
+    int n = ring->batch_elems;
+#ifdef VERIFY
+    long sum = 0;
+    for (int i = 0; i < n; i++) {
+        sum += slot->data[i];
+        if (slot->prefix_sums[i] != sum) {
+            printf("Wrong pipelined implementation: batch %d, error at position %d\n", k, i);
+            ring->errors++;
+            break;
+        }
+    }
+#endif // #ifdef VERIFY
+    ring->checksum += slot->prefix_sums[n - 1];
+}
+
+void *producer_thread(void *arg)
+{
+    ring_t *ring = (ring_t *) arg;
+    struct timeval start_time, end_time;
+    for (int k = 0; k < ring->num_batches; k++) {
+        slot_t *slot = ring_wait(ring, k, SLOT_EMPTY);
+        gettimeofday(&start_time, NULL);
+        produce(ring, slot->data, k);
+        gettimeofday(&end_time, NULL);
+        ring->produce_usec += usec(start_time, end_time);
+        ring_set(ring, slot, SLOT_FILLED);
+    }
+    return NULL;
+}
+
+void *consumer_thread(void *arg)
+{
+    ring_t *ring = (ring_t *) arg;
+    struct timeval start_time, end_time;
+    for (int k = 0; k < ring->num_batches; k++) {
+        slot_t *slot = ring_wait(ring, k, SLOT_SCANNED);
+        gettimeofday(&start_time, NULL);
+        consume(ring, slot, k);
+        gettimeofday(&end_time, NULL);
+        ring->consume_usec += usec(start_time, end_time);
+        ring_set(ring, slot, SLOT_EMPTY);
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    int batch_elems = 0;
+    int num_batches = 0;
+    int num_threads = 0;
+    int ring_depth = 3;
+    FILE *input = NULL;
+
+    struct timeval start_time, end_time;  // for gettimeofday to calculate timing
+
+    char filename[256] = "prefixsum_pipeline_";
+    FILE *fp = NULL;
+
+    if (argc < 4) {
+        printf("Usage: %s [batch_elems] [num_batches] [num_threads] [ring_depth] [input_file]\n", argv[0]);
+        printf("    - batch_elems:  number of elements per batch\n");
+        printf("    - num_batches: number of batches in the stream\n");
+        printf("    - num_threads: number of scan threads\n");
+        printf("    - ring_depth: number of batch slots (optional, default 3)\n");
+        printf("    - input_file: raw ints to read the batches from (optional, default random)\n");
+        exit(-1);
+    }
+
+    batch_elems = atoi(argv[1]);
+    num_batches = atoi(argv[2]);
+    num_threads = atoi(argv[3]);
+    if (argc > 4)
+        ring_depth = atoi(argv[4]);
+
+    if (num_threads < 1) {
+        printf("Number of threads should be more than one!\n");
+        exit(-1);
+    }
+    if (batch_elems < 1 || num_batches < 1 || ring_depth < 1) {
+        printf("Batch size, number of batches and ring depth should be positive!\n");
+        exit(-1);
+    }
+    if (argc > 5) {
+        input = fopen(argv[5], "rb");
+        if (input == NULL || fseek(input, 0, SEEK_END) != 0 || ftell(input) < (long) sizeof(int)) {
+            printf("ERROR: can't read ints from the file %s!\n", argv[5]);
+            exit(-1);
+        }
+        rewind(input);
+    }
+
+    strcat(filename, argv[1]);
+    strcat(filename, "elems_");
+    strcat(filename, argv[2]);
+    strcat(filename, "batches_");
+    strcat(filename, argv[3]);
+    strcat(filename, "threads.txt");
+
+    fp = fopen(filename, "w");
+    if (fp) {
+        printf("Command line: %s %d %d %d %d%s%s\n",
+                argv[0], batch_elems, num_batches, num_threads, ring_depth,
+                input ? " " : "", input ? argv[5] : "");
+        printf("Stats file: %s\n\n", filename);
+        fprintf(fp, "Command line: %s %d %d %d %d%s%s\n",
+                argv[0], batch_elems, num_batches, num_threads, ring_depth,
+                input ? " " : "", input ? argv[5] : "");
+        fprintf(fp, "Stats file: %s\n\n", filename);
+    } else {
+        printf("ERROR: can't open the file %s!\n", filename);
+        exit(-1);
+    }
+
+    // Memory allocation of the ring
+    ring_t ring;
+    int id;
+    memset(&ring, 0, sizeof(ring));
+    ring.depth = ring_depth;
+    ring.batch_elems = batch_elems;
+    ring.num_batches = num_batches;
+    ring.K = MAX_INT / batch_elems;
+    ring.input = input;
+    ring.slots = (slot_t *) malloc(sizeof(slot_t) * ring_depth);
+    scan_ctx_t *ctx = scan_ctx_create(num_threads);
+    if (ring.slots == NULL || ctx == NULL) {
+        printf("Failed in malloc()\n");
+        exit(-2);
+    }
+    for (id = 0; id < ring_depth; id++) {
+        ring.slots[id].data = (int *) malloc(sizeof(int) * batch_elems);
+        ring.slots[id].prefix_sums = (long *) malloc(sizeof(long) * batch_elems);
+        if (ring.slots[id].data == NULL || ring.slots[id].prefix_sums == NULL) {
+            printf("Failed in malloc()\n");
+            printf(" - slot %d data: %p\n", id, ring.slots[id].data);
+            printf(" - slot %d prefix_sums: %p\n", id, ring.slots[id].prefix_sums);
+            exit(-2);
+        }
+        memset(ring.slots[id].data, 0, sizeof(int) * batch_elems);
+        memset(ring.slots[id].prefix_sums, 0, sizeof(long) * batch_elems);
+    }
+    pthread_mutex_init(&ring.lock, NULL);
+    pthread_cond_init(&ring.changed, NULL);
+
+    // set number of threads
+    omp_set_num_threads(num_threads);
+
+    suseconds_t *usecs = (suseconds_t *) malloc(sizeof(suseconds_t) * num_batches);
+    const char *mode_names[] = {"sequential", "pipelined"};
+    int errors = 0;
+
+    printf("Start ...\n");
+    fprintf(fp, "Start ...\n");
+
+    long sequential_checksum = 0;
+    for (int mode = 0; mode < 2; mode++) {
+        ring.produce_usec = ring.consume_usec = 0;
+        ring.checksum = 0;
+        ring.errors = 0;
+        for (id = 0; id < ring_depth; id++)
+            ring.slots[id].state = SLOT_EMPTY;
+        if (input)
+            rewind(input);
+
+        struct timeval scan_start, scan_end;
+        suseconds_t scan_usec = 0;
+        pthread_t producer, consumer;
+
+        gettimeofday(&start_time, NULL);
+        if (mode == 1) {
+            pthread_create(&producer, NULL, producer_thread, &ring);
+            pthread_create(&consumer, NULL, consumer_thread, &ring);
+        }
+        for (int k = 0; k < num_batches; k++) {
+            slot_t *slot;
+            if (mode == 0) {
+                slot = &ring.slots[0];
+                gettimeofday(&scan_start, NULL);
+                produce(&ring, slot->data, k);
+                gettimeofday(&scan_end, NULL);
+                ring.produce_usec += usec(scan_start, scan_end);
+            } else {
+                slot = ring_wait(&ring, k, SLOT_FILLED);
+            }
+
+            gettimeofday(&scan_start, NULL);
+            scan_i32_i64(ctx, slot->data, slot->prefix_sums, batch_elems);
+            gettimeofday(&scan_end, NULL);
+            usecs[k] = usec(scan_start, scan_end);
+            scan_usec += usecs[k];
+
+            if (mode == 0) {
+                gettimeofday(&scan_start, NULL);
+                consume(&ring, slot, k);
+                gettimeofday(&scan_end, NULL);
+                ring.consume_usec += usec(scan_start, scan_end);
+            } else {
+                ring_set(&ring, slot, SLOT_SCANNED);
+            }
+        }
+        if (mode == 1) {
+            pthread_join(producer, NULL);
+            pthread_join(consumer, NULL);
+        }
+        gettimeofday(&end_time, NULL);
+
+        suseconds_t total_usec = usec(start_time, end_time);
+        double elems = (double) batch_elems * num_batches;
+        printf("%-10s: end-to-end %d (usec), %.1f Melems/s; busy produce %d, scan %d (std %f per batch), consume %d (usec); checksum %ld\n",
+                mode_names[mode], total_usec, total_usec > 0 ? elems / total_usec : 0.0,
+                ring.produce_usec, scan_usec, calculate_standard_deviation(usecs, num_batches),
+                ring.consume_usec, ring.checksum);
+        fprintf(fp, "%-10s: end-to-end %d (usec), %.1f Melems/s; busy produce %d, scan %d (std %f per batch), consume %d (usec); checksum %ld\n",
+                mode_names[mode], total_usec, total_usec > 0 ? elems / total_usec : 0.0,
+                ring.produce_usec, scan_usec, calculate_standard_deviation(usecs, num_batches),
+                ring.consume_usec, ring.checksum);
+        errors += ring.errors;
+
+        // both runs see the same batches, so a lost or repeated hand-off
+        // shows up as a different checksum
+        if (mode == 0) {
+            sequential_checksum = ring.checksum;
+        } else if (ring.checksum != sequential_checksum) {
+            printf("Wrong pipelined implementation: checksum %ld, sequential checksum %ld\n",
+                    ring.checksum, sequential_checksum);
+            errors++;
+        }
+    }
+
+    printf("Finish OpenMP Pipelined Prefix Sum\n");
+    fprintf(fp, "Finish OpenMP Pipelined Prefix Sum\n");
+
+    pthread_mutex_destroy(&ring.lock);
+    pthread_cond_destroy(&ring.changed);
+    for (id = 0; id < ring_depth; id++) {
+        free(ring.slots[id].data);
+        free(ring.slots[id].prefix_sums);
+    }
+    free(ring.slots);
+    scan_ctx_destroy(ctx);
+    free(usecs);
+    if (input)
+        fclose(input);
+
+    fclose(fp);
+
+    return errors ? -1 : 0;
+}
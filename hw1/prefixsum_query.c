@@ -0,0 +1,455 @@
+/*
+ * prefixsum_query.c
+ *
+ * Description: Range-sum query engine on top of the prefix sums of a sequence
+ * of randomly generated integers. sum(data[l..r]) is answered as
+ * prefix_sums[r] - prefix_sums[l-1] for large batches of queries using
+ * OpenMP.
+ *
+ * Procedure:
+ * 1. All the threads generate num_elems random integers (in parallel OpenMP
+ *    region) and build the prefix sums once with the chunked parallel scan of
+ *    prefixsum_omp.c;
+ * 2. A batch of num_queries queries is generated, either uniform over the
+ *    array or skewed (left ends concentrated at the front of the array and
+ *    short ranges);
+ * 3. The batch is answered three ways, each timed separately:
+ *    - direct: every thread answers a slice of the batch in query order;
+ *    - prefetch: the same with the two loads of query q+PREFETCH_DIST
+ *      prefetched while query q is answered;
+ *    - bucketed: every query is split in its two lookups (r and l-1), the
+ *      lookups are counting-sorted by position bucket (per-thread histograms,
+ *      a scan of the histograms and a scatter, the same pattern as the prefix
+ *      sum itself), resolved in position order so every bucket of
+ *      prefix_sums is streamed through the cache once, and the two halves of
+ *      every query are subtracted in query order.
+ * 4. Queries per second are reported for every mode and distribution.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <omp.h>
+
+#include "prefixsum.h"
+
+#define MAX_INT 2147483647
+#define BUCKET_SHIFT 15         // 32K prefix sums (256 KB) per bucket
+#define PREFETCH_DIST 16        // queries ahead to prefetch
+#define SKEW_EXPONENT 4.0       // l = N * u^SKEW_EXPONENT for skewed queries
+#define NUM_MODES 3
+#define NUM_DISTS 2
+//#define PRINT_PREFIXSUM
+#define VERIFY
+
+// usec: calculate the time interval in microseconds
+inline suseconds_t usec(struct timeval start, struct timeval end)
+{
+  return ((double) (((end.tv_sec * 1000000 + end.tv_usec) -
+                     (start.tv_sec * 1000000 + start.tv_usec))));
+}
+
+double calculate_standard_deviation(suseconds_t *data, int n) {
+    double mean = 0.0;
+    double variance = 0.0;
+    double std_dev = 0.0;
+
+    for (int i = 0; i < n; i++) {
+        mean += (double)data[i];
+    }
+    mean /= n;
+
+    for (int i = 0; i < n; i++) {
+        variance += (data[i] - mean) * (data[i] - mean);
+    }
+    variance /= n;
+
+    std_dev = sqrt(variance);
+
+    return std_dev;
+}
+
+// query_direct: answer the queries in their own order
+void query_direct(long *prefix_sums, int *ls, int *rs, long *answers,
+                  int num_queries)
+{
+    int q;
+    #pragma omp parallel for schedule(static)
+    for (q = 0; q < num_queries; q++) {
+        int l = ls[q];
+        answers[q] = prefix_sums[rs[q]] - (l > 0 ? prefix_sums[l-1] : 0);
+    }
+}
+
+// query_prefetch: answer the queries in their own order, prefetching the
+// prefix sums of the queries PREFETCH_DIST ahead
+void query_prefetch(long *prefix_sums, int *ls, int *rs, long *answers,
+                    int num_queries)
+{
+    #pragma omp parallel
+    {
+        int num_threads = omp_get_num_threads();
+        int tid = omp_get_thread_num();
+        int start = (long) num_queries * tid / num_threads;
+        int end = (long) num_queries * (tid + 1) / num_threads;
+        int q;
+        for (q = start; q < end; q++) {
+            if (q + PREFETCH_DIST < end) {
+                int lp = ls[q + PREFETCH_DIST];
+                __builtin_prefetch(&prefix_sums[rs[q + PREFETCH_DIST]], 0, 0);
+                __builtin_prefetch(&prefix_sums[lp > 0 ? lp - 1 : 0], 0, 0);
+            }
+            int l = ls[q];
+            answers[q] = prefix_sums[rs[q]] - (l > 0 ? prefix_sums[l-1] : 0);
+        }
+    }
+}
+
+// query_bucketed: split every query in its two lookups, counting-sort them by
+// position bucket and resolve them in position order. lookup slot 2q holds
+// prefix(l-1) and slot 2q+1 holds prefix(r) of query q. The scratch arrays
+// hold 2 * num_queries entries, hists holds num_threads * num_buckets.
+void query_bucketed(long *prefix_sums, int num_elems, int *ls, int *rs,
+                    long *answers, int num_queries, int *sorted_pos,
+                    int *sorted_slots, long *halves, int *hists)
+{
+    int num_lookups = 2 * num_queries;
+    int num_buckets = ((num_elems - 1) >> BUCKET_SHIFT) + 1;
+
+    #pragma omp parallel
+    {
+        int num_threads = omp_get_num_threads();
+        int tid = omp_get_thread_num();
+        int start = (long) num_lookups * tid / num_threads;
+        int end = (long) num_lookups * (tid + 1) / num_threads;
+        int *hist = hists + (long) tid * num_buckets;
+        int k, b, t;
+
+        // lookup position, -1 for the empty prefix before element 0
+        #define LOOKUP_POS(k) ((k) & 1 ? rs[(k) >> 1] : ls[(k) >> 1] - 1)
+
+        // 1. per-thread histogram of the position buckets
+        memset(hist, 0, sizeof(int) * num_buckets);
+        for (k = start; k < end; k++) {
+            int pos = LOOKUP_POS(k);
+            hist[pos < 0 ? 0 : pos >> BUCKET_SHIFT]++;
+        }
+        #pragma omp barrier
+
+        // 2. exclusive scan of the histograms in (bucket, thread) order; each
+        //    thread scans a range of buckets, then the bucket range totals are
+        //    scanned and added back
+        int b_start = (long) num_buckets * tid / num_threads;
+        int b_end = (long) num_buckets * (tid + 1) / num_threads;
+        int offset = 0;
+        for (b = b_start; b < b_end; b++) {
+            for (t = 0; t < num_threads; t++) {
+                int count = hists[(long) t * num_buckets + b];
+                hists[(long) t * num_buckets + b] = offset;
+                offset += count;
+            }
+        }
+        halves[tid] = offset;   // halves is free until step 4
+        #pragma omp barrier
+        int base = 0;
+        for (t = 0; t < tid; t++)
+            base += halves[t];
+        for (b = b_start; b < b_end; b++)
+            for (t = 0; t < num_threads; t++)
+                hists[(long) t * num_buckets + b] += base;
+        #pragma omp barrier
+
+        // 3. scatter the lookups of this thread to their sorted slots
+        for (k = start; k < end; k++) {
+            int pos = LOOKUP_POS(k);
+            int dst = hist[pos < 0 ? 0 : pos >> BUCKET_SHIFT]++;
+            sorted_pos[dst] = pos;
+            sorted_slots[dst] = k;
+        }
+        #pragma omp barrier
+        #undef LOOKUP_POS
+
+        // 4. resolve the lookups in position order
+        for (k = start; k < end; k++) {
+            if (k + PREFETCH_DIST < end) {
+                int pp = sorted_pos[k + PREFETCH_DIST];
+                __builtin_prefetch(&prefix_sums[pp < 0 ? 0 : pp], 0, 0);
+            }
+            int pos = sorted_pos[k];
+            halves[sorted_slots[k]] = pos < 0 ? 0 : prefix_sums[pos];
+        }
+        #pragma omp barrier
+
+        // 5. combine the two halves of every query
+        int q;
+        #pragma omp for schedule(static)
+        for (q = 0; q < num_queries; q++)
+            answers[q] = halves[2 * q + 1] - halves[2 * q];
+    }
+}
+
+// generate_queries: uniform (skewed == 0) or skewed queries, in parallel
+void generate_queries(int *ls, int *rs, int num_queries, int num_elems,
+                      int skewed)
+{
+    #pragma omp parallel
+    {
+        unsigned int seed = omp_get_thread_num() * 7919 + time(NULL);
+        int max_len = num_elems / 1000 > 0 ? num_elems / 1000 : 1;
+        int q;
+        #pragma omp for schedule(static)
+        for (q = 0; q < num_queries; q++) {
+            int l, r;
+            if (skewed) {
+                double u = (double) rand_r(&seed) / RAND_MAX;
+                l = (int) (num_elems * pow(u, SKEW_EXPONENT));
+                if (l >= num_elems)
+                    l = num_elems - 1;
+                r = l + rand_r(&seed) % max_len;
+                if (r >= num_elems)
+                    r = num_elems - 1;
+            } else {
+                l = rand_r(&seed) % num_elems;
+                r = rand_r(&seed) % num_elems;
+                if (l > r) { int tmp = l; l = r; r = tmp; }
+            }
+            ls[q] = l;
+            rs[q] = r;
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int num_elems = 0;
+    int num_queries = 0;
+    int num_iters = 0;
+    int num_threads = 0;
+
+    int *data = NULL;
+    long *prefix_sums = NULL;
+    scan_ctx_t *ctx = NULL;
+
+    struct timeval start_time, end_time;  // for gettimeofday to calculate timing
+
+    char filename[256] = "prefixsum_query_";
+    FILE *fp = NULL;
+
+    if (argc < 5) {
+        printf("Usage: %s [num_elems] [num_queries] [num_iters] [num_threads]\n", argv[0]);
+        printf("    - num_elems:  number of elements\n");
+        printf("    - num_queries: number of range queries per batch\n");
+        printf("    - num_iters: number of iterations\n");
+        printf("    - num_threads: number of threads\n");
+        exit(-1);
+    }
+
+    num_elems = atoi(argv[1]);
+    num_queries = atoi(argv[2]);
+    num_iters = atoi(argv[3]);
+    num_threads = atoi(argv[4]);
+
+    if (num_threads < 1) {
+        printf("Number of threads should be more than one!\n");
+        exit(-1);
+    }
+    if (num_elems < 1 || num_queries < 1 || num_iters < 1) {
+        printf("Number of elements, queries and iterations should be positive!\n");
+        exit(-1);
+    }
+
+    strcat(filename, argv[1]);
+    strcat(filename, "elems_");
+    strcat(filename, argv[2]);
+    strcat(filename, "queries_");
+    strcat(filename, argv[3]);
+    strcat(filename, "iters_");
+    strcat(filename, argv[4]);
+    strcat(filename, "threads.txt");
+
+    fp = fopen(filename, "w");
+    if (fp) {
+        printf("Command line: %s %d %d %d %d\n",
+                argv[0], num_elems, num_queries, num_iters, num_threads);
+        printf("Stats file: %s\n\n", filename);
+        fprintf(fp, "Command line: %s %d %d %d %d\n",
+                argv[0], num_elems, num_queries, num_iters, num_threads);
+        fprintf(fp, "Stats file: %s\n\n", filename);
+    } else {
+        printf("ERROR: can't open the file %s!\n", filename);
+        exit(-1);
+    }
+
+    // data partition and allocation
+    int num_elems_mean = num_elems / num_threads;
+    int num_elems_remain = num_elems % num_threads;
+    // starting and ending IDs of data partition for each thread
+    int *starts;
+    int *ends;
+    starts = (int *) malloc(sizeof(int) * num_threads);
+    ends = (int *) malloc(sizeof(int) * num_threads);
+    int id;
+    for (id = 0; id < num_threads; id++) {
+        if (id < num_elems_remain) {
+            starts[id] = id * (num_elems_mean + 1);
+            ends[id] = starts[id] + (num_elems_mean + 1);
+        } else {
+            starts[id] = id * num_elems_mean + num_elems_remain;
+            ends[id] = starts[id] + num_elems_mean;
+        }
+    }
+
+    // Memory allocation
+    int num_buckets = ((num_elems - 1) >> BUCKET_SHIFT) + 1;
+    data = (int *) malloc(sizeof(int) * num_elems);
+    prefix_sums = (long *) malloc(sizeof(long) * num_elems);
+    ctx = scan_ctx_create(num_threads);
+    int *ls = (int *) malloc(sizeof(int) * num_queries);
+    int *rs = (int *) malloc(sizeof(int) * num_queries);
+    long *answers[NUM_MODES];
+    int mode;
+    for (mode = 0; mode < NUM_MODES; mode++)
+        answers[mode] = (long *) malloc(sizeof(long) * num_queries);
+    int *sorted_pos = (int *) malloc(sizeof(int) * 2 * num_queries);
+    int *sorted_slots = (int *) malloc(sizeof(int) * 2 * num_queries);
+    long *halves = (long *) malloc(sizeof(long) *
+            (2 * num_queries > num_threads ? 2 * num_queries : num_threads));
+    int *hists = (int *) malloc(sizeof(int) * num_buckets * num_threads);
+    suseconds_t *usecs = (suseconds_t *) malloc(sizeof(suseconds_t) * num_iters);
+    if (data == NULL || prefix_sums == NULL || ctx == NULL ||
+        ls == NULL || rs == NULL || answers[0] == NULL || answers[1] == NULL ||
+        answers[2] == NULL || sorted_pos == NULL || sorted_slots == NULL ||
+        halves == NULL || hists == NULL || usecs == NULL) {
+        printf("Failed in malloc()\n");
+        printf(" - data: %p\n", data);
+        printf(" - prefix_sums: %p\n", prefix_sums);
+        printf(" - sorted_pos: %p\n", sorted_pos);
+        printf(" - halves: %p\n", halves);
+        exit(-2);
+    }
+
+    // set number of threads
+    omp_set_num_threads(num_threads);
+
+    // Generate random ints in parallel
+    int K = MAX_INT / num_elems;
+
+    #pragma omp parallel shared(starts, ends, K, data)
+    {
+        // get the local thread ID
+        int tid = omp_get_thread_num();
+        srand(tid + time(NULL));  // Seed rand function
+
+        int start = starts[tid];
+        int end = ends[tid];
+
+        int i;
+        for (i = start; i < end; i++) {
+            data[i] = rand() % K;
+        }
+    }
+
+    printf("Start ...\n");
+    fprintf(fp, "Start ...\n");
+
+    suseconds_t scan_usec;
+    gettimeofday(&start_time, NULL);
+    scan_i32_i64(ctx, data, prefix_sums, num_elems);
+    gettimeofday(&end_time, NULL);
+    scan_usec = usec(start_time, end_time);
+    printf("prefix sum build elapsed time: %d (usec)\n\n", scan_usec);
+    fprintf(fp, "prefix sum build elapsed time: %d (usec)\n\n", scan_usec);
+
+    const char *mode_names[NUM_MODES] = {"direct", "prefetch", "bucketed"};
+    const char *dist_names[NUM_DISTS] = {"uniform", "skewed"};
+    int dist, iter, q;
+    for (dist = 0; dist < NUM_DISTS; dist++) {
+        generate_queries(ls, rs, num_queries, num_elems, dist);
+
+        for (mode = 0; mode < NUM_MODES; mode++) {
+            suseconds_t total_usec = 0;
+            for (iter = 0; iter < num_iters; iter++) {
+                gettimeofday(&start_time, NULL);
+                if (mode == 0) {
+                    query_direct(prefix_sums, ls, rs, answers[mode], num_queries);
+                } else if (mode == 1) {
+                    query_prefetch(prefix_sums, ls, rs, answers[mode], num_queries);
+                } else {
+                    query_bucketed(prefix_sums, num_elems, ls, rs, answers[mode],
+                                   num_queries, sorted_pos, sorted_slots,
+                                   halves, hists);
+                }
+                gettimeofday(&end_time, NULL);
+                usecs[iter] = usec(start_time, end_time);
+                total_usec += usecs[iter];
+            }
+
+            suseconds_t avg_usec = total_usec / num_iters;
+            double qps = avg_usec > 0 ? (double) num_queries * 1e6 / avg_usec : 0.0;
+            printf("%s queries, %s: %d (usec, std %f), %.3e queries/s\n",
+                    dist_names[dist], mode_names[mode], avg_usec,
+                    calculate_standard_deviation(usecs, num_iters), qps);
+            fprintf(fp, "%s queries, %s: %d (usec, std %f), %.3e queries/s\n",
+                    dist_names[dist], mode_names[mode], avg_usec,
+                    calculate_standard_deviation(usecs, num_iters), qps);
+        }
+
+        for (q = 0; q < num_queries; q++) {
+            if (answers[1][q] != answers[0][q] || answers[2][q] != answers[0][q]) {
+                printf("Wrong range query implementation: query %d [%d, %d], direct %ld, prefetch %ld, bucketed %ld\n",
+                        q, ls[q], rs[q], answers[0][q], answers[1][q], answers[2][q]);
+                exit(-1);
+            }
+        }
+    }
+
+    printf("Finish Range Query benchmark\n\n");
+    fprintf(fp, "Finish Range Query benchmark\n\n");
+
+    int i;
+#ifdef PRINT_PREFIXSUM
+    fprintf(fp, "\nQueries:");
+    for (q = 0; q < num_queries; q++) {
+        fprintf(fp, " [%d,%d]:%ld", ls[q], rs[q], answers[0][q]);
+    }
+    fprintf(fp, "\n");
+#endif // #ifdef PRINT_PREFIXSUM
+
+#ifdef VERIFY
+    // direct summation of the first queries of the last (short range) batch
+    for (q = 0; q < num_queries && q < 1000; q++) {
+        long sum = 0;
+        for (i = ls[q]; i <= rs[q]; i++)
+            sum += data[i];
+        if (sum != answers[0][q]) {
+            printf("Wrong range query implementation: query %d [%d, %d], true sum: %ld, computed sum: %ld\n",
+                    q, ls[q], rs[q], sum, answers[0][q]);
+            exit(-1);
+        }
+    }
+#endif // #ifdef VERIFY
+
+    // free the allocated memory
+    free(starts);
+    free(ends);
+    free(data);
+    free(prefix_sums);
+    scan_ctx_destroy(ctx);
+    free(ls);
+    free(rs);
+    for (mode = 0; mode < NUM_MODES; mode++)
+        free(answers[mode]);
+    free(sorted_pos);
+    free(sorted_slots);
+    free(halves);
+    free(hists);
+    free(usecs);
+
+    fclose(fp);
+
+    return 0;
+}
@@ -0,0 +1,286 @@
+/*
+ * prefixsum_queue.c
+ *
+ * Description: The scan queue of libprefixsum (prefixsum.h). Requests are
+ * kept in FIFO order in a linked list under one mutex. The dispatcher
+ * thread takes either the large request at the head, which it runs with
+ * scan_i32_i64 and the whole team, or the run of small requests at the head,
+ * which it runs in one parallel loop over the requests. A run of small
+ * requests is held back until it reaches batch_elems elements, a large
+ * request queues up behind it, or its oldest request has waited
+ * max_delay_usec.
+ */
+
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include <omp.h>
+
+#include "prefixsum.h"
+
+struct scan_future {
+    scan_queue_t *queue;
+    const int32_t *in;
+    int64_t *out;
+    size_t n;
+    long submitted_usec;
+    int status;
+    int done;
+    scan_future_t *next;
+};
+
+struct scan_queue {
+    scan_ctx_t *ctx;
+    size_t small_elems;
+    size_t batch_elems;
+    long max_delay_usec;
+
+    pthread_t dispatcher;
+    pthread_mutex_t lock;
+    pthread_cond_t submitted;   // the dispatcher waits for requests
+    pthread_cond_t completed;   // the callers wait for their futures
+    scan_future_t *head, *tail;
+    int stopping;
+
+    scan_future_t **batch;      // small requests of the current launch
+    size_t batch_capacity;
+    long num_requests;
+    long num_launches;
+};
+
+// now_usec: monotonic clock in microseconds
+static long now_usec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000L + ts.tv_nsec / 1000;
+}
+
+// run_small: the requests of one launch, each scanned by one thread
+static void run_small(scan_queue_t *queue, size_t count)
+{
+    long k;
+
+    #pragma omp parallel for schedule(dynamic, 1) \
+                         num_threads(scan_ctx_num_threads(queue->ctx)) if (count > 1)
+    for (k = 0; k < (long) count; k++) {
+        scan_future_t *future = queue->batch[k];
+        int64_t sum = 0;
+        for (size_t i = 0; i < future->n; i++) {
+            sum += future->in[i];
+            future->out[i] = sum;
+        }
+        future->status = SCAN_OK;
+    }
+}
+
+static void *dispatch(void *arg)
+{
+    scan_queue_t *queue = (scan_queue_t *) arg;
+    size_t count, elems, k;
+    scan_future_t *future;
+
+    pthread_mutex_lock(&queue->lock);
+    for (;;) {
+        while (queue->head == NULL && !queue->stopping)
+            pthread_cond_wait(&queue->submitted, &queue->lock);
+        if (queue->head == NULL)
+            break;
+
+        // a large request runs alone
+        future = queue->head;
+        if (future->n >= queue->small_elems) {
+            queue->head = future->next;
+            if (queue->head == NULL)
+                queue->tail = NULL;
+            queue->num_launches++;
+            pthread_mutex_unlock(&queue->lock);
+            future->status = scan_i32_i64(queue->ctx, future->in, future->out,
+                                          future->n);
+            pthread_mutex_lock(&queue->lock);
+            __atomic_store_n(&future->done, 1, __ATOMIC_RELEASE);
+            pthread_cond_broadcast(&queue->completed);
+            continue;
+        }
+
+        // the run of small requests at the head
+        count = elems = 0;
+        for (future = queue->head; future != NULL && future->n < queue->small_elems;
+             future = future->next) {
+            count++;
+            elems += future->n;
+        }
+        long deadline = queue->head->submitted_usec + queue->max_delay_usec;
+        if (elems < queue->batch_elems && future == NULL && !queue->stopping &&
+            now_usec() < deadline) {
+            struct timespec ts;
+            ts.tv_sec = deadline / 1000000;
+            ts.tv_nsec = (deadline % 1000000) * 1000;
+            pthread_cond_timedwait(&queue->submitted, &queue->lock, &ts);
+            continue;
+        }
+
+        if (count > queue->batch_capacity) {
+            scan_future_t **batch = (scan_future_t **) realloc(queue->batch,
+                                        sizeof(scan_future_t *) * count * 2);
+            if (batch == NULL) {
+                // run what fits, the rest stays queued
+                count = queue->batch_capacity;
+            } else {
+                queue->batch = batch;
+                queue->batch_capacity = count * 2;
+            }
+        }
+        if (count == 0) {
+            // not even one slot: fail the head request
+            future = queue->head;
+            queue->head = future->next;
+            if (queue->head == NULL)
+                queue->tail = NULL;
+            future->status = SCAN_ENOMEM;
+            __atomic_store_n(&future->done, 1, __ATOMIC_RELEASE);
+            pthread_cond_broadcast(&queue->completed);
+            continue;
+        }
+        for (k = 0; k < count; k++) {
+            queue->batch[k] = queue->head;
+            queue->head = queue->head->next;
+        }
+        if (queue->head == NULL)
+            queue->tail = NULL;
+        queue->num_launches++;
+        pthread_mutex_unlock(&queue->lock);
+
+        run_small(queue, count);
+
+        pthread_mutex_lock(&queue->lock);
+        for (k = 0; k < count; k++)
+            __atomic_store_n(&queue->batch[k]->done, 1, __ATOMIC_RELEASE);
+        pthread_cond_broadcast(&queue->completed);
+    }
+    pthread_mutex_unlock(&queue->lock);
+
+    return NULL;
+}
+
+scan_queue_t *scan_queue_create(scan_ctx_t *ctx, size_t small_elems,
+                                size_t batch_elems, long max_delay_usec)
+{
+    scan_queue_t *queue;
+    pthread_condattr_t attr;
+
+    if (ctx == NULL)
+        return NULL;
+    queue = (scan_queue_t *) calloc(1, sizeof(scan_queue_t));
+    if (queue == NULL)
+        return NULL;
+    queue->ctx = ctx;
+    queue->small_elems = small_elems;
+    queue->batch_elems = batch_elems;
+    queue->max_delay_usec = (max_delay_usec > 0) ? max_delay_usec : 0;
+
+    // the timed wait of the dispatcher is on the monotonic clock
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->submitted, &attr);
+    pthread_cond_init(&queue->completed, NULL);
+    pthread_condattr_destroy(&attr);
+
+    if (pthread_create(&queue->dispatcher, NULL, dispatch, queue) != 0) {
+        pthread_mutex_destroy(&queue->lock);
+        pthread_cond_destroy(&queue->submitted);
+        pthread_cond_destroy(&queue->completed);
+        free(queue);
+        return NULL;
+    }
+
+    return queue;
+}
+
+void scan_queue_destroy(scan_queue_t *queue)
+{
+    if (queue == NULL)
+        return;
+
+    pthread_mutex_lock(&queue->lock);
+    queue->stopping = 1;
+    pthread_cond_signal(&queue->submitted);
+    pthread_mutex_unlock(&queue->lock);
+    pthread_join(queue->dispatcher, NULL);
+
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->submitted);
+    pthread_cond_destroy(&queue->completed);
+    free(queue->batch);
+    free(queue);
+}
+
+scan_future_t *scan_queue_submit_i32_i64(scan_queue_t *queue,
+                                         const int32_t *in, int64_t *out,
+                                         size_t n)
+{
+    scan_future_t *future;
+
+    if (queue == NULL || (n > 0 && (in == NULL || out == NULL)))
+        return NULL;
+    future = (scan_future_t *) malloc(sizeof(scan_future_t));
+    if (future == NULL)
+        return NULL;
+    future->queue = queue;
+    future->in = in;
+    future->out = out;
+    future->n = n;
+    future->submitted_usec = now_usec();
+    future->status = SCAN_OK;
+    future->done = 0;
+    future->next = NULL;
+
+    pthread_mutex_lock(&queue->lock);
+    if (queue->tail != NULL)
+        queue->tail->next = future;
+    else
+        queue->head = future;
+    queue->tail = future;
+    queue->num_requests++;
+    pthread_cond_signal(&queue->submitted);
+    pthread_mutex_unlock(&queue->lock);
+
+    return future;
+}
+
+void scan_queue_stats(scan_queue_t *queue, long *num_requests,
+                      long *num_launches)
+{
+    pthread_mutex_lock(&queue->lock);
+    if (num_requests != NULL)
+        *num_requests = queue->num_requests;
+    if (num_launches != NULL)
+        *num_launches = queue->num_launches;
+    pthread_mutex_unlock(&queue->lock);
+}
+
+int scan_future_ready(const scan_future_t *future)
+{
+    return __atomic_load_n(&future->done, __ATOMIC_ACQUIRE);
+}
+
+int scan_future_wait(scan_future_t *future)
+{
+    scan_queue_t *queue;
+    int status;
+
+    if (future == NULL)
+        return SCAN_EINVAL;
+    queue = future->queue;
+    if (!scan_future_ready(future)) {
+        pthread_mutex_lock(&queue->lock);
+        while (!future->done)
+            pthread_cond_wait(&queue->completed, &queue->lock);
+        pthread_mutex_unlock(&queue->lock);
+    }
+    status = future->status;
+    free(future);
+
+    return status;
+}
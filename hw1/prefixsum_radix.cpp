@@ -0,0 +1,379 @@
+/*
+ * prefixsum_radix.cpp
+ *
+ * Description: Parallel LSD radix sort of 32-bit and 64-bit keys using
+ * OpenMP, with the digit offsets of every thread computed by the chunked
+ * scan of prefixsum_omp.c.
+ *
+ * Procedure (one pass per RADIX_BITS digit, least significant first):
+ * 1. Every thread builds the digit histogram of its partition and stores it
+ *    digit-major, counts[d * num_threads + tid];
+ * 2. The counts are scanned with scan_i32_i64 of libprefixsum, the chunked
+ *    scan of prefixsum_omp.c: in digit-major order, the exclusive prefix of
+ *    counts[d * num_threads + tid] is where thread tid writes its first key
+ *    with digit d. A pass whose keys all share one digit is skipped;
+ * 3. Every thread scatters its keys through write-combining buffers: one
+ *    cache line per digit in L1, flushed to the destination with one copy
+ *    when full, so the scatter writes whole lines instead of one key at a
+ *    time into 2^RADIX_BITS streams;
+ * 4. The key-value variant moves a 32-bit value with every key.
+ *
+ * The sorts are timed against std::sort (one thread) and the throughput of
+ * the plain scan on the same number of ints.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/time.h>
+#include <omp.h>
+
+#include <algorithm>
+
+#include "prefixsum.h"
+
+#define RADIX_BITS 8
+#define RADIX (1 << RADIX_BITS)
+#define WC_BYTES 64             // one write-combining line per digit
+#define VERIFY
+
+// usec: calculate the time interval in microseconds
+inline suseconds_t usec(struct timeval start, struct timeval end)
+{
+  return ((double) (((end.tv_sec * 1000000 + end.tv_usec) -
+                     (start.tv_sec * 1000000 + start.tv_usec))));
+}
+
+double calculate_standard_deviation(suseconds_t *data, int n) {
+    double mean = 0.0;
+    double variance = 0.0;
+    double std_dev = 0.0;
+
+    for (int i = 0; i < n; i++) {
+        mean += (double)data[i];
+    }
+    mean /= n;
+
+    for (int i = 0; i < n; i++) {
+        variance += (data[i] - mean) * (data[i] - mean);
+    }
+    variance /= n;
+
+    std_dev = sqrt(variance);
+
+    return std_dev;
+}
+
+// splitmix64: counter-based generator, key i only depends on i
+static inline unsigned long splitmix64(unsigned long x)
+{
+    x += 0x9E3779B97F4A7C15UL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9UL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBUL;
+    return x ^ (x >> 31);
+}
+
+// partition_range: the num_elems_mean plus remainder split of prefixsum_omp.c
+void partition_range(int *starts, int *ends, int num_elems, int num_threads)
+{
+    int num_elems_mean = num_elems / num_threads;
+    int num_elems_remain = num_elems % num_threads;
+    for (int id = 0; id < num_threads; id++) {
+        if (id < num_elems_remain) {
+            starts[id] = id * (num_elems_mean + 1);
+            ends[id] = starts[id] + (num_elems_mean + 1);
+        } else {
+            starts[id] = id * num_elems_mean + num_elems_remain;
+            ends[id] = starts[id] + num_elems_mean;
+        }
+    }
+}
+
+// Scratch of the radix sort, allocated once per run
+typedef struct {
+    int num_threads;
+    int *starts, *ends;             // key partition
+    int *counts;                    // RADIX * num_threads, digit-major
+    long *offsets;                  // inclusive scan of counts
+    scan_ctx_t *scan;
+} radix_ctx_t;
+
+// radix_sort: sort keys (and values along when KV) by LSD passes; keys_tmp
+// and values_tmp are scratch arrays of the same size. The result is in keys
+template <typename K, typename V, bool KV>
+void radix_sort(radix_ctx_t *ctx, K *keys, K *keys_tmp, V *values, V *values_tmp)
+{
+    const int T = ctx->num_threads;
+    const int n = ctx->ends[T - 1];
+    const int WC = WC_BYTES / sizeof(K);
+    int passes = 0;
+
+    for (int shift = 0; shift < (int) (8 * sizeof(K)); shift += RADIX_BITS) {
+        // 1. digit histograms
+        #pragma omp parallel
+        {
+            int tid = omp_get_thread_num();
+            int local[RADIX] = {0};
+            for (int i = ctx->starts[tid]; i < ctx->ends[tid]; i++)
+                local[(keys[i] >> shift) & (RADIX - 1)]++;
+            for (int d = 0; d < RADIX; d++)
+                ctx->counts[d * T + tid] = local[d];
+        }
+
+        // 2. per-thread digit offsets by the chunked scan
+        scan_i32_i64(ctx->scan, ctx->counts, ctx->offsets, RADIX * T);
+        bool skip = false;
+        for (int d = 0; d < RADIX && !skip; d++) {
+            long before = (d == 0) ? 0 : ctx->offsets[d * T - 1];
+            skip = (ctx->offsets[d * T + T - 1] - before == n);
+        }
+        if (skip)
+            continue;
+
+        // 3. scatter through write-combining buffers
+        #pragma omp parallel
+        {
+            int tid = omp_get_thread_num();
+            alignas(64) K key_buf[RADIX][WC_BYTES / sizeof(K)];
+            alignas(64) V value_buf[KV ? RADIX : 1][WC_BYTES / sizeof(K)];
+            long pos[RADIX];
+            int fill[RADIX];
+            for (int d = 0; d < RADIX; d++) {
+                pos[d] = ctx->offsets[d * T + tid] - ctx->counts[d * T + tid];
+                fill[d] = 0;
+            }
+
+            for (int i = ctx->starts[tid]; i < ctx->ends[tid]; i++) {
+                K key = keys[i];
+                int d = (key >> shift) & (RADIX - 1);
+                key_buf[d][fill[d]] = key;
+                if (KV)
+                    value_buf[KV ? d : 0][fill[d]] = values[i];
+                if (++fill[d] == WC) {
+                    memcpy(keys_tmp + pos[d], key_buf[d], WC * sizeof(K));
+                    if (KV)
+                        memcpy(values_tmp + pos[d], value_buf[KV ? d : 0], WC * sizeof(V));
+                    pos[d] += WC;
+                    fill[d] = 0;
+                }
+            }
+            for (int d = 0; d < RADIX; d++) {
+                memcpy(keys_tmp + pos[d], key_buf[d], fill[d] * sizeof(K));
+                if (KV)
+                    memcpy(values_tmp + pos[d], value_buf[KV ? d : 0], fill[d] * sizeof(V));
+            }
+        }
+
+        std::swap(keys, keys_tmp);
+        if (KV)
+            std::swap(values, values_tmp);
+        passes++;
+    }
+
+    // an odd number of passes leaves the result in the scratch arrays
+    if (passes % 2 == 1) {
+        #pragma omp parallel
+        {
+            int tid = omp_get_thread_num();
+            int start = ctx->starts[tid];
+            int len = ctx->ends[tid] - start;
+            memcpy(keys_tmp + start, keys + start, len * sizeof(K));
+            if (KV)
+                memcpy(values_tmp + start, values + start, len * sizeof(V));
+        }
+    }
+}
+
+// bench_sort: time num_iters radix sorts and std::sorts of the keys;
+// prints and returns 0 when both agree (and, for KV, the values are the
+// stable permutation of the input)
+template <typename K, bool KV>
+int bench_sort(const char *name, radix_ctx_t *ctx, int num_iters, FILE *fp,
+               suseconds_t *usecs)
+{
+    int n = ctx->ends[ctx->num_threads - 1];
+    K *input = new K[n];
+    K *keys = new K[n];
+    K *keys_tmp = new K[n];
+    K *reference = new K[n];
+    unsigned *values = new unsigned[KV ? n : 1];
+    unsigned *values_tmp = new unsigned[KV ? n : 1];
+    struct timeval start_time, end_time;
+
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++) {
+        input[i] = (K) splitmix64(i);
+        keys[i] = keys_tmp[i] = reference[i] = 0;
+        if (KV)
+            values[i] = values_tmp[i] = 0;
+    }
+
+    suseconds_t radix_total = 0, std_total = 0;
+    for (int iter = 0; iter < num_iters; iter++) {
+        memcpy(keys, input, n * sizeof(K));
+        if (KV)
+            for (int i = 0; i < n; i++)
+                values[i] = i;
+        gettimeofday(&start_time, NULL);
+        radix_sort<K, unsigned, KV>(ctx, keys, keys_tmp, values, values_tmp);
+        gettimeofday(&end_time, NULL);
+        usecs[iter] = usec(start_time, end_time);
+        radix_total += usecs[iter];
+    }
+    double radix_std = calculate_standard_deviation(usecs, num_iters);
+
+    for (int iter = 0; iter < num_iters; iter++) {
+        memcpy(reference, input, n * sizeof(K));
+        gettimeofday(&start_time, NULL);
+        std::sort(reference, reference + n);
+        gettimeofday(&end_time, NULL);
+        usecs[iter] = usec(start_time, end_time);
+        std_total += usecs[iter];
+    }
+
+    suseconds_t radix_avg = radix_total / num_iters;
+    suseconds_t std_avg = std_total / num_iters;
+    printf("%-14s radix sort: %d (usec), std %f, %.1f Mkeys/s; std::sort: %d (usec), %.1f Mkeys/s; speedup %.2fx\n",
+            name, radix_avg, radix_std, radix_avg > 0 ? (double) n / radix_avg : 0.0,
+            std_avg, std_avg > 0 ? (double) n / std_avg : 0.0,
+            radix_avg > 0 ? (double) std_avg / radix_avg : 0.0);
+    fprintf(fp, "%-14s radix sort: %d (usec), std %f, %.1f Mkeys/s; std::sort: %d (usec), %.1f Mkeys/s; speedup %.2fx\n",
+            name, radix_avg, radix_std, radix_avg > 0 ? (double) n / radix_avg : 0.0,
+            std_avg, std_avg > 0 ? (double) n / std_avg : 0.0,
+            radix_avg > 0 ? (double) std_avg / radix_avg : 0.0);
+
+    int error = -1;
+#ifdef VERIFY
+    for (int i = 0; i < n && error < 0; i++) {
+        if (keys[i] != reference[i])
+            error = i;
+        else if (KV && (input[values[i]] != keys[i] ||
+                        (i > 0 && keys[i] == keys[i-1] && values[i] <= values[i-1])))
+            error = i;
+    }
+    if (error >= 0)
+        printf("Wrong %s radix sort implementation: error at position %d\n", name, error);
+#endif // #ifdef VERIFY
+
+    delete[] input;
+    delete[] keys;
+    delete[] keys_tmp;
+    delete[] reference;
+    delete[] values;
+    delete[] values_tmp;
+    return error >= 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int num_elems = 0;
+    int num_iters = 0;
+    int num_threads = 0;
+
+    struct timeval start_time, end_time;  // for gettimeofday to calculate timing
+
+    char filename[256] = "prefixsum_radix_";
+    FILE *fp = NULL;
+
+    if (argc < 4) {
+        printf("Usage: %s [num_elems] [num_iters] [num_threads]\n", argv[0]);
+        printf("    - num_elems:  number of elements\n");
+        printf("    - num_iters: number of iterations\n");
+        printf("    - num_threads: number of threads\n");
+        exit(-1);
+    }
+
+    num_elems = atoi(argv[1]);
+    num_iters = atoi(argv[2]);
+    num_threads = atoi(argv[3]);
+
+    if (num_threads < 1) {
+        printf("Number of threads should be more than one!\n");
+        exit(-1);
+    }
+    if (num_elems < 1 || num_iters < 1) {
+        printf("Number of elements and iterations should be positive!\n");
+        exit(-1);
+    }
+
+    strcat(filename, argv[1]);
+    strcat(filename, "elems_");
+    strcat(filename, argv[2]);
+    strcat(filename, "iters_");
+    strcat(filename, argv[3]);
+    strcat(filename, "threads.txt");
+
+    fp = fopen(filename, "w");
+    if (fp) {
+        printf("Command line: %s %d %d %d\n",
+                argv[0], num_elems, num_iters, num_threads);
+        printf("Stats file: %s\n\n", filename);
+        fprintf(fp, "Command line: %s %d %d %d\n",
+                argv[0], num_elems, num_iters, num_threads);
+        fprintf(fp, "Stats file: %s\n\n", filename);
+    } else {
+        printf("ERROR: can't open the file %s!\n", filename);
+        exit(-1);
+    }
+
+    // set number of threads
+    omp_set_num_threads(num_threads);
+
+    radix_ctx_t ctx;
+    ctx.num_threads = num_threads;
+    ctx.starts = new int[num_threads];
+    ctx.ends = new int[num_threads];
+    ctx.counts = new int[RADIX * num_threads];
+    ctx.offsets = new long[RADIX * num_threads];
+    ctx.scan = scan_ctx_create(num_threads);
+    partition_range(ctx.starts, ctx.ends, num_elems, num_threads);
+    suseconds_t *usecs = new suseconds_t[num_iters];
+
+    printf("Start ...\n");
+    fprintf(fp, "Start ...\n");
+
+    // throughput of the plain scan on the same number of ints
+    int *data = new int[num_elems];
+    long *prefix_sums = new long[num_elems];
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < num_elems; i++) {
+        data[i] = (int) (splitmix64(i) % 1000);
+        prefix_sums[i] = 0;
+    }
+    suseconds_t scan_total = 0;
+    for (int iter = 0; iter < num_iters; iter++) {
+        gettimeofday(&start_time, NULL);
+        scan_i32_i64(ctx.scan, data, prefix_sums, num_elems);
+        gettimeofday(&end_time, NULL);
+        scan_total += usec(start_time, end_time);
+    }
+    printf("%-14s scan: %d (usec), %.1f Melems/s\n", "int32",
+            scan_total / num_iters,
+            scan_total > 0 ? (double) num_elems * num_iters / scan_total : 0.0);
+    fprintf(fp, "%-14s scan: %d (usec), %.1f Melems/s\n", "int32",
+            scan_total / num_iters,
+            scan_total > 0 ? (double) num_elems * num_iters / scan_total : 0.0);
+    delete[] data;
+    delete[] prefix_sums;
+
+    int errors = 0;
+    errors += bench_sort<unsigned, false>("uint32", &ctx, num_iters, fp, usecs);
+    errors += bench_sort<unsigned long, false>("uint64", &ctx, num_iters, fp, usecs);
+    errors += bench_sort<unsigned, true>("uint32+value", &ctx, num_iters, fp, usecs);
+    errors += bench_sort<unsigned long, true>("uint64+value", &ctx, num_iters, fp, usecs);
+
+    printf("Finish OpenMP Parallel Radix Sort\n");
+    fprintf(fp, "Finish OpenMP Parallel Radix Sort\n");
+
+    delete[] ctx.starts;
+    delete[] ctx.ends;
+    delete[] ctx.counts;
+    delete[] ctx.offsets;
+    scan_ctx_destroy(ctx.scan);
+    delete[] usecs;
+
+    fclose(fp);
+
+    return errors ? -1 : 0;
+}
@@ -0,0 +1,398 @@
+/*
+ * prefixsum_repro.c
+ *
+ * Description: Bitwise-reproducible parallel prefix sums of a sequence of
+ * floating-point numbers using OpenMP. The output bits do not depend on the
+ * number of threads nor on the chunk size. Built as prefixsum_repro.exe for
+ * float and, with -DUSE_DOUBLE, as prefixsum_repro_double.exe for double.
+ *
+ * Procedure:
+ * 1. All the threads generate num_elems numbers in [0, 1) from a hash of the
+ *    element index (in parallel OpenMP region), so that every run and every
+ *    partition sees exactly the same inputs;
+ * 2. The maximum magnitude of the inputs is reduced (max is exact and does
+ *    not depend on the order). Together with num_elems it fixes a grid of
+ *    REPRO_BINS fixed-point bins, each coarse enough that the sum of all the
+ *    elements rounded to it is exact in a double;
+ * 3. Pre-rounding: every element is split exactly into one value per bin
+ *    (the high bin holds the element rounded to the bin grid, the next bin
+ *    the remainder rounded to a finer grid). Additions of the bin values are
+ *    exact, hence associative, so:
+ *    - each thread sums the bins of its chunks (in parallel OpenMP region);
+ *    - the chunk totals are scanned exactly;
+ *    - each thread rescans its chunks from their exact base and converts
+ *      every running bin prefix back to real_t (in parallel OpenMP region).
+ *    Every output is a deterministic function of the exact bin prefixes,
+ *    hence independent of how the array was partitioned.
+ * 4. The non-reproducible chunked scan of prefixsum_omp.c on the same data
+ *    is timed for comparison, and both are checked against a long double
+ *    reference. Finally every thread count from 1 to num_threads is run with
+ *    several chunk sizes and the output bits are compared.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <omp.h>
+
+#define DATA_SEED 20240501UL
+#define NUM_CHUNK_SIZES 3
+//#define PRINT_PREFIXSUM
+#define VERIFY
+
+#ifdef USE_DOUBLE
+typedef double real_t;
+#define REAL_NAME "double"
+#define REPRO_BINS 2            // two bins cover the 53 bits of a double
+#else
+typedef float real_t;
+#define REAL_NAME "float"
+#define REPRO_BINS 1
+#endif
+
+#include "repro.h"
+
+// usec: calculate the time interval in microseconds
+inline suseconds_t usec(struct timeval start, struct timeval end)
+{
+  return ((double) (((end.tv_sec * 1000000 + end.tv_usec) -
+                     (start.tv_sec * 1000000 + start.tv_usec))));
+}
+
+double calculate_standard_deviation(suseconds_t *data, int n) {
+    double mean = 0.0;
+    double variance = 0.0;
+    double std_dev = 0.0;
+
+    for (int i = 0; i < n; i++) {
+        mean += (double)data[i];
+    }
+    mean /= n;
+
+    for (int i = 0; i < n; i++) {
+        variance += (data[i] - mean) * (data[i] - mean);
+    }
+    variance /= n;
+
+    std_dev = sqrt(variance);
+
+    return std_dev;
+}
+
+static inline real_t generate_elem(long i)
+{
+    return (real_t) ((splitmix64(DATA_SEED + i) >> 11) * 0x1.0p-53);
+}
+
+// repro_scan: reproducible scan of data in chunks of chunk_size elements
+// using the current OpenMP thread team. chunk_bins holds REPRO_BINS doubles
+// per chunk.
+void repro_scan(real_t *data, real_t *prefix_sums, long num_elems,
+                long chunk_size, double *chunk_bins)
+{
+    long num_chunks = (num_elems + chunk_size - 1) / chunk_size;
+    double max_abs = 0.0;
+    repro_grid_t grid;
+    long c, i;
+
+    #pragma omp parallel for simd schedule(static) reduction(max:max_abs)
+    for (i = 0; i < num_elems; i++) {
+        double a = fabs((double) data[i]);
+        max_abs = a > max_abs ? a : max_abs;
+    }
+    repro_grid_init(&grid, max_abs, num_elems);
+
+    #pragma omp parallel shared(grid, data, prefix_sums, chunk_bins)
+    {
+        int k;
+
+        // 1. exact bin totals of every chunk
+        #pragma omp for schedule(static)
+        for (c = 0; c < num_chunks; c++) {
+            long start = c * chunk_size;
+            long end = start + chunk_size < num_elems ? start + chunk_size : num_elems;
+            repro_totals(&grid, data + start, end - start,
+                         &chunk_bins[c * REPRO_BINS]);
+        }
+
+        // 2. exact exclusive scan of the chunk totals
+        #pragma omp single
+        {
+            double carry[REPRO_BINS] = {0};
+            long cc;
+            for (cc = 0; cc < num_chunks; cc++) {
+                for (k = 0; k < REPRO_BINS; k++) {
+                    double total = chunk_bins[cc * REPRO_BINS + k];
+                    chunk_bins[cc * REPRO_BINS + k] = carry[k];
+                    carry[k] += total;
+                }
+            }
+        }
+
+        // 3. rescan every chunk from its exact base
+        #pragma omp for schedule(static)
+        for (c = 0; c < num_chunks; c++) {
+            long start = c * chunk_size;
+            long end = start + chunk_size < num_elems ? start + chunk_size : num_elems;
+            repro_rescan(&grid, data + start, prefix_sums + start, end - start,
+                         &chunk_bins[c * REPRO_BINS]);
+        }
+    }
+}
+
+// parallel_prefix_sum: non-reproducible chunked scan of prefixsum_omp.c
+void parallel_prefix_sum(real_t *data, real_t *prefix_sums, long num_elems,
+                         real_t *tmp_sums)
+{
+    #pragma omp parallel shared(data, prefix_sums, tmp_sums)
+    {
+        int num_threads = omp_get_num_threads();
+        int tid = omp_get_thread_num(); // get the local thread ID
+        long start = num_elems * tid / num_threads;
+        long end = num_elems * (tid + 1) / num_threads;
+        long i;
+        real_t sum = 0;
+        for (i = start; i < end; i++) {
+            sum += data[i];
+            prefix_sums[i] = sum;
+        }
+        tmp_sums[tid] = sum;
+        #pragma omp barrier
+        #pragma omp single
+        {
+            real_t carry = 0;
+            for (int ii = 0; ii < num_threads; ii++) {
+                real_t local = tmp_sums[ii];
+                tmp_sums[ii] = carry;
+                carry += local;
+            }
+        }
+        real_t base = tmp_sums[tid];
+        for (i = start; i < end; i++)
+            prefix_sums[i] += base;
+    }
+}
+
+// max_rel_error: maximum relative error against the long double reference
+double max_rel_error(real_t *prefix_sums, long double *reference, long num_elems)
+{
+    double max_rel_err = 0.0;
+    long i;
+    #pragma omp parallel for reduction(max:max_rel_err)
+    for (i = 0; i < num_elems; i++) {
+        if (reference[i] != 0) {
+            double rel_err = fabsl((prefix_sums[i] - reference[i]) / reference[i]);
+            if (rel_err > max_rel_err)
+                max_rel_err = rel_err;
+        }
+    }
+    return max_rel_err;
+}
+
+int main(int argc, char *argv[])
+{
+    int num_elems = 0;
+    int num_iters = 0;
+    int num_threads = 0;
+
+    real_t *data = NULL;
+    real_t *prefix_sums = NULL;
+    real_t *repro_sums = NULL;
+    real_t *tmp_sums = NULL;
+    double *chunk_bins = NULL;
+    long double *reference = NULL;
+
+    struct timeval start_time, end_time;  // for gettimeofday to calculate timing
+
+    char filename[256] = "prefixsum_repro_" REAL_NAME "_";
+    FILE *fp = NULL;
+
+    if (argc < 4) {
+        printf("Usage: %s [num_elems] [num_iters] [num_threads]\n", argv[0]);
+        printf("    - num_elems:  number of elements\n");
+        printf("    - num_iters: number of iterations\n");
+        printf("    - num_threads: number of threads\n");
+        exit(-1);
+    }
+
+    num_elems = atoi(argv[1]);
+    num_iters = atoi(argv[2]);
+    num_threads = atoi(argv[3]);
+
+    if (num_threads < 1) {
+        printf("Number of threads should be more than one!\n");
+        exit(-1);
+    }
+    if (num_elems < 1 || num_iters < 1) {
+        printf("Number of elements and iterations should be positive!\n");
+        exit(-1);
+    }
+
+    strcat(filename, argv[1]);
+    strcat(filename, "elems_");
+    strcat(filename, argv[2]);
+    strcat(filename, "iters_");
+    strcat(filename, argv[3]);
+    strcat(filename, "threads.txt");
+
+    fp = fopen(filename, "w");
+    if (fp) {
+        printf("Command line: %s %d %d %d\n",
+                argv[0], num_elems, num_iters, num_threads);
+        printf("Stats file: %s\n\n", filename);
+        fprintf(fp, "Command line: %s %d %d %d\n",
+                argv[0], num_elems, num_iters, num_threads);
+        fprintf(fp, "Stats file: %s\n\n", filename);
+    } else {
+        printf("ERROR: can't open the file %s!\n", filename);
+        exit(-1);
+    }
+
+    // Memory allocation; chunk_bins is sized for the smallest chunk size
+    long default_chunk = (num_elems + num_threads - 1) / num_threads;
+    long chunk_sizes[NUM_CHUNK_SIZES] = {0, 4096, 65537};
+    long max_chunks = (num_elems + 4095) / 4096 > num_threads ?
+                      (num_elems + 4095) / 4096 : num_threads;
+    data = (real_t *) malloc(sizeof(real_t) * num_elems);
+    prefix_sums = (real_t *) malloc(sizeof(real_t) * num_elems);
+    repro_sums = (real_t *) malloc(sizeof(real_t) * num_elems);
+    tmp_sums = (real_t *) malloc(sizeof(real_t) * num_threads);
+    chunk_bins = (double *) malloc(sizeof(double) * REPRO_BINS * max_chunks);
+    reference = (long double *) malloc(sizeof(long double) * num_elems);
+    suseconds_t *base_usecs = (suseconds_t *) malloc(sizeof(suseconds_t) * num_iters);
+    suseconds_t *repro_usecs = (suseconds_t *) malloc(sizeof(suseconds_t) * num_iters);
+    if (data == NULL || prefix_sums == NULL || repro_sums == NULL ||
+        tmp_sums == NULL || chunk_bins == NULL || reference == NULL ||
+        base_usecs == NULL || repro_usecs == NULL) {
+        printf("Failed in malloc()\n");
+        printf(" - data: %p\n", data);
+        printf(" - prefix_sums: %p\n", prefix_sums);
+        printf(" - repro_sums: %p\n", repro_sums);
+        printf(" - reference: %p\n", reference);
+        exit(-2);
+    }
+
+    // set number of threads
+    omp_set_num_threads(num_threads);
+
+    // Generate the inputs in parallel, element i only depends on i; the
+    // threads touch the output pages first
+    long i;
+    #pragma omp parallel for schedule(static)
+    for (i = 0; i < num_elems; i++) {
+        data[i] = generate_elem(i);
+        prefix_sums[i] = repro_sums[i] = 0;
+    }
+
+    long double ref_sum = 0;
+    for (i = 0; i < num_elems; i++) {
+        ref_sum += data[i];
+        reference[i] = ref_sum;
+    }
+
+    printf("Start ...\n");
+    fprintf(fp, "Start ...\n");
+
+    suseconds_t base_total = 0, repro_total = 0;
+    int iter;
+    for (iter = 0; iter < num_iters; iter++) {
+        gettimeofday(&start_time, NULL);
+        parallel_prefix_sum(data, prefix_sums, num_elems, tmp_sums);
+        gettimeofday(&end_time, NULL);
+        base_usecs[iter] = usec(start_time, end_time);
+        base_total += base_usecs[iter];
+
+        gettimeofday(&start_time, NULL);
+        repro_scan(data, repro_sums, num_elems, default_chunk, chunk_bins);
+        gettimeofday(&end_time, NULL);
+        repro_usecs[iter] = usec(start_time, end_time);
+        repro_total += repro_usecs[iter];
+
+        printf("iteration %d elapsed time: chunked %d (usec), reproducible %d (usec)\n",
+                iter, base_usecs[iter], repro_usecs[iter]);
+        fprintf(fp, "iteration %d elapsed time: chunked %d (usec), reproducible %d (usec)\n",
+                iter, base_usecs[iter], repro_usecs[iter]);
+    }
+
+    suseconds_t base_avg = base_total / num_iters;
+    suseconds_t repro_avg = repro_total / num_iters;
+    printf("Finish Reproducible Prefix Sum calculation\n\n");
+    fprintf(fp, "Finish Reproducible Prefix Sum calculation\n\n");
+    printf("%s chunked scan average elapsed time: %d (usec), std %f, max rel err %.3e\n",
+            REAL_NAME, base_avg, calculate_standard_deviation(base_usecs, num_iters),
+            max_rel_error(prefix_sums, reference, num_elems));
+    fprintf(fp, "%s chunked scan average elapsed time: %d (usec), std %f, max rel err %.3e\n",
+            REAL_NAME, base_avg, calculate_standard_deviation(base_usecs, num_iters),
+            max_rel_error(prefix_sums, reference, num_elems));
+    printf("%s reproducible scan average elapsed time: %d (usec), std %f, max rel err %.3e\n",
+            REAL_NAME, repro_avg, calculate_standard_deviation(repro_usecs, num_iters),
+            max_rel_error(repro_sums, reference, num_elems));
+    fprintf(fp, "%s reproducible scan average elapsed time: %d (usec), std %f, max rel err %.3e\n",
+            REAL_NAME, repro_avg, calculate_standard_deviation(repro_usecs, num_iters),
+            max_rel_error(repro_sums, reference, num_elems));
+    printf("Reproducibility overhead: %.2fx\n",
+            base_avg > 0 ? (double) repro_avg / base_avg : 0.0);
+    fprintf(fp, "Reproducibility overhead: %.2fx\n",
+            base_avg > 0 ? (double) repro_avg / base_avg : 0.0);
+
+#ifdef PRINT_PREFIXSUM
+    fprintf(fp, "\nInputs:");
+    for (i = 0; i < num_elems; i++) {
+        fprintf(fp, " %ld:%a", i, (double) data[i]);
+    }
+    fprintf(fp, "\n\nPrefix Sums:");
+    for (i = 0; i < num_elems; i++) {
+        fprintf(fp, " %ld:%a", i, (double) repro_sums[i]);
+    }
+    fprintf(fp, "\n");
+#endif // #ifdef PRINT_PREFIXSUM
+
+#ifdef VERIFY
+    // every thread count and chunk size must give the same bits as
+    // repro_sums; the chunked scan is shown for comparison
+    int t, cs;
+    for (t = 1; t <= num_threads; t++) {
+        omp_set_num_threads(t);
+        parallel_prefix_sum(data, prefix_sums, num_elems, tmp_sums);
+        long chunked_diffs = 0;
+        for (i = 0; i < num_elems; i++)
+            chunked_diffs += memcmp(&prefix_sums[i], &repro_sums[i], sizeof(real_t)) != 0;
+
+        for (cs = 0; cs < NUM_CHUNK_SIZES; cs++) {
+            long chunk_size = chunk_sizes[cs] > 0 ? chunk_sizes[cs] :
+                              (num_elems + t - 1) / t;
+            repro_scan(data, prefix_sums, num_elems, chunk_size, chunk_bins);
+            if (memcmp(prefix_sums, repro_sums, sizeof(real_t) * num_elems) != 0) {
+                for (i = 0; i < num_elems; i++)
+                    if (memcmp(&prefix_sums[i], &repro_sums[i], sizeof(real_t)) != 0)
+                        break;
+                printf("Wrong reproducible prefix sum implementation: %d threads, chunk size %ld, position %ld: %a vs %a\n",
+                        t, chunk_size, i, (double) prefix_sums[i], (double) repro_sums[i]);
+                exit(-1);
+            }
+        }
+        printf("%d threads: reproducible scan bitwise identical for %d chunk sizes, chunked scan output differs from it at %ld elements\n",
+                t, NUM_CHUNK_SIZES, chunked_diffs);
+        fprintf(fp, "%d threads: reproducible scan bitwise identical for %d chunk sizes, chunked scan output differs from it at %ld elements\n",
+                t, NUM_CHUNK_SIZES, chunked_diffs);
+    }
+#endif // #ifdef VERIFY
+
+    // free the allocated memory
+    free(data);
+    free(prefix_sums);
+    free(repro_sums);
+    free(tmp_sums);
+    free(chunk_bins);
+    free(reference);
+    free(base_usecs);
+    free(repro_usecs);
+
+    fclose(fp);
+
+    return 0;
+}
@@ -0,0 +1,344 @@
+/*
+ * prefixsum_repro_mpi.c
+ *
+ * Description: Bitwise-reproducible parallel prefix sums of a sequence of
+ * floating-point numbers using MPI. The output bits do not depend on the
+ * number of processes. This is the MPI counterpart of prefixsum_repro.c and
+ * uses the same pre-rounding into fixed-point bins (repro.h). Built as
+ * prefixsum_repro_mpi.exe for float and, with -DUSE_DOUBLE, as
+ * prefixsum_repro_mpi_double.exe for double.
+ *
+ * Procedure:
+ * 1. Each processor generates its partition of num_elems numbers in [0, 1)
+ *    from a hash of the global element index, so every process count sees
+ *    exactly the same global inputs;
+ * 2. The global maximum magnitude is reduced with MPI_Allreduce(MPI_MAX),
+ *    which fixes the same fixed-point grid on every processor;
+ * 3. Each processor splits its elements into bin values and sums them, the
+ *    bin totals are exclusively scanned with MPI_Exscan on MPI_DOUBLE (the
+ *    sums are exact, so the association chosen by the MPI library does not
+ *    matter), and each processor rescans its partition from its exact base
+ *    and converts the running bin sums back to real_t;
+ * 4. An order-independent hash of the output bits is reduced to rank 0, so
+ *    runs at different process counts can be compared directly. The
+ *    non-reproducible scan (real_t MPI_Exscan of the partition totals) is
+ *    timed and hashed for comparison.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <mpi.h>
+
+#define DATA_SEED 20240501UL
+#define VERIFY
+
+#ifdef USE_DOUBLE
+typedef double real_t;
+#define MPI_REAL_T MPI_DOUBLE
+#define REAL_NAME "double"
+#define REPRO_BINS 2
+#else
+typedef float real_t;
+#define MPI_REAL_T MPI_FLOAT
+#define REAL_NAME "float"
+#define REPRO_BINS 1
+#endif
+
+#include "repro.h"
+
+// usec: calculate the time interval in microseconds
+inline suseconds_t usec(struct timeval start, struct timeval end)
+{
+  return ((double) (((end.tv_sec * 1000000 + end.tv_usec) -
+                     (start.tv_sec * 1000000 + start.tv_usec))));
+}
+
+double calculate_standard_deviation(suseconds_t *data, int n) {
+    double mean = 0.0;
+    double variance = 0.0;
+    double std_dev = 0.0;
+
+    for (int i = 0; i < n; i++) {
+        mean += (double)data[i];
+    }
+    mean /= n;
+
+    for (int i = 0; i < n; i++) {
+        variance += (data[i] - mean) * (data[i] - mean);
+    }
+    variance /= n;
+
+    std_dev = sqrt(variance);
+
+    return std_dev;
+}
+
+static inline real_t generate_elem(long i)
+{
+    return (real_t) ((splitmix64(DATA_SEED + i) >> 11) * 0x1.0p-53);
+}
+
+// hash_elem: contribution of output element i to the order-independent hash
+static inline unsigned long hash_elem(long i, real_t x)
+{
+    unsigned long bits = 0;
+    memcpy(&bits, &x, sizeof(real_t));
+    return splitmix64(bits ^ splitmix64(i));
+}
+
+// repro_local_totals: bin totals of a partition
+void repro_local_totals(const repro_grid_t *grid, real_t *data, int n,
+                        double *totals)
+{
+    repro_totals(grid, data, n, totals);
+}
+
+// repro_local_scan: rescan a partition from its exact bin base
+void repro_local_scan(const repro_grid_t *grid, real_t *data,
+                      real_t *prefix_sums, int n, const double *base)
+{
+    double sums[REPRO_BINS];
+    int k;
+    for (k = 0; k < REPRO_BINS; k++)
+        sums[k] = base[k];
+    repro_rescan(grid, data, prefix_sums, n, sums);
+}
+
+int main(int argc, char *argv[])
+{
+    // command line arguments
+    int num_elems = 0;
+    int num_iters = 0;
+    int num_procs = 0;
+
+    int rank;
+
+    // per-processor local memory pointers
+    real_t *local_data = NULL;
+    real_t *local_prefix_sums = NULL;
+    real_t *local_repro_sums = NULL;
+
+    struct timeval start_time, end_time;  // for gettimeofday to calculate timing
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);  // getting the ID for this process
+
+    if (argc < 3) {
+        if (rank == 0) {
+            printf("Usage: %s [num_elems] [num_iters]\n", argv[0]);
+            printf("    - num_elems:  number of elements\n");
+            printf("    - num_iters: number of iterations\n");
+        }
+
+        MPI_Finalize();
+        exit(-1);
+    }
+
+    num_elems = atoi(argv[1]);
+    num_iters = atoi(argv[2]);
+
+    MPI_Comm_size(MPI_COMM_WORLD, &num_procs); // get the number of processes
+
+    if (num_elems < num_procs || num_iters < 1) {
+        if (rank == 0)
+            printf("Every processor needs at least one element and one iteration!\n");
+        MPI_Finalize();
+        exit(-1);
+    }
+
+    char filename[256] = "prefixsum_repro_mpi_" REAL_NAME "_";
+    char nprocs[16];
+    sprintf(nprocs, "%d", num_procs);
+    FILE *fp = NULL;
+
+    strcat(filename, argv[1]);
+    strcat(filename, "elems_");
+    strcat(filename, argv[2]);
+    strcat(filename, "iters_");
+    strcat(filename, nprocs);
+    strcat(filename, "procs.txt");
+
+    if (rank == 0) {
+        fp = fopen(filename, "w");
+        if (fp) {
+            printf("Command line: mpirun -np %d %s %d %d\n",
+                    num_procs, argv[0], num_elems, num_iters);
+            printf("Stats file: %s\n\n", filename);
+            fprintf(fp, "Command line: mpirun -np %d %s %d %d\n",
+                    num_procs, argv[0], num_elems, num_iters);
+            fprintf(fp, "Stats file: %s\n\n", filename);
+        } else {
+            printf("ERROR: can't open the file %s!\n", filename);
+            MPI_Abort(MPI_COMM_WORLD, -1);
+        }
+    }
+
+    // data patition varies due to the input data size
+    int my_num_elems;
+    int num_elems_mean = num_elems / num_procs;
+    int num_elems_remain = num_elems % num_procs;
+    int start;
+    if (rank < num_elems_remain) {
+        my_num_elems = num_elems_mean + 1;
+        start = rank * (num_elems_mean + 1);
+    } else {
+        my_num_elems = num_elems_mean;
+        start = rank * num_elems_mean + num_elems_remain;
+    }
+
+    // Memory allocation private to each process
+    local_data = (real_t *) malloc(sizeof(real_t) * my_num_elems);
+    local_prefix_sums = (real_t *) malloc(sizeof(real_t) * my_num_elems);
+    local_repro_sums = (real_t *) malloc(sizeof(real_t) * my_num_elems);
+    suseconds_t *base_usecs = (suseconds_t *) malloc(sizeof(suseconds_t) * num_iters);
+    suseconds_t *repro_usecs = (suseconds_t *) malloc(sizeof(suseconds_t) * num_iters);
+    if (local_data == NULL || local_prefix_sums == NULL ||
+        local_repro_sums == NULL || base_usecs == NULL || repro_usecs == NULL) {
+        printf("Processor %d failed in malloc.\n", rank);
+        printf(" - local_data: %p\n", local_data);
+        printf(" - local_prefix_sums: %p\n", local_prefix_sums);
+        printf(" - local_repro_sums: %p\n", local_repro_sums);
+        MPI_Abort(MPI_COMM_WORLD, -2);
+    }
+
+    // generate input data, element i only depends on its global index
+    int i;
+    for (i = 0; i < my_num_elems; i++) {
+        local_data[i] = generate_elem((long) start + i);
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);    // Global barrier
+
+    if (rank == 0) {
+        printf("Start ...\n");
+        fprintf(fp, "Start ...\n");
+    }
+
+    suseconds_t base_total = 0, repro_total = 0;
+    int iter;
+    for (iter = 0; iter < num_iters; iter++) {
+        // non-reproducible: local scan, float exclusive scan of the totals
+        gettimeofday(&start_time, NULL);
+        real_t sum = 0, base = 0;
+        for (i = 0; i < my_num_elems; i++) {
+            sum += local_data[i];
+            local_prefix_sums[i] = sum;
+        }
+        MPI_Exscan(&sum, &base, 1, MPI_REAL_T, MPI_SUM, MPI_COMM_WORLD);
+        if (rank == 0)
+            base = 0;
+        for (i = 0; i < my_num_elems; i++)
+            local_prefix_sums[i] += base;
+        MPI_Barrier(MPI_COMM_WORLD);
+        gettimeofday(&end_time, NULL);
+        base_usecs[iter] = usec(start_time, end_time);
+        base_total += base_usecs[iter];
+
+        // reproducible: global grid, exact carries
+        gettimeofday(&start_time, NULL);
+        double local_max = 0.0, global_max = 0.0;
+        for (i = 0; i < my_num_elems; i++) {
+            double a = fabs((double) local_data[i]);
+            if (a > local_max)
+                local_max = a;
+        }
+        MPI_Allreduce(&local_max, &global_max, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+        repro_grid_t grid;
+        repro_grid_init(&grid, global_max, num_elems);
+
+        double totals[REPRO_BINS], bases[REPRO_BINS];
+        int k;
+        repro_local_totals(&grid, local_data, my_num_elems, totals);
+        MPI_Exscan(totals, bases, REPRO_BINS, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+        if (rank == 0)
+            for (k = 0; k < REPRO_BINS; k++)
+                bases[k] = 0;
+        repro_local_scan(&grid, local_data, local_repro_sums, my_num_elems, bases);
+        MPI_Barrier(MPI_COMM_WORLD);
+        gettimeofday(&end_time, NULL);
+        repro_usecs[iter] = usec(start_time, end_time);
+        repro_total += repro_usecs[iter];
+
+        if (rank == 0) {
+            printf("iteration %d elapsed time: chunked %d (usec), reproducible %d (usec)\n",
+                    iter, base_usecs[iter], repro_usecs[iter]);
+            fprintf(fp, "iteration %d elapsed time: chunked %d (usec), reproducible %d (usec)\n",
+                    iter, base_usecs[iter], repro_usecs[iter]);
+        }
+    }
+
+    // order-independent hashes of the output bits
+    unsigned long local_hashes[2] = {0, 0}, hashes[2] = {0, 0};
+    for (i = 0; i < my_num_elems; i++) {
+        local_hashes[0] += hash_elem((long) start + i, local_prefix_sums[i]);
+        local_hashes[1] += hash_elem((long) start + i, local_repro_sums[i]);
+    }
+    MPI_Reduce(local_hashes, hashes, 2, MPI_UNSIGNED_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+
+    // print timing stats
+    if (rank == 0) {
+        suseconds_t base_avg = base_total / num_iters;
+        suseconds_t repro_avg = repro_total / num_iters;
+        printf("Finish MPI Reproducible Prefix Sum calculation\n\n");
+        fprintf(fp, "Finish MPI Reproducible Prefix Sum calculation\n\n");
+        printf("%s chunked scan average elapsed time: %d (usec), std %f, output hash %016lx\n",
+                REAL_NAME, base_avg, calculate_standard_deviation(base_usecs, num_iters), hashes[0]);
+        fprintf(fp, "%s chunked scan average elapsed time: %d (usec), std %f, output hash %016lx\n",
+                REAL_NAME, base_avg, calculate_standard_deviation(base_usecs, num_iters), hashes[0]);
+        printf("%s reproducible scan average elapsed time: %d (usec), std %f, output hash %016lx\n",
+                REAL_NAME, repro_avg, calculate_standard_deviation(repro_usecs, num_iters), hashes[1]);
+        fprintf(fp, "%s reproducible scan average elapsed time: %d (usec), std %f, output hash %016lx\n",
+                REAL_NAME, repro_avg, calculate_standard_deviation(repro_usecs, num_iters), hashes[1]);
+        printf("Reproducibility overhead: %.2fx\n",
+                base_avg > 0 ? (double) repro_avg / base_avg : 0.0);
+        fprintf(fp, "Reproducibility overhead: %.2fx\n",
+                base_avg > 0 ? (double) repro_avg / base_avg : 0.0);
+
+#ifdef VERIFY
+        // the single-process reproducible scan must hash identically
+        real_t *all_data = (real_t *) malloc(sizeof(real_t) * num_elems);
+        real_t *all_sums = (real_t *) malloc(sizeof(real_t) * num_elems);
+        if (all_data != NULL && all_sums != NULL) {
+            double max_abs = 0.0;
+            double zero[REPRO_BINS] = {0};
+            unsigned long hash = 0;
+            repro_grid_t grid;
+            for (i = 0; i < num_elems; i++) {
+                all_data[i] = generate_elem(i);
+                if (fabs((double) all_data[i]) > max_abs)
+                    max_abs = fabs((double) all_data[i]);
+            }
+            repro_grid_init(&grid, max_abs, num_elems);
+            repro_local_scan(&grid, all_data, all_sums, num_elems, zero);
+            for (i = 0; i < num_elems; i++)
+                hash += hash_elem(i, all_sums[i]);
+            if (hash != hashes[1]) {
+                printf("Wrong reproducible prefix sum implementation: %d processes hash %016lx, 1 process hash %016lx\n",
+                        num_procs, hashes[1], hash);
+                MPI_Abort(MPI_COMM_WORLD, -1);
+            }
+            printf("Reproducible output identical to the single-process scan\n");
+            fprintf(fp, "Reproducible output identical to the single-process scan\n");
+        }
+        free(all_data);
+        free(all_sums);
+#endif // #ifdef VERIFY
+
+        fclose(fp);
+    }
+
+    free(local_data);
+    free(local_prefix_sums);
+    free(local_repro_sums);
+    free(base_usecs);
+    free(repro_usecs);
+
+    MPI_Finalize();
+
+    return 0;
+}
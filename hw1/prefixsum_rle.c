@@ -0,0 +1,285 @@
+/*
+ * prefixsum_rle.c
+ *
+ * Description: Prefix sums of run-length encoded input using OpenMP: the
+ * (value, run length) pairs are scanned as they are, instead of expanding
+ * them into the dense int array the other drivers take.
+ *
+ * Procedure:
+ * 1. For every mean run length from 1 to 4096, the input of num_elems
+ *    elements is generated as runs: the run lengths are uniform in
+ *    [1, 2 * mean - 1], half of the runs are zeros and the others random
+ *    integers;
+ * 2. Three methods are timed num_iters times:
+ *    - expand+scan (baseline): the runs are expanded into a dense array,
+ *      which is scanned with scan_i32_i64 of libprefixsum;
+ *    - rle dense: scan_i32_i64_rle writes the same dense prefix sums
+ *      straight from the runs;
+ *    - rle linear: scan_i32_i64_rle_linear writes only the start and the
+ *      base prefix sum of every run, so its cost follows the number of runs
+ *      and not num_elems;
+ * 3. Both RLE methods are checked against the dense scan, and the time per
+ *    element and per run is reported with the input sizes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <sys/time.h>
+#include <omp.h>
+
+#include "prefixsum.h"
+
+#define MAX_INT 2147483647
+#define NUM_RUN_LENGTHS 7
+#define NUM_METHODS 3
+#define VERIFY
+
+// usec: calculate the time interval in microseconds
+inline suseconds_t usec(struct timeval start, struct timeval end)
+{
+  return ((double) (((end.tv_sec * 1000000 + end.tv_usec) -
+                     (start.tv_sec * 1000000 + start.tv_usec))));
+}
+
+double calculate_standard_deviation(suseconds_t *data, int n) {
+    double mean = 0.0;
+    double variance = 0.0;
+    double std_dev = 0.0;
+
+    for (int i = 0; i < n; i++) {
+        mean += (double)data[i];
+    }
+    mean /= n;
+
+    for (int i = 0; i < n; i++) {
+        variance += (data[i] - mean) * (data[i] - mean);
+    }
+    variance /= n;
+
+    std_dev = sqrt(variance);
+
+    return std_dev;
+}
+
+// generate_runs: runs of mean length mean_run covering num_elems elements;
+// returns the number of runs
+long generate_runs(int *values, unsigned int *lengths, long num_elems,
+                   int mean_run, int K)
+{
+    unsigned int seed = mean_run + time(NULL);
+    long num_runs = 0, pos = 0;
+
+    while (pos < num_elems) {
+        long length = 1 + rand_r(&seed) % (2 * mean_run - 1);
+        if (length > num_elems - pos)
+            length = num_elems - pos;
+        values[num_runs] = (rand_r(&seed) % 2) ? rand_r(&seed) % K : 0;
+        lengths[num_runs] = length;
+        pos += length;
+        num_runs++;
+    }
+
+    return num_runs;
+}
+
+// expand: the dense input of the runs
+void expand(int *data, const int *values, const unsigned int *lengths,
+            long num_runs)
+{
+    long pos = 0;
+    for (long r = 0; r < num_runs; r++)
+        for (unsigned int j = 0; j < lengths[r]; j++)
+            data[pos++] = values[r];
+}
+
+int main(int argc, char *argv[])
+{
+    int num_elems = 0;
+    int num_iters = 0;
+    int num_threads = 0;
+
+    struct timeval start_time, end_time;  // for gettimeofday to calculate timing
+
+    char filename[256] = "prefixsum_rle_";
+    FILE *fp = NULL;
+
+    if (argc < 4) {
+        printf("Usage: %s [num_elems] [num_iters] [num_threads]\n", argv[0]);
+        printf("    - num_elems:  number of elements\n");
+        printf("    - num_iters: number of iterations\n");
+        printf("    - num_threads: number of threads\n");
+        exit(-1);
+    }
+
+    num_elems = atoi(argv[1]);
+    num_iters = atoi(argv[2]);
+    num_threads = atoi(argv[3]);
+
+    if (num_threads < 1) {
+        printf("Number of threads should be more than one!\n");
+        exit(-1);
+    }
+    if (num_elems < 1 || num_iters < 1) {
+        printf("Number of elements and iterations should be positive!\n");
+        exit(-1);
+    }
+
+    strcat(filename, argv[1]);
+    strcat(filename, "elems_");
+    strcat(filename, argv[2]);
+    strcat(filename, "iters_");
+    strcat(filename, argv[3]);
+    strcat(filename, "threads.txt");
+
+    fp = fopen(filename, "w");
+    if (fp) {
+        printf("Command line: %s %d %d %d\n",
+                argv[0], num_elems, num_iters, num_threads);
+        printf("Stats file: %s\n\n", filename);
+        fprintf(fp, "Command line: %s %d %d %d\n",
+                argv[0], num_elems, num_iters, num_threads);
+        fprintf(fp, "Stats file: %s\n\n", filename);
+    } else {
+        printf("ERROR: can't open the file %s!\n", filename);
+        exit(-1);
+    }
+
+    // Memory allocation: the runs (at most one per element), their lines,
+    // the dense input and two dense outputs
+    int *values = (int *) malloc(sizeof(int) * num_elems);
+    unsigned int *lengths = (unsigned int *) malloc(sizeof(unsigned int) * num_elems);
+    long *run_starts = (long *) malloc(sizeof(long) * num_elems);
+    long *run_bases = (long *) malloc(sizeof(long) * num_elems);
+    int *data = (int *) malloc(sizeof(int) * num_elems);
+    long *ref_sums = (long *) malloc(sizeof(long) * num_elems);
+    long *prefix_sums = (long *) malloc(sizeof(long) * num_elems);
+    suseconds_t *usecs = (suseconds_t *) malloc(sizeof(suseconds_t) * num_iters);
+    scan_ctx_t *ctx = scan_ctx_create(num_threads);
+    if (values == NULL || lengths == NULL || run_starts == NULL ||
+        run_bases == NULL || data == NULL || ref_sums == NULL ||
+        prefix_sums == NULL || usecs == NULL || ctx == NULL) {
+        printf("Failed in malloc()\n");
+        printf(" - values: %p\n", values);
+        printf(" - lengths: %p\n", lengths);
+        printf(" - data: %p\n", data);
+        printf(" - ref_sums: %p\n", ref_sums);
+        printf(" - prefix_sums: %p\n", prefix_sums);
+        exit(-2);
+    }
+
+    // set number of threads
+    omp_set_num_threads(num_threads);
+
+    // first touch of the dense arrays in parallel
+    long i;
+    #pragma omp parallel for schedule(static)
+    for (i = 0; i < num_elems; i++) {
+        data[i] = 0;
+        ref_sums[i] = prefix_sums[i] = 0;
+    }
+
+    printf("Start ...\n");
+    fprintf(fp, "Start ...\n");
+    printf("%8s %10s %11s %16s %16s %16s %8s %8s\n", "mean run", "runs",
+            "rle bytes", "expand+scan", "rle dense", "rle linear",
+            "ns/elem", "ns/run");
+    fprintf(fp, "%8s %10s %11s %16s %16s %16s %8s %8s\n", "mean run", "runs",
+            "rle bytes", "expand+scan", "rle dense", "rle linear",
+            "ns/elem", "ns/run");
+
+    const int mean_runs[NUM_RUN_LENGTHS] = {1, 4, 16, 64, 256, 1024, 4096};
+    int K = MAX_INT / num_elems;
+    int errors = 0;
+    for (int m = 0; m < NUM_RUN_LENGTHS; m++) {
+        long num_runs = generate_runs(values, lengths, num_elems, mean_runs[m], K);
+        suseconds_t avg_usecs[NUM_METHODS];
+        double std_usecs[NUM_METHODS];
+
+        for (int method = 0; method < NUM_METHODS; method++) {
+            suseconds_t total_usec = 0;
+            for (int iter = 0; iter < num_iters; iter++) {
+                int status;
+                gettimeofday(&start_time, NULL);
+                if (method == 0) {
+                    expand(data, values, lengths, num_runs);
+                    status = scan_i32_i64(ctx, data, ref_sums, num_elems);
+                } else if (method == 1) {
+                    status = scan_i32_i64_rle(ctx, values, lengths, num_runs,
+                                              prefix_sums);
+                } else {
+                    status = scan_i32_i64_rle_linear(ctx, values, lengths,
+                                                     num_runs, run_starts,
+                                                     run_bases);
+                }
+                gettimeofday(&end_time, NULL);
+                if (status != SCAN_OK) {
+                    printf("Failed in method %d: status %d\n", method, status);
+                    exit(-2);
+                }
+                usecs[iter] = usec(start_time, end_time);
+                total_usec += usecs[iter];
+            }
+            avg_usecs[method] = total_usec / num_iters;
+            std_usecs[method] = calculate_standard_deviation(usecs, num_iters);
+        }
+
+#ifdef VERIFY
+        // the dense RLE scan against the scan of the expanded input, the
+        // lines against the positions and prefix sums before every run
+        long bad = -1, pos = 0, r;
+        for (i = 0; i < num_elems && bad < 0; i++)
+            if (prefix_sums[i] != ref_sums[i])
+                bad = i;
+        if (bad >= 0) {
+            printf("Wrong dense RLE prefix sum implementation: mean run %d, error at position %ld\n",
+                    mean_runs[m], bad);
+            errors++;
+        }
+        for (r = 0, bad = -1; r < num_runs && bad < 0; r++) {
+            long base = (pos == 0) ? 0 : ref_sums[pos - 1];
+            if (run_starts[r] != pos || run_bases[r] != base)
+                bad = r;
+            pos += lengths[r];
+        }
+        if (bad >= 0) {
+            printf("Wrong linear RLE prefix sum implementation: mean run %d, error at run %ld\n",
+                    mean_runs[m], bad);
+            errors++;
+        }
+#endif // #ifdef VERIFY
+
+        long rle_bytes = num_runs * (long) (sizeof(int) + sizeof(unsigned int));
+        printf("%8d %10ld %11ld %9d (usec) %9d (usec) %9d (usec) %8.3f %8.3f\n",
+                mean_runs[m], num_runs, rle_bytes,
+                avg_usecs[0], avg_usecs[1], avg_usecs[2],
+                1000.0 * avg_usecs[1] / num_elems, 1000.0 * avg_usecs[2] / num_runs);
+        fprintf(fp, "%8d %10ld %11ld %9d (usec) %9d (usec) %9d (usec) %8.3f %8.3f\n",
+                mean_runs[m], num_runs, rle_bytes,
+                avg_usecs[0], avg_usecs[1], avg_usecs[2],
+                1000.0 * avg_usecs[1] / num_elems, 1000.0 * avg_usecs[2] / num_runs);
+        fprintf(fp, "    std: %f / %f / %f\n", std_usecs[0], std_usecs[1], std_usecs[2]);
+    }
+
+    printf("Dense input: %ld bytes\n", (long) sizeof(int) * num_elems);
+    fprintf(fp, "Dense input: %ld bytes\n", (long) sizeof(int) * num_elems);
+    printf("Finish OpenMP RLE Prefix Sum\n");
+    fprintf(fp, "Finish OpenMP RLE Prefix Sum\n");
+
+    // free the allocated memory
+    free(values);
+    free(lengths);
+    free(run_starts);
+    free(run_bases);
+    free(data);
+    free(ref_sums);
+    free(prefix_sums);
+    free(usecs);
+    scan_ctx_destroy(ctx);
+
+    fclose(fp);
+
+    return errors ? -1 : 0;
+}
@@ -0,0 +1,388 @@
+/*
+ * prefixsum_rma.c
+ *
+ * Description: Parallel implementation of Prefix Sum program to sum a
+ * sequence of randomly generated integers using MPI, comparing three ways of
+ * propagating the carries between the processors.
+ *
+ * Procedure:
+ * 1. Each processor generates its partition of the random integers;
+ * 2. Each processor computes its local prefix sums, the last one being its
+ *    local total;
+ * 3. The sum of all the previous partitions is obtained with one of:
+ *    - two-sided: the MPI_Recv/MPI_Isend chain of prefixsum_mpi.c, with the
+ *      send request waited on;
+ *    - collective: MPI_Exscan of the local totals;
+ *    - rma: every processor exposes its local total in an MPI_Win and looks
+ *      back over its predecessors with MPI_Fetch_and_op under passive-target
+ *      synchronization (MPI_Win_lock_all), adding their totals until it
+ *      reaches one that already published its inclusive prefix. No receive
+ *      has to be posted by the predecessors;
+ * 4. Each processor adds the carry to its local prefix sums.
+ *
+ * Every variant runs num_iters iterations on the same data; the elapsed time
+ * and the carry time (the slowest processor) are reported per variant.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <mpi.h>
+
+#define MAX_INT 2147483647
+#define VERIFY
+
+#define NUM_CARRIES 3
+
+// window slots of the rma carry, one set per processor
+#define SLOT_FLAG 0         // 2 * iter + 1: aggregate, 2 * iter + 2: inclusive
+#define SLOT_AGGREGATE 1    // local total
+#define SLOT_INCLUSIVE 2    // sum up to and including this processor
+#define NUM_SLOTS 3
+
+// usec: calculate the time interval in microseconds
+inline suseconds_t usec(struct timeval start, struct timeval end)
+{
+  return ((double) (((end.tv_sec * 1000000 + end.tv_usec) -
+                     (start.tv_sec * 1000000 + start.tv_usec))));
+}
+
+double calculate_standard_deviation(suseconds_t *data, int n) {
+    double mean = 0.0;
+    double variance = 0.0;
+    double std_dev = 0.0;
+
+    for (int i = 0; i < n; i++) {
+        mean += (double)data[i];
+    }
+    mean /= n;
+
+    for (int i = 0; i < n; i++) {
+        variance += (data[i] - mean) * (data[i] - mean);
+    }
+    variance /= n;
+
+    std_dev = sqrt(variance);
+
+    return std_dev;
+}
+
+// carry_two_sided: chain of matched sends, rank r waits for rank r-1
+long carry_two_sided(long my_total, int rank, int num_procs)
+{
+    long base = 0;
+    long send_buf;
+    MPI_Request request = MPI_REQUEST_NULL;
+
+    if (rank != 0)
+        MPI_Recv(&base, 1, MPI_LONG, rank - 1, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    if (rank != num_procs - 1) {
+        send_buf = base + my_total;
+        MPI_Isend(&send_buf, 1, MPI_LONG, rank + 1, 0, MPI_COMM_WORLD, &request);
+    }
+    MPI_Wait(&request, MPI_STATUS_IGNORE);
+
+    return base;
+}
+
+// carry_collective: exclusive scan of the local totals
+long carry_collective(long my_total, int rank)
+{
+    long base = 0;
+
+    MPI_Exscan(&my_total, &base, 1, MPI_LONG, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0)
+        base = 0;   // MPI_Exscan leaves it undefined
+
+    return base;
+}
+
+// rma_publish: atomically store value and then flag into this processor's
+// slots; the flush in between makes the value visible before the flag
+static void rma_publish(MPI_Win win, int rank, int slot, long value, long flag)
+{
+    long old;
+    MPI_Fetch_and_op(&value, &old, MPI_LONG, rank, slot, MPI_REPLACE, win);
+    MPI_Win_flush(rank, win);
+    MPI_Fetch_and_op(&flag, &old, MPI_LONG, rank, SLOT_FLAG, MPI_REPLACE, win);
+    MPI_Win_flush(rank, win);
+}
+
+// rma_read: atomically read one slot of a processor
+static long rma_read(MPI_Win win, int target, int slot)
+{
+    long value;
+    MPI_Fetch_and_op(NULL, &value, MPI_LONG, target, slot, MPI_NO_OP, win);
+    MPI_Win_flush(target, win);
+    return value;
+}
+
+// carry_rma: publish the local total, then look back over the predecessors:
+// an inclusive prefix ends the look-back, a local total is added and the
+// look-back moves one processor further, nothing published yet is polled.
+// The caller separates the iterations with a barrier, so the slots of
+// iteration iter are never overwritten while somebody still reads them.
+long carry_rma(MPI_Win win, long my_total, int rank, int iter)
+{
+    long aggregate_flag = 2L * iter + 1;
+    long inclusive_flag = 2L * iter + 2;
+    long base = 0;
+    int pred = rank - 1;
+
+    rma_publish(win, rank, SLOT_AGGREGATE, my_total, aggregate_flag);
+
+    while (pred >= 0) {
+        long flag = rma_read(win, pred, SLOT_FLAG);
+        if (flag == inclusive_flag) {
+            base += rma_read(win, pred, SLOT_INCLUSIVE);
+            break;
+        } else if (flag == aggregate_flag) {
+            base += rma_read(win, pred, SLOT_AGGREGATE);
+            pred--;
+        }
+    }
+
+    rma_publish(win, rank, SLOT_INCLUSIVE, base + my_total, inclusive_flag);
+
+    return base;
+}
+
+#ifdef VERIFY
+// verify_local_prefix_sums: see prefixsum_mpi.c
+int verify_local_prefix_sums(long *local_prefix_sums, int *local_data,
+                             int my_num_elems, long prev_last)
+{
+    int i;
+    for (i = 0; i < my_num_elems; i++) {
+        long prev = (i == 0) ? prev_last : local_prefix_sums[i-1];
+        if (local_prefix_sums[i] - prev != local_data[i])
+            break;
+    }
+    return i;
+}
+#endif // #ifdef VERIFY
+
+int main(int argc, char *argv[])
+{
+    // command line arguments
+    int num_elems = 0;
+    int num_iters = 0;
+    int num_procs = 0;
+
+    int rank;
+
+    // per-processor local memory pointers
+    int *local_data = NULL;
+    long *local_prefix_sums = NULL;
+
+    struct timeval start_time, end_time;  // for gettimeofday to calculate timing
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);  // getting the ID for this process
+
+    if (argc < 3) {
+        if (rank == 0) {
+            printf("Usage: %s [num_elems] [num_iters]\n", argv[0]);
+            printf("    - num_elems:  number of elements\n");
+            printf("    - num_iters: number of iterations\n");
+        }
+
+        MPI_Finalize();
+        exit(-1);
+    }
+
+    num_elems = atoi(argv[1]);
+    num_iters = atoi(argv[2]);
+
+    MPI_Comm_size(MPI_COMM_WORLD, &num_procs); // get the number of processes
+
+    if (num_elems < num_procs || num_iters < 1) {
+        if (rank == 0)
+            printf("Every processor needs at least one element and one iteration!\n");
+        MPI_Finalize();
+        exit(-1);
+    }
+
+    char filename[256] = "prefixsum_rma_";
+    char nprocs[16];
+    sprintf(nprocs, "%d", num_procs);
+    FILE *fp = NULL;
+
+    strcat(filename, argv[1]);
+    strcat(filename, "elems_");
+    strcat(filename, argv[2]);
+    strcat(filename, "iters_");
+    strcat(filename, nprocs);
+    strcat(filename, "procs.txt");
+
+    if (rank == 0) {
+        fp = fopen(filename, "w");
+        if (fp) {
+            printf("Command line: mpirun -np %d %s %d %d\n",
+                    num_procs, argv[0], num_elems, num_iters);
+            printf("Stats file: %s\n\n", filename);
+            fprintf(fp, "Command line: mpirun -np %d %s %d %d\n",
+                    num_procs, argv[0], num_elems, num_iters);
+            fprintf(fp, "Stats file: %s\n\n", filename);
+        } else {
+            printf("ERROR: can't open the file %s!\n", filename);
+            MPI_Abort(MPI_COMM_WORLD, -1);
+        }
+    }
+
+    // data patition varies due to the input data size
+    int my_num_elems;
+    int num_elems_mean = num_elems / num_procs;
+    int num_elems_remain = num_elems % num_procs;
+    int start;
+    if (rank < num_elems_remain) {
+        my_num_elems = num_elems_mean + 1;
+        start = rank * (num_elems_mean + 1);
+    } else {
+        my_num_elems = num_elems_mean;
+        start = rank * num_elems_mean + num_elems_remain;
+    }
+
+    // Memory allocation private to each process
+    local_data = (int *) malloc(sizeof(int) * my_num_elems);
+    local_prefix_sums = (long *) malloc(sizeof(long) * my_num_elems);
+    suseconds_t *usecs = (suseconds_t *) malloc(sizeof(suseconds_t) * num_iters);
+    double *carry_usecs = (double *) malloc(sizeof(double) * num_iters);
+    if (local_data == NULL || local_prefix_sums == NULL ||
+        usecs == NULL || carry_usecs == NULL) {
+        printf("Processor %d failed in malloc.\n", rank);
+        printf(" - local_data: %p\n", local_data);
+        printf(" - local_prefix_sums: %p\n", local_prefix_sums);
+        MPI_Abort(MPI_COMM_WORLD, -2);
+    }
+
+    // window exposing the carry slots of every processor
+    long *slots = NULL;
+    MPI_Win win;
+    MPI_Win_allocate(NUM_SLOTS * sizeof(long), sizeof(long), MPI_INFO_NULL,
+                     MPI_COMM_WORLD, &slots, &win);
+    memset(slots, 0, NUM_SLOTS * sizeof(long));
+    MPI_Barrier(MPI_COMM_WORLD);
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, win);
+
+    // generate input data
+    srand(rank + time(NULL));
+    int i;
+    int K = MAX_INT / num_elems;
+    for (i = 0; i < my_num_elems; i++) {
+        local_data[i] = rand() % K;
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);    // Global barrier
+
+    if (rank == 0) {
+        printf("Start ...\n");
+        fprintf(fp, "Start ...\n");
+    }
+
+    const char *carry_names[NUM_CARRIES] = {"two-sided", "collective", "rma"};
+    int carry, iter;
+    for (carry = 0; carry < NUM_CARRIES; carry++) {
+        suseconds_t total_usec = 0;
+        double total_carry_usec = 0;
+
+        for (iter = 0; iter < num_iters; iter++) {
+            // copy the input array to the prefix sum array for initialization
+            for (i = 0; i < my_num_elems; i++) {
+                local_prefix_sums[i] = local_data[i];
+            }
+
+            MPI_Barrier(MPI_COMM_WORLD);
+            gettimeofday(&start_time, NULL);
+
+            for (i = 1; i < my_num_elems; i++) {
+                local_prefix_sums[i] += local_prefix_sums[i-1];
+            }
+            long my_total = local_prefix_sums[my_num_elems - 1];
+
+            double carry_start = MPI_Wtime();
+            long base;
+            if (carry == 0)
+                base = carry_two_sided(my_total, rank, num_procs);
+            else if (carry == 1)
+                base = carry_collective(my_total, rank);
+            else
+                base = carry_rma(win, my_total, rank, iter);
+            double my_carry_usec = (MPI_Wtime() - carry_start) * 1e6;
+
+            for (i = 0; i < my_num_elems; i++) {
+                local_prefix_sums[i] += base;
+            }
+
+            MPI_Barrier(MPI_COMM_WORLD);
+            gettimeofday(&end_time, NULL);
+
+            usecs[iter] = usec(start_time, end_time);
+            total_usec += usecs[iter];
+            MPI_Reduce(&my_carry_usec, &carry_usecs[iter], 1, MPI_DOUBLE,
+                       MPI_MAX, 0, MPI_COMM_WORLD);
+            total_carry_usec += carry_usecs[iter];
+
+            if (rank == 0) {
+                printf("%s iteration %d elapsed time: %d (usec), carry %.1f (usec)\n",
+                        carry_names[carry], iter, usecs[iter], carry_usecs[iter]);
+                fprintf(fp, "%s iteration %d elapsed time: %d (usec), carry %.1f (usec)\n",
+                        carry_names[carry], iter, usecs[iter], carry_usecs[iter]);
+            }
+        }
+
+#ifdef VERIFY
+        long my_last = local_prefix_sums[my_num_elems - 1];
+        long prev_last = 0;
+        MPI_Sendrecv(&my_last, 1, MPI_LONG,
+                     (rank == num_procs - 1) ? MPI_PROC_NULL : rank + 1, 1,
+                     &prev_last, 1, MPI_LONG,
+                     (rank == 0) ? MPI_PROC_NULL : rank - 1, 1,
+                     MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        int local_error = verify_local_prefix_sums(local_prefix_sums, local_data,
+                                                   my_num_elems, prev_last);
+        int my_error = (local_error < my_num_elems) ? start + local_error : num_elems;
+        int first_error = num_elems;
+        MPI_Allreduce(&my_error, &first_error, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+        if (my_error < num_elems && my_error == first_error) {
+            printf("Wrong %s prefix sum implementation: error at position %d\n",
+                    carry_names[carry], my_error);
+        }
+        if (first_error < num_elems)
+            MPI_Abort(MPI_COMM_WORLD, -1);
+#endif // #ifdef VERIFY
+
+        if (rank == 0) {
+            printf("%s carry average elapsed time: %d (usec), std %f, carry %.1f (usec)\n\n",
+                    carry_names[carry], total_usec / num_iters,
+                    calculate_standard_deviation(usecs, num_iters),
+                    total_carry_usec / num_iters);
+            fprintf(fp, "%s carry average elapsed time: %d (usec), std %f, carry %.1f (usec)\n\n",
+                    carry_names[carry], total_usec / num_iters,
+                    calculate_standard_deviation(usecs, num_iters),
+                    total_carry_usec / num_iters);
+        }
+    }
+
+    if (rank == 0) {
+        printf("Finish MPI Parallel Prefix Sum calculation\n");
+        fprintf(fp, "Finish MPI Parallel Prefix Sum calculation\n");
+        fclose(fp);
+    }
+
+    MPI_Win_unlock_all(win);
+    MPI_Win_free(&win);
+
+    free(local_data);
+    free(local_prefix_sums);
+    free(usecs);
+    free(carry_usecs);
+
+    MPI_Finalize();
+
+    return 0;
+}
@@ -0,0 +1,510 @@
+/*
+ * prefixsum_sat.c
+ *
+ * Description: Parallel 2D prefix sums (summed-area tables) of a grid of
+ * randomly generated integers using OpenMP, and with -DUSE_MPI also across
+ * MPI processes that each own a band of rows.
+ *
+ * out[i][j] is the sum of in[0..i][0..j], a row-wise scan followed by a
+ * column-wise scan. Three ways to compute the SAT of a band of rows are
+ * timed:
+ * - naive: every row is scanned (OpenMP over rows), then every column is
+ *   scanned top to bottom (OpenMP over columns), a stride-num_cols walk
+ *   that touches a new cache line per element;
+ * - two pass: the same row scans, then the column pass walks down strips of
+ *   columns row by row, so the adds of a row segment are one vector loop;
+ * - tiled: every thread owns a sub-band of rows and walks it in tiles of
+ *   TILE_ROWS x TILE_COLS. Inside a tile each row segment is scanned and
+ *   then added to the segment above it while both are in L1, so in and out
+ *   are swept once. The bottom rows of the sub-bands are scanned across the
+ *   threads (one OpenMP loop over columns) and every thread adds the carry
+ *   row of the sub-bands above to its rows.
+ *
+ * With USE_MPI the band totals are chained across the processes like the
+ * carries of prefixsum_mpi.c, with a row of num_cols sums as the message:
+ * process p receives the sum of the bands above from p - 1, adds its own
+ * band total and forwards it to p + 1, then adds the received row to all its
+ * rows (fused with the thread carries in the tiled mode).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <limits.h>
+#include <sys/time.h>
+#include <omp.h>
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
+
+#define MAX_INT 2147483647
+#define TILE_ROWS 16
+#define TILE_COLS 2048      // 16 KB of output per row segment
+#define NUM_MODES 3
+#define VERIFY
+
+// usec: calculate the time interval in microseconds
+inline suseconds_t usec(struct timeval start, struct timeval end)
+{
+  return ((double) (((end.tv_sec * 1000000 + end.tv_usec) -
+                     (start.tv_sec * 1000000 + start.tv_usec))));
+}
+
+double calculate_standard_deviation(suseconds_t *data, int n) {
+    double mean = 0.0;
+    double variance = 0.0;
+    double std_dev = 0.0;
+
+    for (int i = 0; i < n; i++) {
+        mean += (double)data[i];
+    }
+    mean /= n;
+
+    for (int i = 0; i < n; i++) {
+        variance += (data[i] - mean) * (data[i] - mean);
+    }
+    variance /= n;
+
+    std_dev = sqrt(variance);
+
+    return std_dev;
+}
+
+// scan_rows: row-wise scan of every row, OpenMP over rows
+void scan_rows(long *out, const int *in, int num_rows, int num_cols)
+{
+    int r, c;
+
+    #pragma omp parallel for schedule(static) private(c)
+    for (r = 0; r < num_rows; r++) {
+        const int *in_row = in + (long) r * num_cols;
+        long *out_row = out + (long) r * num_cols;
+        long sum = 0;
+        for (c = 0; c < num_cols; c++) {
+            sum += in_row[c];
+            out_row[c] = sum;
+        }
+    }
+}
+
+// sat_naive: row scans, then one column at a time down the whole band
+void sat_naive(long *out, const int *in, int num_rows, int num_cols)
+{
+    int r, c;
+
+    scan_rows(out, in, num_rows, num_cols);
+    #pragma omp parallel for schedule(static) private(r)
+    for (c = 0; c < num_cols; c++)
+        for (r = 1; r < num_rows; r++)
+            out[(long) r * num_cols + c] += out[(long) (r - 1) * num_cols + c];
+}
+
+// sat_two_pass: row scans, then strips of columns row by row
+void sat_two_pass(long *out, const int *in, int num_rows, int num_cols)
+{
+    scan_rows(out, in, num_rows, num_cols);
+
+    #pragma omp parallel
+    {
+        int tid = omp_get_thread_num();
+        int num_threads = omp_get_num_threads();
+        int c0 = (long) num_cols * tid / num_threads;
+        int c1 = (long) num_cols * (tid + 1) / num_threads;
+        int r, c;
+
+        for (r = 1; r < num_rows; r++) {
+            const long *prev_row = out + (long) (r - 1) * num_cols;
+            long *out_row = out + (long) r * num_cols;
+            for (c = c0; c < c1; c++)
+                out_row[c] += prev_row[c];
+        }
+    }
+}
+
+// sat_tile: rows [r0, r1) x columns [c0, c1) of the SAT of a sub-band whose
+// first row is top; row_carry[r - r0] holds the sum of in[r][0..c0) and is
+// advanced to in[r][0..c1)
+static inline void sat_tile(long *out, const int *in, int num_cols, int top,
+                            int r0, int r1, int c0, int c1, long *row_carry)
+{
+    int r, c;
+
+    for (r = r0; r < r1; r++) {
+        const int *in_row = in + (long) r * num_cols;
+        long *out_row = out + (long) r * num_cols;
+        long sum = row_carry[r - r0];
+        for (c = c0; c < c1; c++) {
+            sum += in_row[c];
+            out_row[c] = sum;
+        }
+        row_carry[r - r0] = sum;
+        if (r > top) {
+            const long *prev_row = out - num_cols + (long) r * num_cols;
+            for (c = c0; c < c1; c++)
+                out_row[c] += prev_row[c];
+        }
+    }
+}
+
+// sat_tiled: SAT of every thread's sub-band in tiles, then the scan of the
+// sub-band bottom rows across the threads. carries holds num_threads + 1
+// rows: on return row t is the sum of the sub-bands above thread t and the
+// last row the total of the band; add_carries applies them
+void sat_tiled(long *out, const int *in, int num_rows, int num_cols,
+               long *carries)
+{
+    #pragma omp parallel
+    {
+        int tid = omp_get_thread_num();
+        int num_threads = omp_get_num_threads();
+        int r0 = (long) num_rows * tid / num_threads;
+        int r1 = (long) num_rows * (tid + 1) / num_threads;
+        long row_carry[TILE_ROWS];
+        long *mine = carries + (long) tid * num_cols;
+        int tr, c0, c;
+
+        for (tr = r0; tr < r1; tr += TILE_ROWS) {
+            int tr1 = (tr + TILE_ROWS < r1) ? tr + TILE_ROWS : r1;
+            memset(row_carry, 0, sizeof(row_carry));
+            for (c0 = 0; c0 < num_cols; c0 += TILE_COLS) {
+                int c1 = (c0 + TILE_COLS < num_cols) ? c0 + TILE_COLS : num_cols;
+                sat_tile(out, in, num_cols, r0, tr, tr1, c0, c1, row_carry);
+            }
+        }
+
+        if (r1 > r0)
+            memcpy(mine, out + (long) (r1 - 1) * num_cols, sizeof(long) * num_cols);
+        else
+            memset(mine, 0, sizeof(long) * num_cols);
+        #pragma omp barrier
+
+        // exclusive scan of the sub-band totals, one column per iteration
+        #pragma omp for schedule(static)
+        for (c = 0; c < num_cols; c++) {
+            long running = 0;
+            for (int t = 0; t < num_threads; t++) {
+                long total = carries[(long) t * num_cols + c];
+                carries[(long) t * num_cols + c] = running;
+                running += total;
+            }
+            carries[(long) num_threads * num_cols + c] = running;
+        }
+    }
+}
+
+// add_carries: add to the rows of every thread its row of thread_carries
+// (the sub-band split of sat_tiled, NULL for none) plus carry_in (the sum of
+// the bands of the previous processes, NULL for none)
+void add_carries(long *out, int num_rows, int num_cols, long *thread_carries,
+                 const long *carry_in)
+{
+    if (thread_carries == NULL && carry_in == NULL)
+        return;
+
+    #pragma omp parallel
+    {
+        int tid = omp_get_thread_num();
+        int num_threads = omp_get_num_threads();
+        int r0 = (long) num_rows * tid / num_threads;
+        int r1 = (long) num_rows * (tid + 1) / num_threads;
+        const long *add = carry_in;
+        int r, c;
+
+        if (thread_carries != NULL) {
+            long *mine = thread_carries + (long) tid * num_cols;
+            if (carry_in != NULL)
+                for (c = 0; c < num_cols; c++)
+                    mine[c] += carry_in[c];
+            add = mine;
+        }
+        // the first sub-band of the first band has nothing above it
+        if (add != NULL && (tid > 0 || carry_in != NULL)) {
+            for (r = r0; r < r1; r++) {
+                long *out_row = out + (long) r * num_cols;
+                for (c = 0; c < num_cols; c++)
+                    out_row[c] += add[c];
+            }
+        }
+    }
+}
+
+#ifdef VERIFY
+// verify_sat: check out[r][c] - out[r-1][c] - out[r][c-1] + out[r-1][c-1]
+// == in[r][c] in place, with prev_row the last row of the band above (zeros
+// for the first band). Returns the first wrong position of the band as
+// r * num_cols + c, or LONG_MAX if all is right.
+long verify_sat(const long *out, const int *in, int num_rows, int num_cols,
+                const long *prev_row)
+{
+    long first_error = LONG_MAX;
+    int r;
+
+    #pragma omp parallel for schedule(static) reduction(min:first_error)
+    for (r = 0; r < num_rows; r++) {
+        const long *above = (r == 0) ? prev_row : out + (long) (r - 1) * num_cols;
+        const long *out_row = out + (long) r * num_cols;
+        const int *in_row = in + (long) r * num_cols;
+        for (int c = 0; c < num_cols; c++) {
+            long left = (c == 0) ? 0 : out_row[c - 1];
+            long corner = (c == 0) ? 0 : above[c - 1];
+            if (out_row[c] - above[c] - left + corner != in_row[c]) {
+                if ((long) r * num_cols + c < first_error)
+                    first_error = (long) r * num_cols + c;
+                break;
+            }
+        }
+    }
+
+    return first_error;
+}
+#endif // #ifdef VERIFY
+
+int main(int argc, char *argv[])
+{
+    int num_rows = 0;
+    int num_cols = 0;
+    int num_iters = 0;
+    int num_threads = 0;
+    int rank = 0;
+    int num_procs = 1;
+
+    struct timeval start_time, end_time;  // for gettimeofday to calculate timing
+
+#ifdef USE_MPI
+    char filename[256] = "prefixsum_sat_mpi_";
+    MPI_Status status;
+    MPI_Request request;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &num_procs);
+#else
+    char filename[256] = "prefixsum_sat_";
+#endif
+    FILE *fp = NULL;
+
+    if (argc < 5) {
+        if (rank == 0) {
+            printf("Usage: %s [num_rows] [num_cols] [num_iters] [num_threads]\n", argv[0]);
+            printf("    - num_rows:  number of grid rows\n");
+            printf("    - num_cols:  number of grid columns\n");
+            printf("    - num_iters: number of iterations\n");
+            printf("    - num_threads: number of threads (per process)\n");
+        }
+#ifdef USE_MPI
+        MPI_Finalize();
+#endif
+        exit(-1);
+    }
+
+    num_rows = atoi(argv[1]);
+    num_cols = atoi(argv[2]);
+    num_iters = atoi(argv[3]);
+    num_threads = atoi(argv[4]);
+
+    if (num_threads < 1 || num_iters < 1 || num_cols < 1 || num_rows < num_procs) {
+        if (rank == 0)
+            printf("Threads, iterations and columns should be positive, and every process needs a row!\n");
+#ifdef USE_MPI
+        MPI_Finalize();
+#endif
+        exit(-1);
+    }
+
+    strcat(filename, argv[1]);
+    strcat(filename, "rows_");
+    strcat(filename, argv[2]);
+    strcat(filename, "cols_");
+    strcat(filename, argv[3]);
+    strcat(filename, "iters_");
+    strcat(filename, argv[4]);
+#ifdef USE_MPI
+    char nprocs[16];
+    sprintf(nprocs, "%d", num_procs);
+    strcat(filename, "threads_");
+    strcat(filename, nprocs);
+    strcat(filename, "procs.txt");
+#else
+    strcat(filename, "threads.txt");
+#endif
+
+    if (rank == 0) {
+        fp = fopen(filename, "w");
+        if (fp) {
+            printf("Command line: %s %d %d %d %d (%d procs)\n",
+                    argv[0], num_rows, num_cols, num_iters, num_threads, num_procs);
+            printf("Stats file: %s\n\n", filename);
+            fprintf(fp, "Command line: %s %d %d %d %d (%d procs)\n",
+                    argv[0], num_rows, num_cols, num_iters, num_threads, num_procs);
+            fprintf(fp, "Stats file: %s\n\n", filename);
+        } else {
+            printf("ERROR: can't open the file %s!\n", filename);
+#ifdef USE_MPI
+            MPI_Abort(MPI_COMM_WORLD, -1);
+#endif
+            exit(-1);
+        }
+    }
+
+    // row band of this process
+    int rows_mean = num_rows / num_procs;
+    int rows_remain = num_rows % num_procs;
+    int my_rows = rows_mean + (rank < rows_remain ? 1 : 0);
+    int my_first_row = rank * rows_mean + (rank < rows_remain ? rank : rows_remain);
+    long my_elems = (long) my_rows * num_cols;
+
+    // Memory allocation
+    int *in = (int *) malloc(sizeof(int) * my_elems);
+    long *out = (long *) malloc(sizeof(long) * my_elems);
+    long *carries = (long *) malloc(sizeof(long) * (num_threads + 1) * num_cols);
+    long *carry_in = (long *) malloc(sizeof(long) * num_cols);
+    long *carry_out = (long *) malloc(sizeof(long) * num_cols);
+    suseconds_t *usecs = (suseconds_t *) malloc(sizeof(suseconds_t) * num_iters);
+    if (in == NULL || out == NULL || carries == NULL || carry_in == NULL ||
+        carry_out == NULL || usecs == NULL) {
+        printf("Failed in malloc()\n");
+        printf(" - in: %p\n", in);
+        printf(" - out: %p\n", out);
+        printf(" - carries: %p\n", carries);
+#ifdef USE_MPI
+        MPI_Abort(MPI_COMM_WORLD, -2);
+#endif
+        exit(-2);
+    }
+
+    // set number of threads
+    omp_set_num_threads(num_threads);
+
+    // Generate random ints in parallel, small enough for the grid total to
+    // fit in an int
+    long K = MAX_INT / ((long) num_rows * num_cols);
+    if (K < 2)
+        K = 2;
+
+    #pragma omp parallel
+    {
+        unsigned int seed = omp_get_thread_num() + time(NULL) + 7919 * rank;
+        long i;
+        #pragma omp for schedule(static)
+        for (i = 0; i < my_elems; i++) {
+            in[i] = rand_r(&seed) % K;
+            out[i] = 0;
+        }
+    }
+
+    if (rank == 0) {
+        printf("Start ...\n");
+        fprintf(fp, "Start ...\n");
+    }
+
+    const char *mode_names[NUM_MODES] = {"naive", "two pass", "tiled"};
+    int failed = 0;
+    for (int mode = 0; mode < NUM_MODES; mode++) {
+        suseconds_t total_usec = 0;
+        for (int iter = 0; iter < num_iters; iter++) {
+#ifdef USE_MPI
+            MPI_Barrier(MPI_COMM_WORLD);
+#endif
+            gettimeofday(&start_time, NULL);
+
+            // band-local SAT, the row above the band taken as zeros
+            const long *band_total;
+            long *thread_carries = NULL;
+            if (mode == 0) {
+                sat_naive(out, in, my_rows, num_cols);
+                band_total = out + (long) (my_rows - 1) * num_cols;
+            } else if (mode == 1) {
+                sat_two_pass(out, in, my_rows, num_cols);
+                band_total = out + (long) (my_rows - 1) * num_cols;
+            } else {
+                sat_tiled(out, in, my_rows, num_cols, carries);
+                thread_carries = carries;
+                band_total = carries + (long) num_threads * num_cols;
+            }
+
+#ifdef USE_MPI
+            // chain the band totals down the processes as prefixsum_mpi.c
+            // chains its carries
+            if (rank != 0) {
+                MPI_Recv(carry_in, num_cols, MPI_LONG, rank - 1, 0, MPI_COMM_WORLD, &status);
+                for (int c = 0; c < num_cols; c++)
+                    carry_out[c] = band_total[c] + carry_in[c];
+            } else {
+                memcpy(carry_out, band_total, sizeof(long) * num_cols);
+            }
+            if (rank != num_procs - 1)
+                MPI_Isend(carry_out, num_cols, MPI_LONG, rank + 1, 0, MPI_COMM_WORLD, &request);
+            add_carries(out, my_rows, num_cols, thread_carries,
+                        (rank != 0) ? carry_in : NULL);
+            if (rank != num_procs - 1)
+                MPI_Wait(&request, &status);
+            MPI_Barrier(MPI_COMM_WORLD);
+#else
+            (void) band_total;
+            add_carries(out, my_rows, num_cols, thread_carries, NULL);
+#endif
+
+            gettimeofday(&end_time, NULL);
+            usecs[iter] = usec(start_time, end_time);
+            total_usec += usecs[iter];
+        }
+
+        if (rank == 0) {
+            suseconds_t avg_usec = total_usec / num_iters;
+            double pixels = (double) num_rows * num_cols;
+            printf("%-8s: %d (usec), std %f, %.1f Mpixels/s\n", mode_names[mode],
+                    avg_usec, calculate_standard_deviation(usecs, num_iters),
+                    avg_usec > 0 ? pixels / avg_usec : 0.0);
+            fprintf(fp, "%-8s: %d (usec), std %f, %.1f Mpixels/s\n", mode_names[mode],
+                    avg_usec, calculate_standard_deviation(usecs, num_iters),
+                    avg_usec > 0 ? pixels / avg_usec : 0.0);
+        }
+
+#ifdef VERIFY
+        // the last row of the band above is the only remote input
+        memset(carry_in, 0, sizeof(long) * num_cols);
+#ifdef USE_MPI
+        MPI_Sendrecv(out + (long) (my_rows - 1) * num_cols, num_cols, MPI_LONG,
+                     (rank == num_procs - 1) ? MPI_PROC_NULL : rank + 1, 1,
+                     carry_in, num_cols, MPI_LONG,
+                     (rank == 0) ? MPI_PROC_NULL : rank - 1, 1,
+                     MPI_COMM_WORLD, &status);
+#endif
+        long my_error = verify_sat(out, in, my_rows, num_cols, carry_in);
+        if (my_error != LONG_MAX)
+            my_error += (long) my_first_row * num_cols;
+        long first_error = my_error;
+#ifdef USE_MPI
+        MPI_Allreduce(&my_error, &first_error, 1, MPI_LONG, MPI_MIN, MPI_COMM_WORLD);
+#endif
+        if (first_error != LONG_MAX) {
+            if (rank == 0)
+                printf("Wrong %s summed-area table: error at row %ld, column %ld\n",
+                        mode_names[mode], first_error / num_cols, first_error % num_cols);
+            failed = 1;
+        }
+#endif // #ifdef VERIFY
+    }
+
+    if (rank == 0) {
+        printf("Finish Parallel Summed-Area Table calculation\n");
+        fprintf(fp, "Finish Parallel Summed-Area Table calculation\n");
+        fclose(fp);
+    }
+
+    // free the allocated memory
+    free(in);
+    free(out);
+    free(carries);
+    free(carry_in);
+    free(carry_out);
+    free(usecs);
+
+#ifdef USE_MPI
+    MPI_Finalize();
+#endif
+
+    return failed ? -1 : 0;
+}
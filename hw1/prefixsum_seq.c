@@ -9,6 +9,11 @@
  * 2. The processor compute the prefix sums from the first element to the last
  *    one. Next prefix sum equals to the sum of its corresponding integer and
  *    the previous prefix sum. The computation complexity is O(N).
+ *
+ * With a baseline (a stats file of an earlier run of the same arguments) the
+ * run is written to <stats file>_compare.txt and its iteration times are
+ * tested against the baseline (compare.h); a significant slowdown exits
+ * with COMPARE_REGRESSION.
  */
 
 #include <stdio.h>
@@ -20,6 +25,8 @@
 #include <sys/time.h>
 #include <math.h>
 
+#include "compare.h"
+
 #define MAX_INT 2147483647
 //#define PRINT_PREFIXSUM
 
@@ -64,9 +71,10 @@ int main(int argc, char *argv[])
     FILE *fp = NULL;
 
     if (argc < 3) {
-        printf("Usage: %s [num_elems] [num_iters]\n", argv[0]);
+        printf("Usage: %s [num_elems] [num_iters] [baseline]\n", argv[0]);
         printf("    - num_elems:  number of elements\n");
         printf("    - num_iters: number of iterations\n");
+        printf("    - baseline: stats file to compare with (optional)\n");
         exit(-1);
     }
 
@@ -78,6 +86,22 @@ int main(int argc, char *argv[])
     strcat(filename, argv[2]);
     strcat(filename, "iters.txt");
 
+    // compare mode: read the baseline before a stats file of the same name
+    // is written, and keep it by writing this run to _compare.txt
+    suseconds_t *baseline = NULL;
+    int num_baseline = 0;
+    if (argc > 3) {
+        num_baseline = compare_load_baseline(argv[3], filename, &baseline);
+        if (num_baseline == -2) {
+            printf("ERROR: %s is not a baseline of %s!\n", argv[3], filename);
+            exit(-1);
+        } else if (num_baseline < 0) {
+            printf("ERROR: can't read the baseline %s!\n", argv[3]);
+            exit(-1);
+        }
+        strcpy(filename + strlen(filename) - strlen(".txt"), "_compare.txt");
+    }
+
     fp = fopen(filename, "w");
     if (fp) {
         printf("Command line: %s %d %d\n", argv[0], num_elems, num_iters);
@@ -112,7 +136,7 @@ int main(int argc, char *argv[])
     suseconds_t iter_usec = 0;
     suseconds_t total_usec = 0;
     suseconds_t *usecs;
-    usecs = (suseconds_t *)malloc(sizeof(suseconds_t) * 10);
+    usecs = (suseconds_t *)malloc(sizeof(suseconds_t) * num_iters);
     int iter;
     for (iter = 0; iter < num_iters; iter++) {
 
@@ -148,7 +172,7 @@ int main(int argc, char *argv[])
     fprintf(fp, "Prefix Sum average elapsed time: %d (usec)\n",
             total_usec / num_iters);
 
-    double std_dev = calculate_standard_deviation(usecs, 10);
+    double std_dev = calculate_standard_deviation(usecs, num_iters);
     printf("Prefix Sum std: %f (std_dev)\n",
             std_dev);
     fprintf(fp, "Prefix Sum std: %f (std_dev)\n",
@@ -170,8 +194,15 @@ int main(int argc, char *argv[])
     free(data);
     free(prefix_sums);
 
+    int regression = 0;
+    if (baseline != NULL)
+        regression = compare_report(fp, argv[3], baseline, num_baseline,
+                                    usecs, num_iters);
+    free(baseline);
+    free(usecs);
+
     fclose(fp);
 
-    return 0;
+    return regression ? COMPARE_REGRESSION : 0;
 }
 
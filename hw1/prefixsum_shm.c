@@ -0,0 +1,374 @@
+/*
+ * prefixsum_shm.c
+ *
+ * Description: Parallel implementation of Prefix Sum program to sum a
+ * sequence of randomly generated integers using MPI, where the processors of
+ * one node share their prefix sums through an MPI-3 shared-memory window.
+ *
+ * Procedure:
+ * 1. MPI_COMM_WORLD is split into one communicator per node
+ *    (MPI_Comm_split_type with MPI_COMM_TYPE_SHARED) and the node leaders
+ *    (node rank 0) form a leader communicator. The elements are partitioned
+ *    node by node and, inside a node, by node rank, so the partitions of a
+ *    node are consecutive;
+ * 2. The prefix sums of a node live in one MPI_Win_allocate_shared segment:
+ *    every processor owns its slice, and the slices are contiguous, so the
+ *    node leader sees the node-level result as one array without copies;
+ * 3. shared mode: each processor scans its slice in place and stores its
+ *    local total in a shared totals array. After a node barrier, the leader
+ *    sums the node's totals and gets the node's base with one MPI_Exscan
+ *    over the leaders; every processor then reads the node base and the
+ *    totals of its predecessors on the node directly from shared memory and
+ *    adds them to its slice;
+ * 4. private mode: the prefixsum_mpi.c layout for comparison, private
+ *    local_prefix_sums and MPI_Exscan of the local totals over all the
+ *    processors.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <mpi.h>
+
+#define MAX_INT 2147483647
+#define VERIFY
+
+#define NUM_MODES 2
+
+// usec: calculate the time interval in microseconds
+inline suseconds_t usec(struct timeval start, struct timeval end)
+{
+  return ((double) (((end.tv_sec * 1000000 + end.tv_usec) -
+                     (start.tv_sec * 1000000 + start.tv_usec))));
+}
+
+double calculate_standard_deviation(suseconds_t *data, int n) {
+    double mean = 0.0;
+    double variance = 0.0;
+    double std_dev = 0.0;
+
+    for (int i = 0; i < n; i++) {
+        mean += (double)data[i];
+    }
+    mean /= n;
+
+    for (int i = 0; i < n; i++) {
+        variance += (data[i] - mean) * (data[i] - mean);
+    }
+    variance /= n;
+
+    std_dev = sqrt(variance);
+
+    return std_dev;
+}
+
+// node_sync: make the shared-memory stores of the node visible to all of its
+// processors (MPI-3 unified memory model: sync, barrier, sync)
+static void node_sync(MPI_Win win, MPI_Comm node_comm)
+{
+    MPI_Win_sync(win);
+    MPI_Barrier(node_comm);
+    MPI_Win_sync(win);
+}
+
+#ifdef VERIFY
+// verify_local_prefix_sums: see prefixsum_mpi.c
+int verify_local_prefix_sums(long *local_prefix_sums, int *local_data,
+                             int my_num_elems, long prev_last)
+{
+    int i;
+    for (i = 0; i < my_num_elems; i++) {
+        long prev = (i == 0) ? prev_last : local_prefix_sums[i-1];
+        if (local_prefix_sums[i] - prev != local_data[i])
+            break;
+    }
+    return i;
+}
+#endif // #ifdef VERIFY
+
+int main(int argc, char *argv[])
+{
+    // command line arguments
+    int num_elems = 0;
+    int num_iters = 0;
+    int num_procs = 0;
+
+    int rank;
+
+    // per-processor local memory pointers
+    int *local_data = NULL;
+    long *local_prefix_sums = NULL;
+
+    struct timeval start_time, end_time;  // for gettimeofday to calculate timing
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);  // getting the ID for this process
+
+    if (argc < 3) {
+        if (rank == 0) {
+            printf("Usage: %s [num_elems] [num_iters]\n", argv[0]);
+            printf("    - num_elems:  number of elements\n");
+            printf("    - num_iters: number of iterations\n");
+        }
+
+        MPI_Finalize();
+        exit(-1);
+    }
+
+    num_elems = atoi(argv[1]);
+    num_iters = atoi(argv[2]);
+
+    MPI_Comm_size(MPI_COMM_WORLD, &num_procs); // get the number of processes
+
+    if (num_elems < num_procs || num_iters < 1) {
+        if (rank == 0)
+            printf("Every processor needs at least one element and one iteration!\n");
+        MPI_Finalize();
+        exit(-1);
+    }
+
+    // node communicator and node leader communicator
+    MPI_Comm node_comm, leader_comm;
+    int node_rank, node_size;
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0,
+                        MPI_INFO_NULL, &node_comm);
+    MPI_Comm_rank(node_comm, &node_rank);
+    MPI_Comm_size(node_comm, &node_size);
+    MPI_Comm_split(MPI_COMM_WORLD, node_rank == 0 ? 0 : MPI_UNDEFINED, rank,
+                   &leader_comm);
+
+    // scan order: nodes in leader order, then node ranks. scan_rank is the
+    // position of this processor in the global partition
+    int node_first = 0, num_nodes = 0;
+    if (node_rank == 0) {
+        int leader_rank;
+        MPI_Comm_rank(leader_comm, &leader_rank);
+        MPI_Comm_size(leader_comm, &num_nodes);
+        MPI_Exscan(&node_size, &node_first, 1, MPI_INT, MPI_SUM, leader_comm);
+        if (leader_rank == 0)
+            node_first = 0;     // MPI_Exscan leaves it undefined
+    }
+    MPI_Bcast(&node_first, 1, MPI_INT, 0, node_comm);
+    MPI_Bcast(&num_nodes, 1, MPI_INT, 0, node_comm);
+    int scan_rank = node_first + node_rank;
+    MPI_Comm scan_comm;
+    MPI_Comm_split(MPI_COMM_WORLD, 0, scan_rank, &scan_comm);
+
+    char filename[256] = "prefixsum_shm_";
+    char nprocs[16];
+    sprintf(nprocs, "%d", num_procs);
+    FILE *fp = NULL;
+
+    strcat(filename, argv[1]);
+    strcat(filename, "elems_");
+    strcat(filename, argv[2]);
+    strcat(filename, "iters_");
+    strcat(filename, nprocs);
+    strcat(filename, "procs.txt");
+
+    if (rank == 0) {
+        fp = fopen(filename, "w");
+        if (fp) {
+            printf("Command line: mpirun -np %d %s %d %d\n",
+                    num_procs, argv[0], num_elems, num_iters);
+            printf("Stats file: %s\n", filename);
+            printf("Nodes: %d\n\n", num_nodes);
+            fprintf(fp, "Command line: mpirun -np %d %s %d %d\n",
+                    num_procs, argv[0], num_elems, num_iters);
+            fprintf(fp, "Stats file: %s\n", filename);
+            fprintf(fp, "Nodes: %d\n\n", num_nodes);
+        } else {
+            printf("ERROR: can't open the file %s!\n", filename);
+            MPI_Abort(MPI_COMM_WORLD, -1);
+        }
+    }
+
+    // data patition by scan rank
+    int my_num_elems;
+    int num_elems_mean = num_elems / num_procs;
+    int num_elems_remain = num_elems % num_procs;
+    int start;
+    if (scan_rank < num_elems_remain) {
+        my_num_elems = num_elems_mean + 1;
+        start = scan_rank * (num_elems_mean + 1);
+    } else {
+        my_num_elems = num_elems_mean;
+        start = scan_rank * num_elems_mean + num_elems_remain;
+    }
+    int node_start = start;
+    MPI_Bcast(&node_start, 1, MPI_INT, 0, node_comm);
+
+    // Memory allocation: private input and private prefix sums, shared
+    // prefix sums and shared totals (node_size totals and the node base)
+    local_data = (int *) malloc(sizeof(int) * my_num_elems);
+    local_prefix_sums = (long *) malloc(sizeof(long) * my_num_elems);
+    suseconds_t *usecs = (suseconds_t *) malloc(sizeof(suseconds_t) * num_iters);
+    if (local_data == NULL || local_prefix_sums == NULL || usecs == NULL) {
+        printf("Processor %d failed in malloc.\n", rank);
+        printf(" - local_data: %p\n", local_data);
+        printf(" - local_prefix_sums: %p\n", local_prefix_sums);
+        MPI_Abort(MPI_COMM_WORLD, -2);
+    }
+
+    long *my_shared_sums = NULL, *node_sums = NULL;
+    long *my_totals = NULL, *totals = NULL;
+    MPI_Win sums_win, totals_win;
+    MPI_Aint seg_size;
+    int disp_unit;
+    MPI_Win_allocate_shared(sizeof(long) * my_num_elems, sizeof(long),
+                            MPI_INFO_NULL, node_comm, &my_shared_sums, &sums_win);
+    MPI_Win_shared_query(sums_win, 0, &seg_size, &disp_unit, &node_sums);
+    MPI_Win_allocate_shared(node_rank == 0 ? sizeof(long) * (node_size + 1) : 0,
+                            sizeof(long), MPI_INFO_NULL, node_comm,
+                            &my_totals, &totals_win);
+    MPI_Win_shared_query(totals_win, 0, &seg_size, &disp_unit, &totals);
+    if (my_shared_sums != node_sums + (start - node_start)) {
+        printf("Processor %d: the shared segment of the node is not contiguous\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, -2);
+    }
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, sums_win);
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, totals_win);
+
+    // generate input data
+    srand(rank + time(NULL));
+    int i;
+    int K = MAX_INT / num_elems;
+    for (i = 0; i < my_num_elems; i++) {
+        local_data[i] = rand() % K;
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);    // Global barrier
+
+    if (rank == 0) {
+        printf("Start ...\n");
+        fprintf(fp, "Start ...\n");
+    }
+
+    const char *mode_names[NUM_MODES] = {"private", "shared"};
+    int mode, iter;
+    for (mode = 0; mode < NUM_MODES; mode++) {
+        long *sums = (mode == 0) ? local_prefix_sums : my_shared_sums;
+        suseconds_t total_usec = 0;
+
+        for (iter = 0; iter < num_iters; iter++) {
+            // copy the input array to the prefix sum array for initialization
+            for (i = 0; i < my_num_elems; i++) {
+                sums[i] = local_data[i];
+            }
+
+            MPI_Barrier(MPI_COMM_WORLD);
+            gettimeofday(&start_time, NULL);
+
+            for (i = 1; i < my_num_elems; i++) {
+                sums[i] += sums[i-1];
+            }
+
+            long base = 0;
+            if (mode == 0) {
+                MPI_Exscan(&sums[my_num_elems - 1], &base, 1, MPI_LONG,
+                           MPI_SUM, scan_comm);
+                if (scan_rank == 0)
+                    base = 0;
+            } else {
+                totals[node_rank] = sums[my_num_elems - 1];
+                node_sync(totals_win, node_comm);
+                if (node_rank == 0) {
+                    long node_total = 0, node_base = 0;
+                    for (i = 0; i < node_size; i++)
+                        node_total += totals[i];
+                    MPI_Exscan(&node_total, &node_base, 1, MPI_LONG, MPI_SUM,
+                               leader_comm);
+                    totals[node_size] = (node_first == 0) ? 0 : node_base;
+                }
+                node_sync(totals_win, node_comm);
+                base = totals[node_size];
+                for (i = 0; i < node_rank; i++)
+                    base += totals[i];
+            }
+
+            for (i = 0; i < my_num_elems; i++) {
+                sums[i] += base;
+            }
+
+            MPI_Barrier(MPI_COMM_WORLD);
+            gettimeofday(&end_time, NULL);
+
+            usecs[iter] = usec(start_time, end_time);
+            total_usec += usecs[iter];
+
+            if (rank == 0) {
+                printf("%s iteration %d elapsed time: %d (usec)\n",
+                        mode_names[mode], iter, usecs[iter]);
+                fprintf(fp, "%s iteration %d elapsed time: %d (usec)\n",
+                        mode_names[mode], iter, usecs[iter]);
+            }
+        }
+
+#ifdef VERIFY
+        // the element before this slice: on the node it is read from the
+        // shared segment, otherwise it comes from the previous processor in
+        // scan order
+        long my_last = sums[my_num_elems - 1];
+        long prev_last = 0;
+        MPI_Sendrecv(&my_last, 1, MPI_LONG,
+                     (scan_rank == num_procs - 1) ? MPI_PROC_NULL : scan_rank + 1, 1,
+                     &prev_last, 1, MPI_LONG,
+                     (scan_rank == 0) ? MPI_PROC_NULL : scan_rank - 1, 1,
+                     scan_comm, MPI_STATUS_IGNORE);
+        if (mode == 1) {
+            MPI_Win_sync(sums_win);
+            if (node_rank > 0 && sums[-1] != prev_last) {
+                printf("Processor %d: the shared segment disagrees with its neighbour\n", rank);
+                MPI_Abort(MPI_COMM_WORLD, -1);
+            }
+        }
+        int local_error = verify_local_prefix_sums(sums, local_data,
+                                                   my_num_elems, prev_last);
+        int my_error = (local_error < my_num_elems) ? start + local_error : num_elems;
+        int first_error = num_elems;
+        MPI_Allreduce(&my_error, &first_error, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+        if (my_error < num_elems && my_error == first_error) {
+            printf("Wrong %s prefix sum implementation: error at position %d\n",
+                    mode_names[mode], my_error);
+        }
+        if (first_error < num_elems)
+            MPI_Abort(MPI_COMM_WORLD, -1);
+#endif // #ifdef VERIFY
+
+        if (rank == 0) {
+            printf("%s average elapsed time: %d (usec), std %f\n\n",
+                    mode_names[mode], total_usec / num_iters,
+                    calculate_standard_deviation(usecs, num_iters));
+            fprintf(fp, "%s average elapsed time: %d (usec), std %f\n\n",
+                    mode_names[mode], total_usec / num_iters,
+                    calculate_standard_deviation(usecs, num_iters));
+        }
+    }
+
+    if (rank == 0) {
+        printf("Finish MPI Shared-Memory Prefix Sum calculation\n");
+        fprintf(fp, "Finish MPI Shared-Memory Prefix Sum calculation\n");
+        fclose(fp);
+    }
+
+    MPI_Win_unlock_all(totals_win);
+    MPI_Win_unlock_all(sums_win);
+    MPI_Win_free(&totals_win);
+    MPI_Win_free(&sums_win);
+    if (leader_comm != MPI_COMM_NULL)
+        MPI_Comm_free(&leader_comm);
+    MPI_Comm_free(&node_comm);
+    MPI_Comm_free(&scan_comm);
+
+    free(local_data);
+    free(local_prefix_sums);
+    free(usecs);
+
+    MPI_Finalize();
+
+    return 0;
+}
@@ -0,0 +1,480 @@
+/*
+ * prefixsum_sweep.c
+ *
+ * Description: Working-set size sweep of the int -> long scan kernels using
+ * OpenMP, from L1-resident arrays to DRAM, so the cache cliffs of every
+ * kernel and the sizes where one kernel overtakes another are visible.
+ *
+ * Procedure:
+ * 1. All the threads generate the input of the largest size (in parallel
+ *    OpenMP region); a working set is the input plus the output, 12 bytes
+ *    per element;
+ * 2. The working set grows from MIN_BYTES to max_bytes in steps of
+ *    2^(1/STEPS_PER_DOUBLING); every size scans the first elements of the
+ *    same arrays, so a small working set stays in cache between calls;
+ * 3. The kernels:
+ *    - scalar: the serial loop of prefixsum_seq.c;
+ *    - simd: serial, four elements per step in 16-byte vectors, the carry
+ *      chain is one add per vector;
+ *    - two pass: every thread sums its chunk, then scans it from the sum of
+ *      the chunks before it (reads the input twice, writes once);
+ *    - scan-add: scan_i32_i64 of libprefixsum, every thread scans its chunk,
+ *      then adds the carry (reads the output again);
+ *    - tiled: the two pass in rounds of TILE_ELEMS per thread, the second
+ *      read of a tile hits the cache; one barrier per round;
+ *    - single pass: tiles taken in order from a shared counter, each tile
+ *      publishes its sum and looks back over the previous tiles for its
+ *      carry (chained scan with decoupled look-back), no barrier at all;
+ *    the parallel kernels scan their chunks and tiles with the simd loop;
+ * 4. Every kernel is repeated until a sample takes MIN_SAMPLE_USEC, the
+ *    median of NUM_SAMPLES samples is reported as ns per element and GB/s
+ *    of the working set, with the fastest kernel of every size.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <sched.h>
+#include <sys/time.h>
+#include <omp.h>
+
+#include "prefixsum.h"
+
+#define MAX_INT 2147483647
+#define MIN_BYTES 1024
+#define STEPS_PER_DOUBLING 2
+#define BYTES_PER_ELEM (sizeof(int) + sizeof(long))
+#define TILE_ELEMS 8192                 // 96 KB of working set per tile
+#define NUM_SAMPLES 5
+#define MIN_SAMPLE_USEC 2000
+#define NUM_KERNELS 6
+#define VERIFY
+
+typedef long v2l_t __attribute__((vector_size(16)));
+typedef int v4i_t __attribute__((vector_size(16)));
+
+// status of a tile of the single pass kernel, one cache line each; flag is
+// 2 * epoch + 1 once the aggregate is set and 2 * epoch + 2 once the
+// inclusive prefix is, so the flags of the previous call read as unset
+typedef struct {
+    long aggregate;
+    long inclusive;
+    long flag;
+} __attribute__((aligned(64))) tile_status_t;
+
+typedef struct {
+    int num_threads;
+    scan_ctx_t *scan;
+    long *carries;              // two rounds of one cache line per thread
+    tile_status_t *status;      // one per tile of the largest size
+    long epoch;
+} sweep_ctx_t;
+
+typedef void (*kernel_t)(sweep_ctx_t *ctx, const int *in, long *out, long n);
+
+// usec: calculate the time interval in microseconds
+inline suseconds_t usec(struct timeval start, struct timeval end)
+{
+  return ((double) (((end.tv_sec * 1000000 + end.tv_usec) -
+                     (start.tv_sec * 1000000 + start.tv_usec))));
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+// scan_simd_run: out[i] = base + in[0] + ... + in[i]; returns the last one.
+// Each vector is scanned in two 2-lane halves without the carry, so the
+// carry only passes through one add per four elements.
+static inline long scan_simd_run(const int *in, long *out, long n, long base)
+{
+    const v2l_t zero = {0, 0};
+    v2l_t carry = zero + base;
+    long i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        v4i_t x;
+        memcpy(&x, in + i, sizeof(x));
+        v2l_t lo = {x[0], x[1]};
+        v2l_t hi = {x[2], x[3]};
+        lo += __builtin_shuffle(zero, lo, (v2l_t) {0, 2});
+        hi += __builtin_shuffle(zero, hi, (v2l_t) {0, 2}) + lo[1];
+        lo += carry;
+        hi += carry;
+        memcpy(out + i, &lo, sizeof(lo));
+        memcpy(out + i + 2, &hi, sizeof(hi));
+        carry = zero + hi[1];
+    }
+    long sum = carry[0];
+    for (; i < n; i++) {
+        sum += in[i];
+        out[i] = sum;
+    }
+
+    return sum;
+}
+
+static inline long sum_run(const int *in, long n)
+{
+    long sum = 0;
+    for (long i = 0; i < n; i++)
+        sum += in[i];
+    return sum;
+}
+
+static void scan_scalar(sweep_ctx_t *ctx, const int *in, long *out, long n)
+{
+    (void) ctx;
+    long sum = 0;
+    for (long i = 0; i < n; i++) {
+        sum += in[i];
+        out[i] = sum;
+    }
+}
+
+static void scan_simd(sweep_ctx_t *ctx, const int *in, long *out, long n)
+{
+    (void) ctx;
+    scan_simd_run(in, out, n, 0);
+}
+
+static void scan_two_pass(sweep_ctx_t *ctx, const int *in, long *out, long n)
+{
+    #pragma omp parallel num_threads(ctx->num_threads)
+    {
+        int tid = omp_get_thread_num();
+        int num_threads = omp_get_num_threads();
+        long start = n * tid / num_threads;
+        long end = n * (tid + 1) / num_threads;
+
+        ctx->carries[tid * 8] = sum_run(in + start, end - start);
+        #pragma omp barrier
+        long base = 0;
+        for (int t = 0; t < tid; t++)
+            base += ctx->carries[t * 8];
+        scan_simd_run(in + start, out + start, end - start, base);
+    }
+}
+
+static void scan_lib(sweep_ctx_t *ctx, const int *in, long *out, long n)
+{
+    scan_i32_i64(ctx->scan, in, out, n);
+}
+
+static void scan_tiled(sweep_ctx_t *ctx, const int *in, long *out, long n)
+{
+    #pragma omp parallel num_threads(ctx->num_threads)
+    {
+        int tid = omp_get_thread_num();
+        int num_threads = omp_get_num_threads();
+        long round_elems = (long) num_threads * TILE_ELEMS;
+        long carry = 0;         // every thread keeps the same running carry
+        int parity = 0;
+
+        for (long round = 0; round < n; round += round_elems) {
+            // the sums of two consecutive rounds go to different lines, so a
+            // thread may start the next round before the others have read
+            // this one
+            long *sums = ctx->carries + parity * num_threads * 8;
+            long start = round + (long) tid * TILE_ELEMS;
+            long end = start + TILE_ELEMS;
+            if (start > n)
+                start = n;
+            if (end > n)
+                end = n;
+
+            sums[tid * 8] = sum_run(in + start, end - start);
+            #pragma omp barrier
+            long base = carry;
+            for (int t = 0; t < num_threads; t++) {
+                if (t == tid)
+                    base = carry;
+                carry += sums[t * 8];
+            }
+            scan_simd_run(in + start, out + start, end - start, base);
+            parity ^= 1;
+        }
+    }
+}
+
+static void scan_single_pass(sweep_ctx_t *ctx, const int *in, long *out, long n)
+{
+    long num_tiles = (n + TILE_ELEMS - 1) / TILE_ELEMS;
+    long next_tile = 0;
+    long epoch = ++ctx->epoch;
+    long has_aggregate = 2 * epoch + 1;
+    long has_inclusive = 2 * epoch + 2;
+
+    #pragma omp parallel num_threads(ctx->num_threads)
+    {
+        long k;
+        // tiles are taken in order, so the owners of the previous tiles are
+        // running and the look-back can not wait forever
+        while ((k = __atomic_fetch_add(&next_tile, 1, __ATOMIC_RELAXED)) < num_tiles) {
+            tile_status_t *status = ctx->status;
+            long start = k * TILE_ELEMS;
+            long end = (start + TILE_ELEMS < n) ? start + TILE_ELEMS : n;
+            long sum = sum_run(in + start, end - start);
+            long base = 0;
+
+            if (k == 0) {
+                status[k].inclusive = sum;
+                __atomic_store_n(&status[k].flag, has_inclusive, __ATOMIC_RELEASE);
+            } else {
+                status[k].aggregate = sum;
+                __atomic_store_n(&status[k].flag, has_aggregate, __ATOMIC_RELEASE);
+                for (long j = k - 1; ; ) {
+                    long flag = __atomic_load_n(&status[j].flag, __ATOMIC_ACQUIRE);
+                    if (flag == has_inclusive) {
+                        base += status[j].inclusive;
+                        break;
+                    } else if (flag == has_aggregate) {
+                        base += status[j].aggregate;
+                        j--;
+                    } else {
+                        sched_yield();
+                    }
+                }
+                status[k].inclusive = base + sum;
+                __atomic_store_n(&status[k].flag, has_inclusive, __ATOMIC_RELEASE);
+            }
+            scan_simd_run(in + start, out + start, end - start, base);
+        }
+    }
+}
+
+#ifdef VERIFY
+// verify_scan: out[i] - out[i-1] == in[i] for all i, in parallel; returns
+// the first wrong position, or n if all is right
+long verify_scan(const int *in, const long *out, long n)
+{
+    long first_error = n;
+    long i;
+
+    #pragma omp parallel for schedule(static) reduction(min:first_error)
+    for (i = 0; i < n; i++) {
+        long prev = (i == 0) ? 0 : out[i-1];
+        if (out[i] - prev != in[i] && i < first_error)
+            first_error = i;
+    }
+
+    return first_error;
+}
+#endif // #ifdef VERIFY
+
+// parse_bytes: a size with an optional K, M or G suffix
+long parse_bytes(const char *arg)
+{
+    char *suffix;
+    double bytes = strtod(arg, &suffix);
+    if (*suffix == 'K' || *suffix == 'k')
+        bytes *= 1024;
+    else if (*suffix == 'M' || *suffix == 'm')
+        bytes *= 1024 * 1024;
+    else if (*suffix == 'G' || *suffix == 'g')
+        bytes *= 1024.0 * 1024 * 1024;
+    return (long) bytes;
+}
+
+// format_bytes: bytes with a K, M or G suffix
+void format_bytes(char *buf, double bytes)
+{
+    if (bytes >= 1024.0 * 1024 * 1024)
+        sprintf(buf, "%.1fG", bytes / (1024.0 * 1024 * 1024));
+    else if (bytes >= 1024 * 1024)
+        sprintf(buf, "%.1fM", bytes / (1024 * 1024));
+    else
+        sprintf(buf, "%.1fK", bytes / 1024);
+}
+
+int main(int argc, char *argv[])
+{
+    long max_bytes = 0;
+    int num_threads = 0;
+
+    struct timeval start_time, end_time;  // for gettimeofday to calculate timing
+
+    char filename[256] = "prefixsum_sweep_";
+    FILE *fp = NULL;
+
+    if (argc < 3) {
+        printf("Usage: %s [max_bytes] [num_threads]\n", argv[0]);
+        printf("    - max_bytes: largest working set (input and output), with K, M or G suffix\n");
+        printf("    - num_threads: number of threads\n");
+        exit(-1);
+    }
+
+    max_bytes = parse_bytes(argv[1]);
+    num_threads = atoi(argv[2]);
+
+    if (num_threads < 1) {
+        printf("Number of threads should be more than one!\n");
+        exit(-1);
+    }
+    if (max_bytes < MIN_BYTES) {
+        printf("The largest working set should be at least %d bytes!\n", MIN_BYTES);
+        exit(-1);
+    }
+
+    strcat(filename, argv[1]);
+    strcat(filename, "bytes_");
+    strcat(filename, argv[2]);
+    strcat(filename, "threads.txt");
+
+    fp = fopen(filename, "w");
+    if (fp) {
+        printf("Command line: %s %s %d\n", argv[0], argv[1], num_threads);
+        printf("Stats file: %s\n\n", filename);
+        fprintf(fp, "Command line: %s %s %d\n", argv[0], argv[1], num_threads);
+        fprintf(fp, "Stats file: %s\n\n", filename);
+    } else {
+        printf("ERROR: can't open the file %s!\n", filename);
+        exit(-1);
+    }
+
+    // Memory allocation for the largest working set
+    long max_elems = max_bytes / BYTES_PER_ELEM;
+    long max_tiles = (max_elems + TILE_ELEMS - 1) / TILE_ELEMS;
+    int *data = (int *) malloc(sizeof(int) * max_elems);
+    long *prefix_sums = (long *) malloc(sizeof(long) * max_elems);
+    sweep_ctx_t ctx;
+    ctx.num_threads = num_threads;
+    ctx.epoch = 0;
+    ctx.scan = scan_ctx_create(num_threads);
+    ctx.carries = (long *) aligned_alloc(64, sizeof(long) * 2 * 8 * num_threads);
+    ctx.status = (tile_status_t *) aligned_alloc(64, sizeof(tile_status_t) * max_tiles);
+    if (data == NULL || prefix_sums == NULL || ctx.scan == NULL ||
+        ctx.carries == NULL || ctx.status == NULL) {
+        printf("Failed in malloc()\n");
+        printf(" - data: %p\n", data);
+        printf(" - prefix_sums: %p\n", prefix_sums);
+        exit(-2);
+    }
+    memset(ctx.status, 0, sizeof(tile_status_t) * max_tiles);
+
+    // set number of threads
+    omp_set_num_threads(num_threads);
+
+    // Generate random ints in parallel, the threads touch the pages first;
+    // K stays at least 2 for working sets beyond MAX_INT elements
+    long K = MAX_INT / max_elems;
+    if (K < 2)
+        K = 2;
+
+    #pragma omp parallel
+    {
+        int tid = omp_get_thread_num();
+        unsigned int seed = tid + time(NULL);
+        long i;
+
+        #pragma omp for schedule(static)
+        for (i = 0; i < max_elems; i++) {
+            data[i] = rand_r(&seed) % K;
+            prefix_sums[i] = 0;
+        }
+    }
+
+    printf("Start ...\n");
+    fprintf(fp, "Start ...\n");
+    printf("Per kernel: ns per element, GB/s of the working set\n");
+    fprintf(fp, "Per kernel: ns per element, GB/s of the working set\n");
+    printf("%-9s %12s", "working", "elems");
+    fprintf(fp, "%-9s %12s", "working", "elems");
+
+    const char *kernel_names[NUM_KERNELS] =
+        {"scalar", "simd", "two pass", "scan-add", "tiled", "single pass"};
+    const kernel_t kernels[NUM_KERNELS] =
+        {scan_scalar, scan_simd, scan_two_pass, scan_lib, scan_tiled,
+         scan_single_pass};
+    int k;
+    for (k = 0; k < NUM_KERNELS; k++) {
+        printf(" | %-14s", kernel_names[k]);
+        fprintf(fp, " | %-14s", kernel_names[k]);
+    }
+    printf(" | best\n");
+    fprintf(fp, " | best\n");
+
+    int errors = 0;
+    for (int step = 0; ; step++) {
+        double bytes = MIN_BYTES * pow(2.0, (double) step / STEPS_PER_DOUBLING);
+        long n = (long) bytes / BYTES_PER_ELEM;
+        if (bytes > max_bytes)
+            break;
+        char size[32];
+        format_bytes(size, bytes);
+        printf("%-9s %12ld", size, n);
+        fprintf(fp, "%-9s %12ld", size, n);
+
+        int best = 0;
+        double best_ns = 0;
+        for (k = 0; k < NUM_KERNELS; k++) {
+            double samples[NUM_SAMPLES];
+            long reps = 1;
+
+#ifdef VERIFY
+            // poison the output, so a kernel is not checked against what the
+            // previous one left in prefix_sums
+            long i;
+            #pragma omp parallel for schedule(static)
+            for (i = 0; i < n; i++)
+                prefix_sums[i] = -1;
+#endif // #ifdef VERIFY
+            // warm up, then double the repetitions until a sample is long
+            // enough for gettimeofday
+            kernels[k](&ctx, data, prefix_sums, n);
+#ifdef VERIFY
+            long bad = verify_scan(data, prefix_sums, n);
+            if (bad < n) {
+                printf("\nWrong %s prefix sum implementation: %ld elements, error at position %ld\n",
+                        kernel_names[k], n, bad);
+                errors++;
+            }
+#endif // #ifdef VERIFY
+            for (int s = 0; s < NUM_SAMPLES; s++) {
+                suseconds_t sample_usec;
+                for (;;) {
+                    gettimeofday(&start_time, NULL);
+                    for (long r = 0; r < reps; r++)
+                        kernels[k](&ctx, data, prefix_sums, n);
+                    gettimeofday(&end_time, NULL);
+                    sample_usec = usec(start_time, end_time);
+                    if (sample_usec >= MIN_SAMPLE_USEC || s > 0)
+                        break;
+                    reps *= 2;
+                }
+                samples[s] = (double) sample_usec / reps;
+            }
+            qsort(samples, NUM_SAMPLES, sizeof(double), compare_double);
+
+            double ns_per_elem = 1000.0 * samples[NUM_SAMPLES / 2] / n;
+            double gb_per_sec = BYTES_PER_ELEM / ns_per_elem;
+            if (k == 0 || ns_per_elem < best_ns) {
+                best = k;
+                best_ns = ns_per_elem;
+            }
+            printf(" | %6.3f %7.2f", ns_per_elem, gb_per_sec);
+            fprintf(fp, " | %6.3f %7.2f", ns_per_elem, gb_per_sec);
+        }
+        printf(" | %s\n", kernel_names[best]);
+        fprintf(fp, " | %s\n", kernel_names[best]);
+    }
+
+    printf("Finish OpenMP Prefix Sum working-set sweep\n");
+    fprintf(fp, "Finish OpenMP Prefix Sum working-set sweep\n");
+
+    // free the allocated memory
+    free(data);
+    free(prefix_sums);
+    free(ctx.carries);
+    free(ctx.status);
+    scan_ctx_destroy(ctx.scan);
+
+    fclose(fp);
+
+    return errors ? -1 : 0;
+}
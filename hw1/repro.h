@@ -0,0 +1,153 @@
+/*
+ * repro.h
+ *
+ * Description: Fixed-point pre-rounding of the reproducible scans
+ * (prefixsum_repro.c with OpenMP, prefixsum_repro_mpi.c with MPI). Every
+ * element is split exactly into REPRO_BINS bin values on a grid fixed by the
+ * maximum magnitude and the number of elements; the bin values add up
+ * exactly in a double, so their sums do not depend on the summation order.
+ *
+ * The including file defines real_t and REPRO_BINS (1 for float, 2 for
+ * double) before including this header.
+ */
+
+#ifndef REPRO_H
+#define REPRO_H
+
+#include <math.h>
+
+#if !defined(REPRO_BINS) || REPRO_BINS < 1 || REPRO_BINS > 2
+#error "define real_t and REPRO_BINS (1 or 2) before including repro.h"
+#endif
+
+// splitmix64: counter-based generator, element i only depends on i
+static inline unsigned long splitmix64(unsigned long x)
+{
+    x += 0x9E3779B97F4A7C15UL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9UL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBUL;
+    return x ^ (x >> 31);
+}
+
+// Fixed-point grid shared by all the threads and processes: bin k holds
+// multiples of its own power of two, coarse enough that num_elems of them add
+// up exactly in a double. round[k] = 1.5 * 2^52 * ulp(bin k) rounds to the
+// bin grid with one addition and one subtraction.
+typedef struct {
+    double round[REPRO_BINS];
+} repro_grid_t;
+
+// repro_grid_init: bin 0 keeps 53 - headroom bits below the maximum
+// magnitude, every further bin the next 53 - headroom bits of the remainder
+static inline void repro_grid_init(repro_grid_t *grid, double max_abs,
+                                   long num_elems)
+{
+    int headroom = 1, exponent = 0, k;
+    while ((1L << headroom) <= num_elems && headroom < 52)
+        headroom++;
+    if (max_abs > 0)
+        frexp(max_abs, &exponent);  // max_abs < 2^exponent
+    for (k = 0; k < REPRO_BINS; k++)
+        grid->round[k] = ldexp(1.5, 52 + exponent - (k + 1) * (53 - headroom));
+}
+
+// repro_round: y rounded to the grid of bin k
+static inline double repro_round(const repro_grid_t *grid, int k, double y)
+{
+    return (y + grid->round[k]) - grid->round[k];
+}
+
+// repro_split: split x exactly into its bin values (pre-rounding)
+static inline void repro_split(const repro_grid_t *grid, real_t x, double *q)
+{
+    double y = x;
+    int k;
+    for (k = 0; k < REPRO_BINS; k++) {
+        q[k] = repro_round(grid, k, y);
+        y -= q[k];
+    }
+}
+
+// repro_value: deterministic conversion of the exact bin sums to real_t
+static inline real_t repro_value(const double *q)
+{
+#if REPRO_BINS == 1
+    return (real_t) q[0];
+#else
+    return (real_t) (q[0] + q[1]);
+#endif
+}
+
+// repro_totals: totals[k] is the sum of the bin k values of data[0..n); the
+// bin values add up exactly, so the SIMD lanes may sum in any order. The
+// split is written out per bin: GCC does not vectorize it through the q
+// array of repro_split.
+static inline void repro_totals(const repro_grid_t *grid, const real_t *data,
+                                long n, double *totals)
+{
+    double total0 = 0, total1 = 0;
+    long i;
+    #pragma omp simd reduction(+:total0, total1)
+    for (i = 0; i < n; i++) {
+        double q0 = repro_round(grid, 0, data[i]);
+        total0 += q0;
+#if REPRO_BINS == 2
+        total1 += repro_round(grid, 1, data[i] - q0);
+#endif
+    }
+    totals[0] = total0;
+#if REPRO_BINS == 2
+    totals[1] = total1;
+#endif
+}
+
+#define REPRO_BLOCK 256        // elements split at once by the rescan
+
+// repro_rescan: prefix_sums[i] is the conversion of sums plus the bin values
+// of data[0..i]; sums holds the REPRO_BINS running bin sums and is advanced
+// past the n elements. Every block is split in one SIMD loop (written out
+// per bin as in repro_totals), then scanned four elements at a time as a
+// tree off the running sum: one dependent addition per four elements instead
+// of one per element, and since the additions are exact, the same bits as
+// the serial order.
+static inline void repro_rescan(const repro_grid_t *grid, const real_t *data,
+                                real_t *prefix_sums, long n, double *sums)
+{
+    double q[REPRO_BINS][REPRO_BLOCK];
+    double run[4][REPRO_BINS];
+    long i, j, m;
+    int k;
+
+    for (i = 0; i < n; i += m) {
+        m = n - i < REPRO_BLOCK ? n - i : REPRO_BLOCK;
+        #pragma omp simd
+        for (j = 0; j < m; j++) {
+            q[0][j] = repro_round(grid, 0, data[i + j]);
+#if REPRO_BINS == 2
+            q[1][j] = repro_round(grid, 1, data[i + j] - q[0][j]);
+#endif
+        }
+        for (j = 0; j + 4 <= m; j += 4) {
+            for (k = 0; k < REPRO_BINS; k++) {
+                double q01 = q[k][j] + q[k][j + 1];
+                double q23 = q[k][j + 2] + q[k][j + 3];
+                run[0][k] = sums[k] + q[k][j];
+                run[1][k] = sums[k] + q01;
+                run[2][k] = run[1][k] + q[k][j + 2];
+                run[3][k] = sums[k] + (q01 + q23);
+                sums[k] = run[3][k];
+            }
+            prefix_sums[i + j] = repro_value(run[0]);
+            prefix_sums[i + j + 1] = repro_value(run[1]);
+            prefix_sums[i + j + 2] = repro_value(run[2]);
+            prefix_sums[i + j + 3] = repro_value(run[3]);
+        }
+        for (; j < m; j++) {
+            for (k = 0; k < REPRO_BINS; k++)
+                sums[k] += q[k][j];
+            prefix_sums[i + j] = repro_value(sums);
+        }
+    }
+}
+
+#endif // REPRO_H
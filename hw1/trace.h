@@ -0,0 +1,173 @@
+/*
+ * trace.h
+ *
+ * Description: Phase timeline tracing, compiled in with -DTRACE and empty
+ * otherwise. Every thread appends (phase, begin, end) events to its own
+ * preallocated buffer, so recording is a clock read and a store with no
+ * locks and no allocation; the buffers are written after the run as Chrome
+ * trace JSON (chrome://tracing, ui.perfetto.dev), one row per thread.
+ *
+ * Usage:
+ *   trace_init(num_threads, events_per_thread);     before the timed region
+ *   TRACE_BEGIN(t); ...; TRACE_END("local scan", t); around a phase
+ *   trace_dump(path, pid, "omp");                    after the run
+ *   trace_free();
+ *
+ * The phase name must be a string literal, only its pointer is stored. The
+ * thread is the OpenMP thread number (0 without OpenMP); events of threads
+ * beyond num_threads and events past a full buffer are counted as dropped.
+ * The state is a weak symbol, so the driver and the library sources built
+ * into the same program share one set of buffers.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#ifdef TRACE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+typedef struct {
+    const char *name;
+    double begin;               // usec since trace_init
+    double end;
+} trace_event_t;
+
+// one cache line per thread for the counters
+typedef struct {
+    trace_event_t *events;
+    long count;
+} __attribute__((aligned(64))) trace_buffer_t;
+
+typedef struct {
+    int num_threads;
+    long capacity;              // events per thread
+    double origin;              // trace_now() at trace_init
+    long dropped;
+    trace_buffer_t *buffers;
+} trace_state_t;
+
+__attribute__((weak)) trace_state_t trace_state;
+
+// trace_now: monotonic clock in microseconds
+static inline double trace_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec * 1e-3;
+}
+
+// trace_init: allocate the buffers and start the clock; returns 0, or -1 if
+// out of memory
+static inline int trace_init(int num_threads, long events_per_thread)
+{
+    trace_buffer_t *buffers = (trace_buffer_t *) aligned_alloc(64,
+                                  sizeof(trace_buffer_t) * num_threads);
+    if (buffers == NULL)
+        return -1;
+    for (int t = 0; t < num_threads; t++) {
+        buffers[t].events = (trace_event_t *) malloc(sizeof(trace_event_t) *
+                                                     events_per_thread);
+        buffers[t].count = 0;
+        if (buffers[t].events == NULL) {
+            while (t-- > 0)
+                free(buffers[t].events);
+            free(buffers);
+            return -1;
+        }
+    }
+    trace_state.num_threads = num_threads;
+    trace_state.capacity = events_per_thread;
+    trace_state.dropped = 0;
+    trace_state.buffers = buffers;
+    trace_state.origin = trace_now();
+
+    return 0;
+}
+
+static inline void trace_record(const char *name, double begin, double end)
+{
+#ifdef _OPENMP
+    int tid = omp_get_thread_num();
+#else
+    int tid = 0;
+#endif
+    trace_buffer_t *buffer;
+
+    if (trace_state.buffers == NULL)
+        return;
+    if (tid >= trace_state.num_threads) {
+        __atomic_fetch_add(&trace_state.dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    buffer = &trace_state.buffers[tid];
+    if (buffer->count == trace_state.capacity) {
+        __atomic_fetch_add(&trace_state.dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    buffer->events[buffer->count].name = name;
+    buffer->events[buffer->count].begin = begin - trace_state.origin;
+    buffer->events[buffer->count].end = end - trace_state.origin;
+    buffer->count++;
+}
+
+// trace_write_events: the events of this process as complete ("X") events
+// of process pid named process_name, without the enclosing array, so several
+// processes can append to one file; first tells whether an event was written
+// before. Returns the new value of first.
+static inline int trace_write_events(FILE *fp, int pid,
+                                     const char *process_name, int first)
+{
+    fprintf(fp, "%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,"
+                "\"args\":{\"name\":\"%s\"}}\n", first ? "" : ",", pid, process_name);
+    for (int t = 0; t < trace_state.num_threads; t++) {
+        trace_buffer_t *buffer = &trace_state.buffers[t];
+        for (long k = 0; k < buffer->count; k++) {
+            trace_event_t *event = &buffer->events[k];
+            fprintf(fp, ",{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,"
+                        "\"ts\":%.3f,\"dur\":%.3f}\n", event->name, pid, t,
+                    event->begin, event->end - event->begin);
+        }
+    }
+
+    return 0;
+}
+
+// trace_dump: write the events of this process to path as a whole trace
+// file; returns 0, or -1 if the file can't be opened
+static inline int trace_dump(const char *path, int pid, const char *process_name)
+{
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL)
+        return -1;
+    fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    trace_write_events(fp, pid, process_name, 1);
+    fprintf(fp, "]}\n");
+    fclose(fp);
+
+    return 0;
+}
+
+static inline void trace_free(void)
+{
+    if (trace_state.buffers == NULL)
+        return;
+    for (int t = 0; t < trace_state.num_threads; t++)
+        free(trace_state.buffers[t].events);
+    free(trace_state.buffers);
+    trace_state.buffers = NULL;
+}
+
+#define TRACE_BEGIN(t) double t = trace_now()
+#define TRACE_END(name, t) trace_record(name, t, trace_now())
+#else
+#define TRACE_BEGIN(t)
+#define TRACE_END(name, t) ((void) 0)
+#endif // #ifdef TRACE
+
+#endif // TRACE_H